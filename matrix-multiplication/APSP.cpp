@@ -0,0 +1,223 @@
+// #define DEBUG
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <utility>
+
+#include "Gemm.h"
+#include "Matrix.h"
+#include "Semiring.h"
+#include "Verify.h"
+#include "WorkStealingPool.h"
+
+using namespace std;
+using namespace std::chrono;
+
+//
+// All-pairs shortest paths, by repeated squaring in the (min, +) semiring.
+//
+// If D holds the shortest distances using at most h edges, then D * D in (min, +) holds the shortest
+// distances using at most 2h edges. Starting from the edge weights, with zeros on the diagonal, about
+// log2(n) squarings therefore find every shortest path. Each squaring is an ordinary GEMM apart from
+// its arithmetic, so it runs on the same blocked engine, and its rows are shared between threads.
+//
+
+// Generates a random directed graph with weights between 1 and 100; missing edges have infinite weight
+template<typename T>
+Matrix<T> random_graph(int vertices, double degree, optional<int> seed)
+{
+  mt19937 engine;
+  if (seed) {
+    engine.seed(*seed);
+  } else {
+    random_device rd;
+    engine.seed(rd());
+  }
+
+  bernoulli_distribution edge(min(1.0, degree / max(1, vertices - 1)));
+  uniform_int_distribution<int> weight(1, 100);
+
+  Matrix<T> graph(vertices, vertices);
+  for (int i = 0; i < vertices; i++) {
+    for (int j = 0; j < vertices; j++) {
+      const bool present = i != j && edge(engine);
+      graph.set(i, j, i == j ? T(0) : present ? T(weight(engine)) : MinPlus<T>::infinity());
+    }
+  }
+
+  return graph;
+}
+
+// Computes next = distances * distances in (min, +), sharing the rows between the workers in the pool
+template<typename T>
+void square(const Matrix<T> &distances, Matrix<T> &next, WorkStealingPool &pool)
+{
+  // a few tasks per worker, so that the pool can balance the load
+  const int vertices = distances.rows();
+  const int rows_per_task = max(16, vertices / (4 * pool.size()));
+
+  pool.parallel_for(0, vertices, rows_per_task, [&](int m_begin, int m_end) {
+    semiring_gemm<MinPlus<T>>(distances, distances, next, m_begin, m_end);
+  });
+}
+
+// Reference implementation, used to check the result; Floyd-Warshall also takes O(n^3) time
+template<typename T>
+Matrix<T> floyd_warshall(const Matrix<T> &graph)
+{
+  Matrix<T> distances(graph);
+  const int vertices = graph.rows();
+  for (int k = 0; k < vertices; k++) {
+    for (int i = 0; i < vertices; i++) {
+      const T through = distances.get(i, k);
+      for (int j = 0; j < vertices; j++) {
+        distances.set(i, j, MinPlus<T>::add(distances.get(i, j), MinPlus<T>::multiply(through, distances.get(k, j))));
+      }
+    }
+  }
+
+  return distances;
+}
+
+template<typename T>
+int all_pairs_shortest_paths(int vertices, double degree, int num_threads, optional<int> seed)
+{
+  const Matrix<T> graph = random_graph<T>(vertices, degree, seed);
+
+  size_t edges = 0;
+  for (size_t i = 0; i < graph.size(); i++) {
+    edges += graph.data()[i] != 0 && graph.data()[i] != MinPlus<T>::infinity();
+  }
+  cout << "Vertices: " << vertices << ", edges: " << edges << endl;
+
+#ifdef DEBUG
+  cout << "Graph:" << endl;
+  cout << graph << endl;
+#endif
+
+  WorkStealingPool pool(num_threads);
+  Matrix<T> distances(graph);
+  Matrix<T> next(vertices, vertices);
+
+  // do the work, stopping early if the distances stop changing
+  auto start = high_resolution_clock::now();
+
+  int squarings = 0;
+  for (long hops = 1; hops < vertices - 1; hops *= 2) {
+    square(distances, next, pool);
+    squarings++;
+
+    const bool converged = equal(distances.data(), distances.data() + distances.size(), next.data());
+    swap(distances, next);
+    if (converged) {
+      break;
+    }
+  }
+
+  auto stop = high_resolution_clock::now();
+
+#ifdef DEBUG
+  cout << "Distances:" << endl;
+  cout << distances << endl;
+#endif
+
+  size_t reachable = 0;
+  for (size_t i = 0; i < distances.size(); i++) {
+    reachable += distances.data()[i] != MinPlus<T>::infinity();
+  }
+  cout << "Reachable pairs: " << reachable << " of " << distances.size() << endl;
+
+  // how long did it take?
+  auto duration = duration_cast<microseconds>(stop - start);
+  cout << "Squarings: " << squarings << endl;
+  cout << "Duration: " << duration.count() << " microseconds (" << (double(duration.count()) / 1000000.0f) << " seconds)" << endl;
+
+  // how fast was it? each squaring takes one addition and one minimum per inner step
+  const double operations = 2.0 * vertices * vertices * double(vertices) * squarings;
+  cout << "Throughput: " << (operations / max<double>(duration.count(), 1) / 1000.0) << " GOP/s ("
+       << semiring_kernel<MinPlus<T>>().name << " micro-kernel)" << endl;
+
+  // (min, +) has no subtraction for Freivalds' algorithm, so the result is compared with Floyd-Warshall
+  const bool passed = verify_against("Floyd-Warshall", [&]() {
+    const Matrix<T> expected = floyd_warshall(graph);
+    return equal(expected.data(), expected.data() + expected.size(), distances.data());
+  });
+  if (!passed) {
+    return 1;
+  }
+
+  return 0;
+}
+
+int usage(char **argv)
+{
+  cout << endl;
+  cout << "Usage:" << endl;
+  cout << "  " << argv[0] << " <vertices> <num-threads> [average-degree] [float|int] [seed]" << endl;
+  cout << endl;
+  cout << "Finds the shortest paths between every pair of vertices in a random directed graph" << endl;
+  cout << endl;
+  cout << "By default, each vertex has 8 outgoing edges on average, and distances are floats" << endl;
+
+  return 1;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc == 1) {
+    return usage(argv);
+  }
+
+  if (argc < 3 || argc > 6) {
+    cout << "Invalid argument count: " << argc << endl;
+    return usage(argv);
+  }
+
+  int vertices = atoi(argv[1]);
+  if (vertices <= 0) {
+    cout << "Argument <vertices> is invalid" << endl;
+    return usage(argv);
+  }
+
+  int num_threads = atoi(argv[2]);
+  if (num_threads <= 0) {
+    cout << "Argument <num-threads> is invalid" << endl;
+    return usage(argv);
+  }
+
+  double degree = 8;
+  if (argc >= 4) {
+    degree = atof(argv[3]);
+    if (degree < 0) {
+      cout << "Argument [average-degree] is invalid" << endl;
+      return usage(argv);
+    }
+  }
+
+  bool integers = false;
+  if (argc >= 5) {
+    if (strcmp(argv[4], "int") == 0) {
+      integers = true;
+    } else if (strcmp(argv[4], "float") != 0) {
+      cout << "Argument [float|int] is invalid" << endl;
+      return usage(argv);
+    }
+  }
+
+  optional<int> seed;
+  if (argc == 6) {
+    seed = atoi(argv[5]);
+    cout << "Random seed: " << *seed << endl;
+  }
+
+  if (integers) {
+    return all_pairs_shortest_paths<int>(vertices, degree, num_threads, seed);
+  } else {
+    return all_pairs_shortest_paths<float>(vertices, degree, num_threads, seed);
+  }
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+//
+// A bump allocator for short-lived temporaries.
+//
+// All of the memory is reserved by a single heap allocation up front. Allocations are carved from it
+// in order, and are released all at once by rolling back to an earlier mark, which takes O(1) time.
+// This suits recursive algorithms, where the temporaries for each level are released before the caller
+// continues, and where the total amount of memory needed can be computed in advance.
+//
+class Arena
+{
+public:
+  // every allocation is aligned to a cache line, which is also sufficient for SIMD loads
+  static constexpr size_t alignment = 64;
+
+  Arena(size_t capacity)
+    : m_capacity(round_up(capacity))
+    , m_used(0)
+    , m_peak(0)
+    , m_allocations(0)
+  {
+    m_memory = static_cast<char*>(std::aligned_alloc(alignment, std::max(m_capacity, alignment)));
+    if (!m_memory) {
+      throw std::bad_alloc();
+    }
+  }
+
+  ~Arena()
+  {
+    std::free(m_memory);
+  }
+
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  template<typename T>
+  T* allocate(size_t count)
+  {
+    const size_t size = round_up(count * sizeof(T));
+    if (m_used + size > m_capacity) {
+      throw std::bad_alloc();
+    }
+
+    T *ptr = reinterpret_cast<T*>(m_memory + m_used);
+    m_used += size;
+    m_peak = std::max(m_peak, m_used);
+    m_allocations++;
+    return ptr;
+  }
+
+  // Returns a mark that can later be passed to release()
+  size_t mark() const
+  {
+    return m_used;
+  }
+
+  // Releases everything that was allocated since 'mark' was taken
+  void release(size_t mark)
+  {
+    assert(mark <= m_used);
+    m_used = mark;
+  }
+
+  size_t allocations() const
+  {
+    return m_allocations;
+  }
+
+  size_t capacity() const
+  {
+    return m_capacity;
+  }
+
+  size_t peak() const
+  {
+    return m_peak;
+  }
+
+  // Amount of arena memory needed to allocate 'count' objects of type T
+  template<typename T>
+  static size_t footprint(size_t count)
+  {
+    return round_up(count * sizeof(T));
+  }
+
+private:
+  static size_t round_up(size_t size)
+  {
+    return (size + alignment - 1) / alignment * alignment;
+  }
+
+  char *m_memory;
+  size_t m_capacity;
+  size_t m_used;
+  size_t m_peak;
+  size_t m_allocations;
+};
+
+// Releases everything allocated from an arena during the lifetime of the scope
+class ArenaScope
+{
+public:
+  ArenaScope(Arena &arena)
+    : m_arena(arena)
+    , m_mark(arena.mark()) {}
+
+  ~ArenaScope()
+  {
+    m_arena.release(m_mark);
+  }
+
+  ArenaScope(const ArenaScope&) = delete;
+  ArenaScope& operator=(const ArenaScope&) = delete;
+
+private:
+  Arena &m_arena;
+  size_t m_mark;
+};
@@ -0,0 +1,214 @@
+// #define DEBUG
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <optional>
+
+#include "Batched.h"
+#include "Gemm.h"
+#include "Matrix.h"
+#include "Verify.h"
+#include "WorkStealingPool.h"
+
+using namespace std;
+using namespace std::chrono;
+
+//
+// Multiplies a large batch of small, independent square matrices, e.g. the transforms in a physics
+// simulation, using the interleaved storage and unrolled kernels in Batched.h. For comparison, some of
+// the products are also computed one at a time, with a Matrix<T> for each input and output and a call to
+// gemm() for each product.
+//
+
+// number of products that are computed one at a time for comparison
+const size_t SEPARATE_PRODUCTS = 100000;
+
+// Checks every product against a straightforward scalar loop, allowing for rounding errors
+template<typename T, int S>
+bool check_products(const MatrixBatch<T, S, S> &a, const MatrixBatch<T, S, S> &b, const MatrixBatch<T, S, S> &c)
+{
+  const double tolerance = 4.0 * S * numeric_limits<T>::epsilon();
+  for (size_t matrix = 0; matrix < c.size(); matrix++) {
+    for (int i = 0; i < S; i++) {
+      for (int j = 0; j < S; j++) {
+        double sum = 0;
+        double scale = 0;
+        for (int k = 0; k < S; k++) {
+          const double product = double(a.get(matrix, i, k)) * double(b.get(matrix, k, j));
+          sum += product;
+          scale += abs(product);
+        }
+
+        if (abs(sum - double(c.get(matrix, i, j))) > tolerance * scale) {
+          return false;
+        }
+      }
+    }
+  }
+
+  return true;
+}
+
+template<typename T, int S>
+int multiply_batch(size_t count, int num_threads, optional<int> seed)
+{
+  // input batches
+  MatrixBatch<T, S, S> batch_a(count, MatrixAllocation::HugePages);
+  batch_a.randomise(-100, 100, seed);
+
+  if (seed) {
+    seed = *seed + 1;
+  }
+
+  MatrixBatch<T, S, S> batch_b(count, MatrixAllocation::HugePages);
+  batch_b.randomise(-100, 100, seed);
+
+  // output batch
+  MatrixBatch<T, S, S> batch_c(count, MatrixAllocation::HugePages);
+
+  cout << "Matrices: " << count << " products of " << S << "x" << S << " matrices, in groups of " << batch_c.lanes << endl;
+  cout << "Memory: " << batch_c.bytes() << " bytes per batch" << endl;
+
+#ifdef DEBUG
+  Matrix<T> first(S, S);
+  batch_a.store(0, first.view());
+  cout << "First matrix A:" << endl;
+  cout << first << endl;
+  batch_b.store(0, first.view());
+  cout << "First matrix B:" << endl;
+  cout << first << endl;
+#endif
+
+  WorkStealingPool pool(num_threads);
+
+  // do the work
+  auto start = high_resolution_clock::now();
+  batched_multiply(batch_a, batch_b, batch_c, pool);
+  auto stop = high_resolution_clock::now();
+
+#ifdef DEBUG
+  batch_c.store(0, first.view());
+  cout << "First matrix C:" << endl;
+  cout << first << endl;
+#endif
+
+  // how long did it take?
+  auto duration = duration_cast<microseconds>(stop - start);
+  cout << "Duration: " << duration.count() << " microseconds (" << (double(duration.count()) / 1000000.0f) << " seconds)" << endl;
+
+  // how fast was it? each product reads two matrices and writes one
+  const double us = max<double>(duration.count(), 1);
+  const double flops = 2.0 * S * S * S * count;
+  const double bytes = 3.0 * S * S * sizeof(T) * count;
+  cout << "Throughput: " << (flops / us / 1000.0) << " GFLOP/s, " << (bytes / us / 1000.0) << " GB/s ("
+       << batched_kernel<T, S, S, S>().name << " kernel)" << endl;
+
+  // compare with products computed one at a time, on one thread
+  const size_t separate = min(count, SEPARATE_PRODUCTS);
+  auto separate_start = high_resolution_clock::now();
+  for (size_t matrix = 0; matrix < separate; matrix++) {
+    Matrix<T> matrix_a(S, S);
+    Matrix<T> matrix_b(S, S);
+    Matrix<T> matrix_c(S, S);
+    batch_a.store(matrix, matrix_a.view());
+    batch_b.store(matrix, matrix_b.view());
+
+    gemm(matrix_a, matrix_b, matrix_c);
+  }
+  auto separate_duration = duration_cast<nanoseconds>(high_resolution_clock::now() - separate_start);
+
+  const double threads = pool.size();
+  cout << "Per product: " << (duration_cast<nanoseconds>(stop - start).count() * threads / count)
+       << " nanoseconds of thread time batched, " << (double(separate_duration.count()) / separate)
+       << " nanoseconds separately (" << separate << " products with Matrix<T> and gemm)" << endl;
+
+  // every product is recomputed, since Freivalds' algorithm would save no work on such small matrices
+  if (!verify_against("scalar products", [&]() { return check_products(batch_a, batch_b, batch_c); })) {
+    return 1;
+  }
+
+  return 0;
+}
+
+template<typename T>
+int multiply_batch(int size, size_t count, int num_threads, optional<int> seed)
+{
+  switch (size) {
+    case 4:
+      return multiply_batch<T, 4>(count, num_threads, seed);
+    case 8:
+      return multiply_batch<T, 8>(count, num_threads, seed);
+    case 16:
+      return multiply_batch<T, 16>(count, num_threads, seed);
+    default:
+      return multiply_batch<T, 32>(count, num_threads, seed);
+  }
+}
+
+int usage(char **argv)
+{
+  cout << endl;
+  cout << "Usage:" << endl;
+  cout << "  " << argv[0] << " <4|8|16|32> <count> <num-threads> [double|float] [seed]" << endl;
+  cout << endl;
+  cout << "Multiplies <count> pairs of random square matrices of the given size, in one batch" << endl;
+
+  return 1;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc == 1) {
+    return usage(argv);
+  }
+
+  if (argc < 4 || argc > 6) {
+    cout << "Invalid argument count: " << argc << endl;
+    return usage(argv);
+  }
+
+  int size = atoi(argv[1]);
+  if (size != 4 && size != 8 && size != 16 && size != 32) {
+    cout << "Argument <4|8|16|32> is invalid" << endl;
+    return usage(argv);
+  }
+
+  long count = atol(argv[2]);
+  if (count <= 0) {
+    cout << "Argument <count> is invalid" << endl;
+    return usage(argv);
+  }
+
+  int num_threads = atoi(argv[3]);
+  if (num_threads <= 0) {
+    cout << "Argument <num-threads> is invalid" << endl;
+    return usage(argv);
+  }
+
+  bool single = false;
+  if (argc >= 5) {
+    if (strcmp(argv[4], "float") == 0) {
+      single = true;
+    } else if (strcmp(argv[4], "double") != 0) {
+      cout << "Argument [double|float] is invalid" << endl;
+      return usage(argv);
+    }
+  }
+
+  optional<int> seed;
+  if (argc == 6) {
+    seed = atoi(argv[5]);
+    cout << "Random seeds: " << *seed << ", " << (*seed + 1) << endl;
+  }
+
+  if (single) {
+    return multiply_batch<float>(size, count, num_threads, seed);
+  } else {
+    return multiply_batch<double>(size, count, num_threads, seed);
+  }
+}
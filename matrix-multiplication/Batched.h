@@ -0,0 +1,357 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <optional>
+#include <random>
+
+#include "Gemm_Kernels.h"
+#include "Matrix.h"
+#include "View.h"
+#include "WorkStealingPool.h"
+
+//
+// Batches of many small matrices of the same size, multiplied together.
+//
+// A 4x4 product takes 64 multiply-adds, which is less than the cost of allocating a Matrix<T> or calling
+// gemm(). A batch therefore stores all of its matrices in one allocation, and multiplies them all with one
+// call, using kernels whose dimensions are template parameters so that their loops can be fully unrolled.
+//
+// Storage is interleaved, as an array of structures of arrays: matrices are stored in groups of one cache
+// line's worth, e.g. 8 doubles, and each cell of the group is stored as a contiguous run of 8 values, one
+// from each matrix. Cell (i, j) of every matrix in a group is then one SIMD vector (or two, with AVX2), so
+// each vector instruction works on 8 independent products, and no shuffling is needed. The last group is
+// padded with zero matrices.
+//
+
+template<typename T>
+struct BatchLayout
+{
+  // matrices per group, so that each cell of a group fills one cache line
+  static constexpr int lanes = int(Matrix<T>::alignment / sizeof(T));
+};
+
+template<typename T, int M, int N>
+class MatrixBatch
+{
+  static_assert(M > 0 && N > 0, "MatrixBatch<T, M, N> requires positive dimensions");
+
+public:
+  static constexpr int lanes = BatchLayout<T>::lanes;
+
+  // values in each group
+  static constexpr int group_size = M * N * lanes;
+
+  MatrixBatch(size_t count, MatrixAllocation allocation = MatrixAllocation::Default)
+    : m_count(count)
+    , m_values(int((count + lanes - 1) / lanes), group_size, allocation)
+  {
+    m_values.view().fill(0);
+  }
+
+  static constexpr int rows()
+  {
+    return M;
+  }
+
+  static constexpr int columns()
+  {
+    return N;
+  }
+
+  // Number of matrices
+  size_t size() const
+  {
+    return m_count;
+  }
+
+  size_t groups() const
+  {
+    return size_t(m_values.rows());
+  }
+
+  size_t bytes() const
+  {
+    return m_values.size() * sizeof(T);
+  }
+
+  T get(size_t matrix, int row, int column) const
+  {
+    return m_values.data()[index(matrix, row, column)];
+  }
+
+  void set(size_t matrix, int row, int column, T value)
+  {
+    m_values.data()[index(matrix, row, column)] = value;
+  }
+
+  T* group(size_t g)
+  {
+    return m_values.data() + g * group_size;
+  }
+
+  const T* group(size_t g) const
+  {
+    return m_values.data() + g * group_size;
+  }
+
+  // Copies an M x N matrix into the batch
+  void load(size_t matrix, TileView<const T> source)
+  {
+    assert(source.rows() == M && source.columns() == N);
+    for (int i = 0; i < M; i++) {
+      for (int j = 0; j < N; j++) {
+        set(matrix, i, j, source(i, j));
+      }
+    }
+  }
+
+  // Copies a matrix out of the batch
+  void store(size_t matrix, TileView<T> destination) const
+  {
+    assert(destination.rows() == M && destination.columns() == N);
+    for (int i = 0; i < M; i++) {
+      for (int j = 0; j < N; j++) {
+        destination(i, j) = get(matrix, i, j);
+      }
+    }
+  }
+
+  // Fills every matrix with random values; the padding in the last group stays zero
+  void randomise(T min, T max, std::optional<int> seed = {})
+  {
+    std::uniform_real_distribution<T> dist(min, max);
+    std::mt19937 engine;
+    if (seed) {
+      engine.seed(*seed);
+    } else {
+      std::random_device rd;
+      engine.seed(rd());
+    }
+
+    for (size_t matrix = 0; matrix < m_count; matrix++) {
+      for (int i = 0; i < M; i++) {
+        for (int j = 0; j < N; j++) {
+          set(matrix, i, j, dist(engine));
+        }
+      }
+    }
+  }
+
+private:
+  static size_t index(size_t matrix, int row, int column)
+  {
+    assert(row >= 0 && row < M && column >= 0 && column < N);
+    return (matrix / lanes) * group_size + size_t(row * N + column) * lanes + matrix % lanes;
+  }
+
+  size_t m_count;
+  Matrix<T> m_values;
+};
+
+// A kernel computes C = A * B for 'groups' consecutive groups of a batch
+template<typename T>
+struct BatchedKernel
+{
+  const char *name;
+  void (*fn)(const T *a, const T *b, T *c, size_t groups);
+};
+
+// Largest divisor of n that is no more than 'limit', so that register tiles cover a matrix exactly
+constexpr int batched_tile(int n, int limit)
+{
+  for (int d = limit; d > 1; d--) {
+    if (n % d == 0) {
+      return d;
+    }
+  }
+
+  return 1;
+}
+
+// Loops over the tile and over K are fully unrolled, for K up to 32
+#define BATCHED_UNROLL _Pragma("GCC unroll 32")
+
+//
+// Each group is multiplied one MR x NR tile of C at a time, for one vector of lanes at a time. For every
+// k, NR vectors of B and one vector of A per row are loaded, and MR x NR multiply-adds accumulate in
+// registers. All addresses are compile-time offsets from the start of the group. The body is shared by
+// the kernels for each instruction set using a macro, as in Gemm_Kernels.h.
+//
+#define BATCHED_KERNEL_BODY                                                           \
+  using Vec = typename Ops::Vec;                                                      \
+  constexpr int W = Ops::width;                                                       \
+  constexpr int L = BatchLayout<T>::lanes;                                            \
+  constexpr int TM = batched_tile(M, MR);                                             \
+  constexpr int TN = batched_tile(N, NR);                                             \
+  static_assert(L % W == 0, "a group must be a whole number of vectors");             \
+                                                                                      \
+  for (size_t g = 0; g < groups; g++) {                                               \
+    const T *ag = a + g * (M * K * L);                                                \
+    const T *bg = b + g * (K * N * L);                                                \
+    T *cg = c + g * (M * N * L);                                                      \
+                                                                                      \
+    for (int o = 0; o < L; o += W) {                                                  \
+      for (int i0 = 0; i0 < M; i0 += TM) {                                            \
+        for (int j0 = 0; j0 < N; j0 += TN) {                                          \
+          Vec acc[TM][TN];                                                            \
+          BATCHED_UNROLL                                                              \
+          for (int i = 0; i < TM; i++) {                                              \
+            BATCHED_UNROLL                                                            \
+            for (int j = 0; j < TN; j++) {                                            \
+              acc[i][j] = Ops::zero();                                                \
+            }                                                                         \
+          }                                                                           \
+                                                                                      \
+          BATCHED_UNROLL                                                              \
+          for (int k = 0; k < K; k++) {                                               \
+            Vec row[TN];                                                              \
+            BATCHED_UNROLL                                                            \
+            for (int j = 0; j < TN; j++) {                                            \
+              row[j] = Ops::load(bg + (k * N + j0 + j) * L + o);                      \
+            }                                                                         \
+            BATCHED_UNROLL                                                            \
+            for (int i = 0; i < TM; i++) {                                            \
+              const Vec ai = Ops::load(ag + ((i0 + i) * K + k) * L + o);              \
+              BATCHED_UNROLL                                                          \
+              for (int j = 0; j < TN; j++) {                                          \
+                acc[i][j] = Ops::fma(ai, row[j], acc[i][j]);                          \
+              }                                                                       \
+            }                                                                         \
+          }                                                                           \
+                                                                                      \
+          BATCHED_UNROLL                                                              \
+          for (int i = 0; i < TM; i++) {                                              \
+            BATCHED_UNROLL                                                            \
+            for (int j = 0; j < TN; j++) {                                            \
+              Ops::store(cg + ((i0 + i) * N + j0 + j) * L + o, acc[i][j]);            \
+            }                                                                         \
+          }                                                                           \
+        }                                                                             \
+      }                                                                               \
+    }                                                                                 \
+  }
+
+// Scalar operations for the portable kernel, which the compiler may still vectorize
+template<typename T>
+struct BatchedScalar
+{
+  using Vec = T;
+  static constexpr int width = 1;
+  static Vec zero() { return T(0); }
+  static Vec load(const T *p) { return *p; }
+  static Vec fma(Vec a, Vec b, Vec c) { return a * b + c; }
+  static void store(T *p, Vec v) { *p = v; }
+};
+
+template<typename Ops, int M, int K, int N, int MR, int NR, typename T>
+void batched_generic_kernel(const T *__restrict a, const T *__restrict b, T *__restrict c, size_t groups)
+{
+  BATCHED_KERNEL_BODY
+}
+
+#ifdef GEMM_X86_KERNELS
+
+template<typename Ops, int M, int K, int N, int MR, int NR, typename T>
+GEMM_AVX2 void batched_avx2_kernel(const T *__restrict a, const T *__restrict b, T *__restrict c, size_t groups)
+{
+  BATCHED_KERNEL_BODY
+}
+
+template<typename Ops, int M, int K, int N, int MR, int NR, typename T>
+GEMM_AVX512 void batched_avx512_kernel(const T *__restrict a, const T *__restrict b, T *__restrict c, size_t groups)
+{
+  BATCHED_KERNEL_BODY
+}
+
+#endif
+
+#undef BATCHED_KERNEL_BODY
+#undef BATCHED_UNROLL
+
+// Vectorized kernels for an element type, if there are any. Tiles are chosen so that the accumulators,
+// a row of B and an element of A fit in 16 (AVX2) or 32 (AVX-512) registers.
+template<typename T>
+struct BatchedSimdKernels
+{
+  static constexpr bool available = false;
+};
+
+#ifdef GEMM_X86_KERNELS
+
+template<>
+struct BatchedSimdKernels<double>
+{
+  static constexpr bool available = true;
+  template<int M, int K, int N> static BatchedKernel<double> avx2() { return { "avx2", batched_avx2_kernel<Avx2Double, M, K, N, 2, 4, double> }; }
+  template<int M, int K, int N> static BatchedKernel<double> avx512() { return { "avx512", batched_avx512_kernel<Avx512Double, M, K, N, 4, 4, double> }; }
+};
+
+template<>
+struct BatchedSimdKernels<float>
+{
+  static constexpr bool available = true;
+  template<int M, int K, int N> static BatchedKernel<float> avx2() { return { "avx2", batched_avx2_kernel<Avx2Float, M, K, N, 2, 4, float> }; }
+  template<int M, int K, int N> static BatchedKernel<float> avx512() { return { "avx512", batched_avx512_kernel<Avx512Float, M, K, N, 4, 4, float> }; }
+};
+
+#endif
+
+template<typename T, int M, int K, int N>
+BatchedKernel<T> batched_select_kernel()
+{
+#ifdef GEMM_X86_KERNELS
+  if constexpr (BatchedSimdKernels<T>::available) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+      return BatchedSimdKernels<T>::template avx512<M, K, N>();
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+      return BatchedSimdKernels<T>::template avx2<M, K, N>();
+    }
+  }
+#endif
+
+  return { "generic", batched_generic_kernel<BatchedScalar<T>, M, K, N, 4, 4, T> };
+}
+
+// Returns the kernel used by batched_multiply() for these sizes, which is chosen once based on the features
+// of the host CPU
+template<typename T, int M, int K, int N>
+const BatchedKernel<T>& batched_kernel()
+{
+  static const BatchedKernel<T> kernel = batched_select_kernel<T, M, K, N>();
+  return kernel;
+}
+
+// Computes C = A * B for every matrix in groups [g_begin, g_end) of the batches
+template<typename T, int M, int K, int N>
+void batched_multiply(const MatrixBatch<T, M, K> &a, const MatrixBatch<T, K, N> &b, MatrixBatch<T, M, N> &c, size_t g_begin, size_t g_end)
+{
+  assert(a.size() == b.size() && a.size() == c.size());
+  assert(g_begin <= g_end && g_end <= c.groups());
+
+  if (g_begin < g_end) {
+    batched_kernel<T, M, K, N>().fn(a.group(g_begin), b.group(g_begin), c.group(g_begin), g_end - g_begin);
+  }
+}
+
+template<typename T, int M, int K, int N>
+void batched_multiply(const MatrixBatch<T, M, K> &a, const MatrixBatch<T, K, N> &b, MatrixBatch<T, M, N> &c)
+{
+  batched_multiply(a, b, c, 0, c.groups());
+}
+
+// Computes C = A * B for every matrix in the batches, sharing the groups between the workers in the pool
+template<typename T, int M, int K, int N>
+void batched_multiply(const MatrixBatch<T, M, K> &a, const MatrixBatch<T, K, N> &b, MatrixBatch<T, M, N> &c, WorkStealingPool &pool)
+{
+  // a few tasks per worker, so that the pool can balance the load
+  const int groups = int(c.groups());
+  const int groups_per_task = std::max(1, groups / (4 * pool.size()));
+
+  pool.parallel_for(0, groups, groups_per_task, [&](int g_begin, int g_end) {
+    batched_multiply(a, b, c, size_t(g_begin), size_t(g_end));
+  });
+}
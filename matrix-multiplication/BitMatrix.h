@@ -0,0 +1,303 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "Matrix.h"
+
+//
+// Boolean matrices, stored as one bit per cell.
+//
+// Each row is a sequence of 64-bit words, holding 64 columns each, so a 65536 x 65536 matrix needs 512 MB
+// rather than the 32 GB that it would take as doubles. Rows are padded to a whole number of cache lines,
+// and bits beyond the last column are always zero, so whole words and blocks of words can be combined
+// without masking.
+//
+// Multiplication is over the boolean semiring: C(i, j) is set if A(i, k) and B(k, j) are both set for
+// any k. That is the same as OrAnd in Semiring.h, but 64 cells are processed by each word operation.
+//
+class BitMatrix
+{
+public:
+  static constexpr int bits_per_word = 64;
+  static constexpr int words_per_line = 8;
+
+  BitMatrix(int rows, int columns, MatrixAllocation allocation = MatrixAllocation::Default)
+    : m_columns(columns)
+    , m_words(rows, words_for(columns), allocation)
+  {
+    m_words.view().fill(0);
+  }
+
+  // Copies are expensive for large matrices, so they must be made explicitly
+  explicit BitMatrix(const BitMatrix &other)
+    : m_columns(other.m_columns)
+    , m_words(other.m_words)
+  {
+  }
+
+  BitMatrix(BitMatrix &&other) noexcept = default;
+  BitMatrix& operator=(BitMatrix &&other) noexcept = default;
+
+  // Number of words in each row, rounded up to a whole number of cache lines
+  static int words_for(int columns)
+  {
+    const int words = (columns + bits_per_word - 1) / bits_per_word;
+    return std::max(1, (words + words_per_line - 1) / words_per_line) * words_per_line;
+  }
+
+  int rows() const
+  {
+    return m_words.rows();
+  }
+
+  int columns() const
+  {
+    return m_columns;
+  }
+
+  int words_per_row() const
+  {
+    return m_words.columns();
+  }
+
+  bool get(int row, int column) const
+  {
+    assert(0 <= column && column < m_columns);
+    return (this->row(row)[column / bits_per_word] >> (column % bits_per_word)) & 1;
+  }
+
+  void set(int row, int column, bool value = true)
+  {
+    assert(0 <= column && column < m_columns);
+    const uint64_t bit = uint64_t(1) << (column % bits_per_word);
+    uint64_t &word = this->row(row)[column / bits_per_word];
+    word = value ? (word | bit) : (word & ~bit);
+  }
+
+  uint64_t* row(int m)
+  {
+    return m_words.row(m).begin();
+  }
+
+  const uint64_t* row(int m) const
+  {
+    return m_words.row(m).begin();
+  }
+
+  // Number of cells that are set
+  size_t count() const
+  {
+    size_t total = 0;
+    for (size_t i = 0; i < m_words.size(); i++) {
+      total += __builtin_popcountll(m_words.data()[i]);
+    }
+
+    return total;
+  }
+
+  size_t bytes() const
+  {
+    return m_words.size() * sizeof(uint64_t);
+  }
+
+  bool operator==(const BitMatrix &rhs) const
+  {
+    return rows() == rhs.rows() && m_columns == rhs.m_columns
+        && std::equal(m_words.data(), m_words.data() + m_words.size(), rhs.m_words.data());
+  }
+
+private:
+  int m_columns;
+  Matrix<uint64_t> m_words;
+};
+
+inline std::ostream& operator<<(std::ostream &os, const BitMatrix &matrix)
+{
+  for (int m = 0; m < matrix.rows(); m++) {
+    for (int n = 0; n < matrix.columns(); n++) {
+      os << (matrix.get(m, n) ? '1' : '0');
+    }
+    os << std::endl;
+  }
+
+  return os;
+}
+
+// ORs 'count' words of 'source' into 'destination'
+inline void bit_or(uint64_t *__restrict destination, const uint64_t *__restrict source, int count)
+{
+  for (int w = 0; w < count; w++) {
+    destination[w] |= source[w];
+  }
+}
+
+//
+// Computes rows [m_begin, m_end) of C = A * B, by ORing row k of B into row i of C for every bit A(i, k)
+// that is set. Each operation covers 64 columns, and zero bits of A are skipped a word at a time, so this
+// is quick for sparse matrices.
+//
+inline void bit_multiply_rows(const BitMatrix &a, const BitMatrix &b, BitMatrix &c, int m_begin, int m_end)
+{
+  assert(a.columns() == b.rows());
+  assert(c.rows() == a.rows() && c.columns() == b.columns());
+  assert(0 <= m_begin && m_begin <= m_end && m_end <= c.rows());
+
+  const int words = c.words_per_row();
+  for (int i = m_begin; i < m_end; i++) {
+    uint64_t *c_row = c.row(i);
+    std::fill(c_row, c_row + words, 0);
+
+    const uint64_t *a_row = a.row(i);
+    for (int w = 0; w < a.words_per_row(); w++) {
+      for (uint64_t bits = a_row[w]; bits; bits &= bits - 1) {
+        const int k = w * BitMatrix::bits_per_word + __builtin_ctzll(bits);
+        bit_or(c_row, b.row(k), words);
+      }
+    }
+  }
+}
+
+//
+// The "Method of Four Russians" (Arlazarov et al, 1970) replaces the individual row operations with
+// table lookups. For each group of 8 rows of B, a table holds the OR of every one of the 256 subsets of
+// those rows, so a whole byte of A is applied with a single lookup. A word of A covers 8 groups, so the
+// 8 tables for a word are built together, and each row of C combines its 8 lookups in registers before
+// it is updated. Building the tables costs 8 x 256 row operations, which is shared between a block of
+// rows of A.
+//
+// A table only pays for itself if the block of A has many more than 256 bits set in its group, so for
+// each group the bits are counted first. Sparse groups, e.g. in the adjacency matrix of a sparse graph,
+// are applied a row of B at a time, as in bit_multiply_rows, and cost no more than they would there.
+//
+// The columns of B and C are divided into blocks of one cache line, so that the tables and the block
+// of C that they are applied to both stay in cache.
+//
+struct FourRussiansBlocking
+{
+  static constexpr int bits = 8;
+  static constexpr int table_size = 1 << bits;
+  static constexpr int tables = BitMatrix::bits_per_word / bits;
+  static constexpr int block_words = BitMatrix::words_per_line;
+  static constexpr int block_rows = 2048;
+};
+
+// Computes rows [m_begin, m_end) of C = A * B using the Method of Four Russians
+inline void bit_multiply(const BitMatrix &a, const BitMatrix &b, BitMatrix &c, int m_begin, int m_end)
+{
+  assert(a.columns() == b.rows());
+  assert(c.rows() == a.rows() && c.columns() == b.columns());
+  assert(0 <= m_begin && m_begin <= m_end && m_end <= c.rows());
+
+  using Blocking = FourRussiansBlocking;
+  constexpr int W = Blocking::block_words;
+
+  // tables are reused between calls made on the same thread; entry 0 of each table starts empty, and
+  // stays empty
+  thread_local std::vector<uint64_t> tables;
+  tables.resize(size_t(Blocking::tables) * Blocking::table_size * W);
+
+  const int k_words = (a.columns() + BitMatrix::bits_per_word - 1) / BitMatrix::bits_per_word;
+
+  // the row operations that a table would save for each group of 8 columns of A, and for each word of A,
+  // a mask of the groups that are applied using tables
+  thread_local std::vector<int> saved;
+  thread_local std::vector<uint64_t> tabled_groups;
+  saved.resize(size_t(k_words) * Blocking::tables);
+  tabled_groups.resize(k_words);
+
+  const int words = c.words_per_row();
+  for (int i = m_begin; i < m_end; i++) {
+    std::fill(c.row(i), c.row(i) + words, 0);
+  }
+
+  for (int m0 = m_begin; m0 < m_end; m0 += Blocking::block_rows) {
+    const int m1 = std::min(m_end, m0 + Blocking::block_rows);
+
+    // a table saves every set bit but the first in each row of the block
+    std::fill(saved.begin(), saved.end(), 0);
+    for (int i = m0; i < m1; i++) {
+      const uint64_t *a_row = a.row(i);
+      for (int kw = 0; kw < k_words; kw++) {
+        const uint64_t bits = a_row[kw];
+        for (int t = 0; bits && t < Blocking::tables; t++) {
+          const int group = (bits >> (t * Blocking::bits)) & (Blocking::table_size - 1);
+          saved[size_t(kw) * Blocking::tables + t] += std::max(__builtin_popcount(group) - 1, 0);
+        }
+      }
+    }
+
+    // tables are only built for groups where they save more than they cost
+    for (int kw = 0; kw < k_words; kw++) {
+      tabled_groups[kw] = 0;
+      for (int t = 0; t < Blocking::tables; t++) {
+        if (saved[size_t(kw) * Blocking::tables + t] > Blocking::table_size) {
+          tabled_groups[kw] |= uint64_t(Blocking::table_size - 1) << (t * Blocking::bits);
+        }
+      }
+    }
+
+    // bits in groups without tables are applied a whole row of B at a time, as in bit_multiply_rows
+    for (int i = m0; i < m1; i++) {
+      const uint64_t *a_row = a.row(i);
+      for (int kw = 0; kw < k_words; kw++) {
+        for (uint64_t bits = a_row[kw] & ~tabled_groups[kw]; bits; bits &= bits - 1) {
+          bit_or(c.row(i), b.row(kw * BitMatrix::bits_per_word + __builtin_ctzll(bits)), words);
+        }
+      }
+    }
+
+    for (int kw = 0; kw < k_words; kw++) {
+      const uint64_t tabled = tabled_groups[kw];
+      if (tabled == 0) {
+        continue;
+      }
+
+      // rows are padded to whole blocks, so every block is W words wide
+      for (int w0 = 0; w0 < words; w0 += W) {
+        for (int t = 0; t < Blocking::tables; t++) {
+          if (((tabled >> (t * Blocking::bits)) & 1) == 0) {
+            continue;
+          }
+
+          // each entry adds its lowest bit to an entry that has already been computed
+          uint64_t *table = tables.data() + size_t(t) * Blocking::table_size * W;
+          const int k0 = kw * BitMatrix::bits_per_word + t * Blocking::bits;
+          const int bits = std::min(Blocking::bits, a.columns() - k0);
+          for (int x = 1; x < (1 << bits); x++) {
+            uint64_t *entry = table + size_t(x) * W;
+            const uint64_t *previous = table + size_t(x & (x - 1)) * W;
+            const uint64_t *b_row = b.row(k0 + __builtin_ctz(x)) + w0;
+            for (int w = 0; w < W; w++) {
+              entry[w] = previous[w] | b_row[w];
+            }
+          }
+        }
+
+        for (int i = m0; i < m1; i++) {
+          const uint64_t bits = a.row(i)[kw] & tabled;
+          if (bits == 0) {
+            continue;
+          }
+
+          // a byte of zero selects entry 0, which is always empty, even in tables that were not built, so
+          // every table can be looked up without branching
+          uint64_t acc[W] = {};
+          for (int t = 0; t < Blocking::tables; t++) {
+            const int index = (bits >> (t * Blocking::bits)) & (Blocking::table_size - 1);
+            const uint64_t *entry = tables.data() + (size_t(t) * Blocking::table_size + index) * W;
+            for (int w = 0; w < W; w++) {
+              acc[w] |= entry[w];
+            }
+          }
+
+          bit_or(c.row(i) + w0, acc, W);
+        }
+      }
+    }
+  }
+}
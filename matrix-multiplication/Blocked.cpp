@@ -0,0 +1,114 @@
+// #define DEBUG
+// #define HUGE_PAGES
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+
+#include "Gemm.h"
+#include "Matrix.h"
+#include "Verify.h"
+
+using namespace std;
+using namespace std::chrono;
+
+#ifdef HUGE_PAGES
+const MatrixAllocation allocation = MatrixAllocation::HugePages;
+#else
+const MatrixAllocation allocation = MatrixAllocation::Default;
+#endif
+
+int usage(char **argv)
+{
+  cout << endl;
+  cout << "Usage:" << endl;
+  cout << "  " << argv[0] << " <M1> <N1/M2> <N2> [seed]" << endl;
+  cout << endl;
+  cout << "Multiplies a random M1xN1 matrix by a random M2xN2 matrix" << endl;
+
+  return 1;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc == 1) {
+    return usage(argv);
+  }
+
+  if (argc != 4 && argc != 5) {
+    cout << "Invalid argument count: " << argc << endl;
+    return usage(argv);
+  }
+
+  int m_a = atoi(argv[1]);
+  if (m_a <= 0) {
+    cout << "Argument M1 is invalid" << endl;
+    return usage(argv);
+  }
+
+  int n_a = atoi(argv[2]);
+  if (n_a <= 0) {
+    cout << "Argument N1/M2 is invalid" << endl;
+    return usage(argv);
+  }
+
+  int n_b = atoi(argv[3]);
+  if (n_b <= 0) {
+    cout << "Argument N2 is invalid" << endl;
+    return usage(argv);
+  }
+
+  optional<int> seed;
+  if (argc == 5) {
+    seed = atoi(argv[4]);
+    cout << "Random seeds: " << *seed << ", " << (*seed + 1) << endl;
+  }
+
+  // first input matrix
+  Matrix<double> matrix_a(m_a, n_a, allocation);
+  matrix_a.randomise(-100, 100, seed);
+
+  if (seed) {
+    seed = *seed + 1;
+  }
+
+  // second input matrix
+  Matrix<double> matrix_b(n_a, n_b, allocation);
+  matrix_b.randomise(-100, 100, seed);
+
+#ifdef DEBUG
+  cout << "Matrix A:" << endl;
+  cout << matrix_a << endl;
+  cout << "Matrix B:" << endl;
+  cout << matrix_b << endl;
+#endif
+
+  // output matrix
+  Matrix<double> matrix_c(m_a, n_b, allocation);
+
+  // do the work
+  auto start = high_resolution_clock::now();
+  gemm(matrix_a, matrix_b, matrix_c);
+  auto stop = high_resolution_clock::now();
+
+#ifdef DEBUG
+  cout << "Matrix C:" << endl;
+  cout << matrix_c;
+#endif
+
+  // how long did it take?
+  auto duration = duration_cast<microseconds>(stop - start);
+  cout << "Duration: " << duration.count() << " microseconds (" << (double(duration.count()) / 1000000.0f) << " seconds)" << endl;
+
+  // how fast was it?
+  const double flops = 2.0 * m_a * n_a * n_b;
+  cout << "Throughput: " << (flops / max<double>(duration.count(), 1) / 1000.0) << " GFLOP/s (" << gemm_kernel<double>().name << " micro-kernel)" << endl;
+
+  // check the result, if asked to
+  if (!verify(matrix_a, matrix_b, matrix_c)) {
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,170 @@
+// #define DEBUG
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Chain.h"
+#include "Matrix.h"
+#include "Verify.h"
+
+using namespace std;
+using namespace std::chrono;
+
+int usage(char **argv)
+{
+  cout << endl;
+  cout << "Usage:" << endl;
+  cout << "  " << argv[0] << " <D0xD1x...xDn> [seed] [byte-cost]" << endl;
+  cout << endl;
+  cout << "Multiplies a chain of random matrices, where matrix i is D(i-1)xDi, in the cheapest order" << endl;
+  cout << endl;
+  cout << "By default, the order minimises floating point operations; a byte cost above zero also counts" << endl;
+  cout << "memory traffic, with moving one byte costing as much as that many operations" << endl;
+
+  return 1;
+}
+
+// Parses dimensions such as "10x1000x10x1000", returning nothing if any of them are invalid
+optional<vector<int>> parse_dimensions(const string &text)
+{
+  vector<int> dimensions;
+  stringstream stream(text);
+  string item;
+  while (getline(stream, item, 'x')) {
+    const int dimension = atoi(item.c_str());
+    if (dimension <= 0) {
+      return {};
+    }
+    dimensions.push_back(dimension);
+  }
+
+  if (dimensions.size() < 2) {
+    return {};
+  }
+
+  return dimensions;
+}
+
+// Evaluates the chain using the given plan, and returns how long it took
+microseconds time_chain(const vector<TileView<const double>> &matrices, const ChainPlan &plan, Matrix<double> &result, ChainWorkspace<double> &workspace)
+{
+  auto start = high_resolution_clock::now();
+  multiply_chain(matrices, plan, result.view(), workspace);
+  auto stop = high_resolution_clock::now();
+
+  return duration_cast<microseconds>(stop - start);
+}
+
+int main(int argc, char **argv)
+{
+  if (argc == 1) {
+    return usage(argv);
+  }
+
+  if (argc < 2 || argc > 4) {
+    cout << "Invalid argument count: " << argc << endl;
+    return usage(argv);
+  }
+
+  optional<vector<int>> parsed = parse_dimensions(argv[1]);
+  if (!parsed) {
+    cout << "Argument <D0xD1x...xDn> is invalid" << endl;
+    return usage(argv);
+  }
+  const vector<int> &dimensions = *parsed;
+  const int count = int(dimensions.size()) - 1;
+
+  optional<int> seed;
+  if (argc >= 3) {
+    seed = atoi(argv[2]);
+    cout << "Random seeds: " << *seed << " to " << (*seed + count - 1) << endl;
+  }
+
+  ChainCostModel<double> model;
+  if (argc == 4) {
+    model.byte_cost = atof(argv[3]);
+    if (model.byte_cost < 0) {
+      cout << "Argument [byte-cost] is invalid" << endl;
+      return usage(argv);
+    }
+  }
+
+  // input matrices
+  vector<Matrix<double>> matrices;
+  vector<TileView<const double>> views;
+  for (int i = 0; i < count; i++) {
+    matrices.emplace_back(dimensions[i], dimensions[i + 1]);
+    matrices.back().randomise(-100, 100, seed);
+
+    if (seed) {
+      seed = *seed + 1;
+    }
+  }
+
+  for (const auto &matrix : matrices) {
+    views.push_back(matrix.view());
+  }
+
+#ifdef DEBUG
+  for (int i = 0; i < count; i++) {
+    cout << "Matrix A" << (i + 1) << ":" << endl;
+    cout << matrices[i] << endl;
+  }
+#endif
+
+  // plan both orders, timing how long it takes to find the cheapest
+  auto plan_start = high_resolution_clock::now();
+  const ChainPlan plan = plan_chain(dimensions, model);
+  auto plan_stop = high_resolution_clock::now();
+  const ChainPlan left_to_right = plan_chain_left_to_right(dimensions);
+
+  cout << "Left to right: " << left_to_right.describe() << ", " << left_to_right.flops() << " flops" << endl;
+  cout << "Planned: " << plan.describe() << ", " << plan.flops() << " flops (planned in "
+       << duration_cast<microseconds>(plan_stop - plan_start).count() << " microseconds)" << endl;
+
+  const double saved = left_to_right.flops() - plan.flops();
+  cout << "Flops saved: " << saved << " (" << (100 * saved / max(left_to_right.flops(), 1.0)) << "%)" << endl;
+
+  if (model.byte_cost > 0) {
+    cout << "Estimated cost: " << left_to_right.cost(model) << " left to right, " << plan.cost(model) << " planned" << endl;
+  }
+
+  Matrix<double> matrix_c(dimensions.front(), dimensions.back());
+
+  // the planned order is evaluated once to warm up, which also fills its workspace
+  ChainWorkspace<double> workspace;
+  time_chain(views, plan, matrix_c, workspace);
+  const size_t allocations = workspace.allocations();
+
+  // the left to right order is only evaluated for comparison, with its own workspace
+  {
+    ChainWorkspace<double> left_to_right_workspace;
+    auto duration = time_chain(views, left_to_right, matrix_c, left_to_right_workspace);
+    cout << "Left to right duration: " << duration.count() << " microseconds (" << (double(duration.count()) / 1000000.0f) << " seconds)" << endl;
+  }
+
+  // do the work, reusing the buffers from the first evaluation
+  auto duration = time_chain(views, plan, matrix_c, workspace);
+
+#ifdef DEBUG
+  cout << "Matrix C:" << endl;
+  cout << matrix_c;
+#endif
+
+  // how long did it take?
+  cout << "Duration: " << duration.count() << " microseconds (" << (double(duration.count()) / 1000000.0f) << " seconds)" << endl;
+  cout << "Workspace: " << workspace.buffers() << " intermediate buffers, " << workspace.bytes() << " bytes, "
+       << (workspace.allocations() - allocations) << " allocated by this evaluation" << endl;
+
+  // check the result, if asked to
+  if (!verify_chain<double>(views, matrix_c.view())) {
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,346 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Gemm.h"
+#include "Matrix.h"
+#include "View.h"
+
+//
+// Multiplication of a chain of matrices, A1 * A2 * ... * An.
+//
+// Matrix multiplication is associative, so the chain can be evaluated in any order, but the cost of
+// each order depends heavily on the shapes involved. For example, if A1 is 10x1000, A2 is 1000x10 and
+// A3 is 10x1000, then (A1 * A2) * A3 takes 0.4 MFLOP while A1 * (A2 * A3) takes 40 MFLOP.
+//
+// The cheapest order is found using the classic O(n^3) dynamic program, which finds the cheapest way to
+// compute every sub-chain Ai..Aj from the cheapest ways to compute shorter sub-chains. The plan is then
+// executed recursively, with intermediate products held in buffers that are reused once consumed.
+//
+
+// Number of floating point operations needed to multiply an m x k matrix by a k x n matrix
+inline double product_flops(int m, int k, int n)
+{
+  return 2.0 * m * k * n;
+}
+
+//
+// Estimated cost of a single product, as a weighted sum of floating point operations and memory traffic.
+//
+// Traffic is counted for the blocked GEMM in Gemm.h: each kc x nc block of B is packed once, A is packed
+// again for every block of nc columns, and C is read and written once for every panel of kc.
+//
+template<typename T>
+struct ChainCostModel
+{
+  // cost of moving one byte to or from memory, relative to one floating point operation; 0 means that
+  // only arithmetic is counted
+  double byte_cost = 0;
+
+  double traffic(int m, int k, int n) const
+  {
+    const double a_passes = (n + GemmBlocking<T>::nc - 1) / GemmBlocking<T>::nc;
+    const double c_passes = (k + GemmBlocking<T>::kc - 1) / GemmBlocking<T>::kc;
+    return (a_passes * m * k + double(k) * n + 2 * c_passes * m * n) * sizeof(T);
+  }
+
+  double cost(int m, int k, int n) const
+  {
+    return product_flops(m, k, n) + (byte_cost > 0 ? byte_cost * traffic(m, k, n) : 0);
+  }
+};
+
+//
+// The order in which to evaluate a chain. Matrix i is dimensions[i] x dimensions[i + 1], and the product
+// of matrices i..j is computed as (i..split(i, j)) * (split(i, j) + 1..j).
+//
+class ChainPlan
+{
+public:
+  ChainPlan(std::vector<int> dimensions)
+    : m_dimensions(std::move(dimensions))
+    , m_splits(size_t(count()) * count())
+  {
+    assert(m_dimensions.size() >= 2);
+  }
+
+  int count() const
+  {
+    return int(m_dimensions.size()) - 1;
+  }
+
+  const std::vector<int>& dimensions() const
+  {
+    return m_dimensions;
+  }
+
+  // Describes the order of evaluation, e.g. "((A1 A2) A3)"
+  std::string describe() const
+  {
+    return describe(0, count() - 1);
+  }
+
+  // Total number of floating point operations needed to execute the plan
+  double flops() const
+  {
+    return flops(0, count() - 1);
+  }
+
+  // Total cost of executing the plan, under the given model
+  template<typename T>
+  double cost(const ChainCostModel<T> &model) const
+  {
+    return cost(model, 0, count() - 1);
+  }
+
+  int split(int i, int j) const
+  {
+    assert(0 <= i && i < j && j < count());
+    return m_splits[size_t(i) * count() + j];
+  }
+
+  void set_split(int i, int j, int k)
+  {
+    assert(i <= k && k < j);
+    m_splits[size_t(i) * count() + j] = k;
+  }
+
+private:
+  std::string describe(int i, int j) const
+  {
+    if (i == j) {
+      return "A" + std::to_string(i + 1);
+    }
+
+    const int k = split(i, j);
+    return "(" + describe(i, k) + " " + describe(k + 1, j) + ")";
+  }
+
+  double flops(int i, int j) const
+  {
+    if (i == j) {
+      return 0;
+    }
+
+    const int k = split(i, j);
+    return flops(i, k) + flops(k + 1, j) + product_flops(m_dimensions[i], m_dimensions[k + 1], m_dimensions[j + 1]);
+  }
+
+  template<typename T>
+  double cost(const ChainCostModel<T> &model, int i, int j) const
+  {
+    if (i == j) {
+      return 0;
+    }
+
+    const int k = split(i, j);
+    return cost(model, i, k) + cost(model, k + 1, j) + model.cost(m_dimensions[i], m_dimensions[k + 1], m_dimensions[j + 1]);
+  }
+
+  std::vector<int> m_dimensions;
+  std::vector<int> m_splits;
+};
+
+// Plans the chain in the order that it is written, i.e. (((A1 A2) A3) ... An)
+inline ChainPlan plan_chain_left_to_right(const std::vector<int> &dimensions)
+{
+  ChainPlan plan(dimensions);
+  for (int i = 0; i < plan.count(); i++) {
+    for (int j = i + 1; j < plan.count(); j++) {
+      plan.set_split(i, j, j - 1);
+    }
+  }
+
+  return plan;
+}
+
+// Plans the chain in the cheapest order under the given model, in O(n^3) time and O(n^2) memory
+template<typename T>
+ChainPlan plan_chain(const std::vector<int> &dimensions, const ChainCostModel<T> &model = {})
+{
+  ChainPlan plan(dimensions);
+  const int n = plan.count();
+
+  // cheapest cost of each sub-chain i..j; a single matrix costs nothing
+  std::vector<double> costs(size_t(n) * n, 0);
+
+  // sub-chains are solved in order of length, so that the shorter ones that they depend on are ready
+  for (int length = 2; length <= n; length++) {
+    for (int i = 0; i + length <= n; i++) {
+      const int j = i + length - 1;
+
+      double best = std::numeric_limits<double>::infinity();
+      for (int k = i; k < j; k++) {
+        const double cost = costs[size_t(i) * n + k] + costs[size_t(k + 1) * n + j]
+                          + model.cost(dimensions[i], dimensions[k + 1], dimensions[j + 1]);
+        if (cost < best) {
+          best = cost;
+          plan.set_split(i, j, k);
+        }
+      }
+
+      costs[size_t(i) * n + j] = best;
+    }
+  }
+
+  return plan;
+}
+
+//
+// Buffers for the intermediate products of a chain. A buffer is returned to the pool as soon as its
+// product has been consumed, so that later products can reuse it, and the pool can be kept between
+// executions so that repeated evaluations allocate nothing.
+//
+template<typename T>
+class ChainWorkspace
+{
+public:
+  // Returns a free buffer that can hold a rows x columns matrix, allocating one only if necessary
+  int acquire(int rows, int columns)
+  {
+    const size_t size = size_t(rows) * columns;
+
+    // the smallest free buffer that is large enough
+    int best = -1;
+    for (int i = 0; i < int(m_buffers.size()); i++) {
+      if (m_free[i] && m_buffers[i].size() >= size && (best == -1 || m_buffers[i].size() < m_buffers[best].size())) {
+        best = i;
+      }
+    }
+
+    // failing that, the largest free buffer, which is replaced rather than keeping both
+    if (best == -1) {
+      for (int i = 0; i < int(m_buffers.size()); i++) {
+        if (m_free[i] && (best == -1 || m_buffers[i].size() > m_buffers[best].size())) {
+          best = i;
+        }
+      }
+    }
+
+    if (best == -1) {
+      best = int(m_buffers.size());
+      m_buffers.emplace_back(rows, columns);
+      m_free.push_back(false);
+      m_allocations++;
+    } else if (m_buffers[best].size() < size) {
+      m_buffers[best] = Matrix<T>(rows, columns);
+      m_allocations++;
+    }
+
+    m_free[best] = false;
+    return best;
+  }
+
+  void release(int buffer)
+  {
+    assert(!m_free[buffer]);
+    m_free[buffer] = true;
+  }
+
+  // Returns a view of a buffer as a rows x columns matrix
+  TileView<T> view(int buffer, int rows, int columns)
+  {
+    assert(m_buffers[buffer].size() >= size_t(rows) * columns);
+    return { m_buffers[buffer].data(), rows, columns, columns };
+  }
+
+  size_t allocations() const
+  {
+    return m_allocations;
+  }
+
+  size_t buffers() const
+  {
+    return m_buffers.size();
+  }
+
+  size_t bytes() const
+  {
+    size_t total = 0;
+    for (const auto &buffer : m_buffers) {
+      total += buffer.size() * sizeof(T);
+    }
+
+    return total;
+  }
+
+private:
+  std::vector<Matrix<T>> m_buffers;
+  std::vector<bool> m_free;
+  size_t m_allocations = 0;
+};
+
+// Computes the product of matrices i..j into 'result'
+template<typename T, typename Multiply>
+void multiply_chain_range(const std::vector<TileView<const T>> &matrices, const ChainPlan &plan, int i, int j, TileView<T> result, ChainWorkspace<T> &workspace, Multiply &multiply)
+{
+  const std::vector<int> &dimensions = plan.dimensions();
+  const int k = plan.split(i, j);
+
+  // each operand is either one of the inputs, or an intermediate product held in the workspace
+  auto operand = [&](int begin, int end, int &buffer) -> TileView<const T> {
+    if (begin == end) {
+      buffer = -1;
+      return matrices[begin];
+    }
+
+    buffer = workspace.acquire(dimensions[begin], dimensions[end + 1]);
+    TileView<T> product = workspace.view(buffer, dimensions[begin], dimensions[end + 1]);
+    multiply_chain_range(matrices, plan, begin, end, product, workspace, multiply);
+    return product;
+  };
+
+  int left_buffer;
+  int right_buffer;
+  TileView<const T> left = operand(i, k, left_buffer);
+  TileView<const T> right = operand(k + 1, j, right_buffer);
+
+  multiply(left, right, result);
+
+  // both operands have been consumed, so their buffers can be reused by the rest of the chain
+  if (left_buffer != -1) {
+    workspace.release(left_buffer);
+  }
+  if (right_buffer != -1) {
+    workspace.release(right_buffer);
+  }
+}
+
+//
+// Computes result = matrices[0] * matrices[1] * ... in the order given by 'plan', using 'multiply' to
+// compute each product as multiply(a, b, c). The result must not overlap any of the inputs.
+//
+template<typename T, typename Multiply>
+void multiply_chain(const std::vector<TileView<const T>> &matrices, const ChainPlan &plan, TileView<T> result, ChainWorkspace<T> &workspace, Multiply multiply)
+{
+  assert(int(matrices.size()) == plan.count());
+  for (int i = 0; i < plan.count(); i++) {
+    assert(matrices[i].rows() == plan.dimensions()[i]);
+    assert(matrices[i].columns() == plan.dimensions()[i + 1]);
+  }
+  assert(result.rows() == plan.dimensions().front());
+  assert(result.columns() == plan.dimensions().back());
+
+  if (plan.count() == 1) {
+    for (int m = 0; m < result.rows(); m++) {
+      std::copy(matrices[0].row(m).begin(), matrices[0].row(m).end(), result.row(m).begin());
+    }
+    return;
+  }
+
+  multiply_chain_range(matrices, plan, 0, plan.count() - 1, result, workspace, multiply);
+}
+
+template<typename T>
+void multiply_chain(const std::vector<TileView<const T>> &matrices, const ChainPlan &plan, TileView<T> result, ChainWorkspace<T> &workspace)
+{
+  multiply_chain(matrices, plan, result, workspace, [](TileView<const T> a, TileView<const T> b, TileView<T> c) {
+    gemm(a, b, c);
+  });
+}
@@ -0,0 +1,206 @@
+// #define DEBUG
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "BitMatrix.h"
+#include "Verify.h"
+#include "WorkStealingPool.h"
+
+using namespace std;
+using namespace std::chrono;
+
+//
+// Transitive closure of a directed graph, by repeated squaring of its boolean adjacency matrix.
+//
+// With a bit set on the diagonal, R * R holds every pair that is connected by a path of at most twice
+// as many edges as in R, so about log2(n) squarings find every pair that is connected at all. Squaring
+// stops early once nothing changes.
+//
+
+// Generates the adjacency lists of a random directed graph, with 'degree' edges per vertex on average
+vector<vector<int>> random_graph(int vertices, double degree, optional<int> seed)
+{
+  mt19937 engine;
+  if (seed) {
+    engine.seed(*seed);
+  } else {
+    random_device rd;
+    engine.seed(rd());
+  }
+
+  // edges are chosen independently, but vertices are drawn at random rather than testing every pair
+  poisson_distribution<int> edges(degree);
+  uniform_int_distribution<int> vertex(0, vertices - 1);
+
+  vector<vector<int>> graph(vertices);
+  for (auto &neighbours : graph) {
+    const int count = edges(engine);
+    for (int e = 0; e < count; e++) {
+      neighbours.push_back(vertex(engine));
+    }
+  }
+
+  return graph;
+}
+
+// Reference implementation, used to check the result: a breadth-first search from every vertex
+BitMatrix reachability(const vector<vector<int>> &graph)
+{
+  const int vertices = int(graph.size());
+  BitMatrix reachable(vertices, vertices);
+
+  vector<int> queue;
+  for (int source = 0; source < vertices; source++) {
+    queue.assign(1, source);
+    reachable.set(source, source);
+
+    for (size_t next = 0; next < queue.size(); next++) {
+      for (int target : graph[queue[next]]) {
+        if (!reachable.get(source, target)) {
+          reachable.set(source, target);
+          queue.push_back(target);
+        }
+      }
+    }
+  }
+
+  return reachable;
+}
+
+int usage(char **argv)
+{
+  cout << endl;
+  cout << "Usage:" << endl;
+  cout << "  " << argv[0] << " <vertices> <num-threads> [average-degree] [rows|four-russians] [seed]" << endl;
+  cout << endl;
+  cout << "Finds every pair of vertices that are connected by a path in a random directed graph" << endl;
+  cout << endl;
+  cout << "By default, each vertex has 2 outgoing edges on average, and the Method of Four Russians is used" << endl;
+  cout << "for the parts of the matrix that are dense enough to benefit from it" << endl;
+
+  return 1;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc == 1) {
+    return usage(argv);
+  }
+
+  if (argc < 3 || argc > 6) {
+    cout << "Invalid argument count: " << argc << endl;
+    return usage(argv);
+  }
+
+  int vertices = atoi(argv[1]);
+  if (vertices <= 0) {
+    cout << "Argument <vertices> is invalid" << endl;
+    return usage(argv);
+  }
+
+  int num_threads = atoi(argv[2]);
+  if (num_threads <= 0) {
+    cout << "Argument <num-threads> is invalid" << endl;
+    return usage(argv);
+  }
+
+  double degree = 2;
+  if (argc >= 4) {
+    degree = atof(argv[3]);
+    if (degree < 0) {
+      cout << "Argument [average-degree] is invalid" << endl;
+      return usage(argv);
+    }
+  }
+
+  bool four_russians = true;
+  if (argc >= 5) {
+    if (strcmp(argv[4], "rows") == 0) {
+      four_russians = false;
+    } else if (strcmp(argv[4], "four-russians") != 0) {
+      cout << "Argument [rows|four-russians] is invalid" << endl;
+      return usage(argv);
+    }
+  }
+
+  optional<int> seed;
+  if (argc == 6) {
+    seed = atoi(argv[5]);
+    cout << "Random seed: " << *seed << endl;
+  }
+
+  const vector<vector<int>> graph = random_graph(vertices, degree, seed);
+
+  // every vertex can reach itself, which also keeps the paths found by earlier squarings
+  BitMatrix closure(vertices, vertices, MatrixAllocation::HugePages);
+  for (int i = 0; i < vertices; i++) {
+    closure.set(i, i);
+    for (int j : graph[i]) {
+      closure.set(i, j);
+    }
+  }
+  BitMatrix next(vertices, vertices, MatrixAllocation::HugePages);
+
+  cout << "Vertices: " << vertices << ", edges: " << (closure.count() - vertices) << " (excluding duplicates and loops)" << endl;
+  cout << "Memory: " << closure.bytes() << " bytes per matrix, rather than "
+       << size_t(vertices) * vertices * sizeof(double) << " as doubles" << endl;
+
+#ifdef DEBUG
+  cout << "Adjacency matrix:" << endl;
+  cout << closure << endl;
+#endif
+
+  WorkStealingPool pool(num_threads);
+  const int rows_per_task = max(64, vertices / (4 * pool.size()));
+
+  // do the work, stopping early if nothing changes
+  auto start = high_resolution_clock::now();
+
+  int squarings = 0;
+  for (long hops = 1; hops < vertices - 1; hops *= 2) {
+    pool.parallel_for(0, vertices, rows_per_task, [&](int m_begin, int m_end) {
+      if (four_russians) {
+        bit_multiply(closure, closure, next, m_begin, m_end);
+      } else {
+        bit_multiply_rows(closure, closure, next, m_begin, m_end);
+      }
+    });
+    squarings++;
+
+    const bool converged = closure == next;
+    swap(closure, next);
+    if (converged) {
+      break;
+    }
+  }
+
+  auto stop = high_resolution_clock::now();
+
+#ifdef DEBUG
+  cout << "Closure:" << endl;
+  cout << closure << endl;
+#endif
+
+  cout << "Reachable pairs: " << closure.count() << " of " << size_t(vertices) * vertices << endl;
+  cout << "Squarings: " << squarings << endl;
+
+  // how long did it take?
+  auto duration = duration_cast<microseconds>(stop - start);
+  cout << "Duration: " << duration.count() << " microseconds (" << (double(duration.count()) / 1000000.0f) << " seconds)" << endl;
+
+  // booleans have no subtraction for Freivalds' algorithm, so the result is compared with breadth-first
+  // searches instead
+  if (!verify_against("breadth-first search", [&]() { return reachability(graph) == closure; })) {
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,253 @@
+// #define DEBUG
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <vector>
+
+#include "FixedMatrix.h"
+#include "Matrix.h"
+#include "Verify.h"
+
+using namespace std;
+using namespace std::chrono;
+
+//
+// Transforms in a scene graph, computed with FixedMatrix<T, 4, 4> and with Matrix<T>.
+//
+// Each node of the graph has a transform relative to its parent, and its world transform is its
+// parent's world transform multiplied by its own. Every node also has a point, which is moved into
+// world coordinates. This is typical of geometric code, which multiplies huge numbers of 4x4 matrices,
+// so the cost of allocating each one and of looping over its cells at run time dominates.
+//
+
+// furthest that a node can be from its parent
+const int MAX_PARENT_DISTANCE = 16;
+
+using Transform = FixedMatrix<double, 4, 4>;
+using Point = FixedMatrix<double, 4, 1>;
+
+constexpr Transform translation(double x, double y, double z)
+{
+  return {
+    1, 0, 0, x,
+    0, 1, 0, y,
+    0, 0, 1, z,
+    0, 0, 0, 1
+  };
+}
+
+// constant transforms are composed at compile time
+static_assert(translation(1, 2, 3) * translation(4, 5, 6) == translation(5, 7, 9));
+static_assert(Transform::identity() * translation(1, 2, 3) == translation(1, 2, 3));
+
+// Rotation about the z axis followed by rotation about the x axis
+Transform rotation(double z_angle, double x_angle)
+{
+  const double cz = cos(z_angle), sz = sin(z_angle);
+  const double cx = cos(x_angle), sx = sin(x_angle);
+
+  const Transform z = {
+    cz, -sz, 0, 0,
+    sz,  cz, 0, 0,
+     0,   0, 1, 0,
+     0,   0, 0, 1
+  };
+  const Transform x = {
+    1,  0,   0, 0,
+    0, cx, -sx, 0,
+    0, sx,  cx, 0,
+    0,  0,   0, 1
+  };
+
+  return x * z;
+}
+
+struct Scene
+{
+  // parent of each node, which always comes before it, and usually shortly before it, as when nodes are
+  // stored in depth-first order; the first node is the root and has none
+  vector<int> parents;
+  vector<Transform> locals;
+  vector<Point> points;
+};
+
+Scene random_scene(int nodes, optional<int> seed)
+{
+  mt19937 engine;
+  if (seed) {
+    engine.seed(*seed);
+  } else {
+    random_device rd;
+    engine.seed(rd());
+  }
+
+  uniform_real_distribution<double> angle(-M_PI, M_PI);
+  uniform_real_distribution<double> offset(-10, 10);
+
+  Scene scene;
+  for (int i = 0; i < nodes; i++) {
+    scene.parents.push_back(i == 0 ? -1 : uniform_int_distribution<int>(max(0, i - MAX_PARENT_DISTANCE), i - 1)(engine));
+    scene.locals.push_back(translation(offset(engine), offset(engine), offset(engine)) * rotation(angle(engine), angle(engine)));
+    scene.points.push_back({ offset(engine), offset(engine), offset(engine), 1 });
+  }
+
+  return scene;
+}
+
+template<typename T>
+void multiply_matrices(const Matrix<T> &matrix_a, const Matrix<T> &matrix_b, Matrix<T> &matrix_c)
+{
+  for (int m = 0; m < matrix_c.rows(); m++) {
+    for (int n = 0; n < matrix_c.columns(); n++) {
+
+      // find value of cell [m,n]
+      T sum = 0;
+      for (int i = 0; i < matrix_a.columns(); i++) {
+        sum += matrix_a.get(m, i) * matrix_b.get(i, n);
+      }
+
+      // store value
+      matrix_c.set(m, n, sum);
+    }
+  }
+}
+
+// Computes the world transforms and points with FixedMatrix
+void transform_fixed(const Scene &scene, vector<Transform> &worlds, vector<Point> &points)
+{
+  for (size_t i = 0; i < scene.locals.size(); i++) {
+    const int parent = scene.parents[i];
+    worlds[i] = parent < 0 ? scene.locals[i] : worlds[parent] * scene.locals[i];
+    points[i] = worlds[i] * scene.points[i];
+  }
+}
+
+// Computes the same with a Matrix<T> for every transform and point, as before FixedMatrix existed
+void transform_dynamic(const Scene &scene, vector<Matrix<double>> &worlds, vector<Matrix<double>> &points)
+{
+  for (size_t i = 0; i < scene.locals.size(); i++) {
+    const Matrix<double> local = scene.locals[i].to_matrix();
+    const Matrix<double> point = scene.points[i].to_matrix();
+
+    Matrix<double> world(4, 4);
+    const int parent = scene.parents[i];
+    if (parent < 0) {
+      world = local;
+    } else {
+      multiply_matrices(worlds[parent], local, world);
+    }
+
+    Matrix<double> moved(4, 1);
+    multiply_matrices(world, point, moved);
+
+    worlds.push_back(move(world));
+    points.push_back(move(moved));
+  }
+}
+
+// Checks that a FixedMatrix matches a Matrix<T> up to rounding errors
+template<int M, int N>
+bool matches(const FixedMatrix<double, M, N> &fixed, const Matrix<double> &dynamic)
+{
+  const FixedMatrix<double, M, N> expected = FixedMatrix<double, M, N>::from(dynamic.view());
+  for (int m = 0; m < M; m++) {
+    for (int n = 0; n < N; n++) {
+      if (abs(fixed(m, n) - expected(m, n)) > 1e-9 * (1 + abs(expected(m, n)))) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+int usage(char **argv)
+{
+  cout << endl;
+  cout << "Usage:" << endl;
+  cout << "  " << argv[0] << " <nodes> [seed]" << endl;
+  cout << endl;
+  cout << "Computes the world transform of every node of a random scene graph, and moves a point at each node" << endl;
+  cout << "into world coordinates, using FixedMatrix and then Matrix" << endl;
+
+  return 1;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc == 1) {
+    return usage(argv);
+  }
+
+  if (argc != 2 && argc != 3) {
+    cout << "Invalid argument count: " << argc << endl;
+    return usage(argv);
+  }
+
+  int nodes = atoi(argv[1]);
+  if (nodes <= 0) {
+    cout << "Argument <nodes> is invalid" << endl;
+    return usage(argv);
+  }
+
+  optional<int> seed;
+  if (argc == 3) {
+    seed = atoi(argv[2]);
+    cout << "Random seed: " << *seed << endl;
+  }
+
+  const Scene scene = random_scene(nodes, seed);
+
+  // output
+  vector<Transform> worlds(nodes);
+  vector<Point> points(nodes);
+
+  // do the work
+  auto start = high_resolution_clock::now();
+  transform_fixed(scene, worlds, points);
+  auto stop = high_resolution_clock::now();
+
+#ifdef DEBUG
+  cout << "Last world transform:" << endl;
+  cout << worlds.back() << endl;
+  cout << "Last point:" << endl;
+  cout << points.back() << endl;
+#endif
+
+  // how long did it take?
+  auto duration = duration_cast<microseconds>(stop - start);
+  cout << "Duration: " << duration.count() << " microseconds (" << (double(duration.count()) / 1000000.0f) << " seconds)" << endl;
+
+  // compare with Matrix<T>
+  vector<Matrix<double>> dynamic_worlds;
+  vector<Matrix<double>> dynamic_points;
+  dynamic_worlds.reserve(nodes);
+  dynamic_points.reserve(nodes);
+
+  auto dynamic_start = high_resolution_clock::now();
+  transform_dynamic(scene, dynamic_worlds, dynamic_points);
+  auto dynamic_duration = duration_cast<nanoseconds>(high_resolution_clock::now() - dynamic_start);
+
+  cout << "Per node: " << (duration_cast<nanoseconds>(stop - start).count() / double(nodes)) << " nanoseconds with FixedMatrix, "
+       << (dynamic_duration.count() / double(nodes)) << " nanoseconds with Matrix" << endl;
+
+  // the products are too small for Freivalds' algorithm to save any work, so they are compared with Matrix<T>
+  const bool passed = verify_against("Matrix", [&]() {
+    for (int i = 0; i < nodes; i++) {
+      if (!matches(worlds[i], dynamic_worlds[i]) || !matches(points[i], dynamic_points[i])) {
+        return false;
+      }
+    }
+    return true;
+  });
+  if (!passed) {
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,279 @@
+#pragma once
+
+#include <cassert>
+#include <iostream>
+#include <type_traits>
+
+#include "Matrix.h"
+#include "View.h"
+
+//
+// Small matrices whose dimensions are known at compile time, e.g. the 4x4 transforms used in geometry.
+//
+// The cells are stored inside the object, so a FixedMatrix lives on the stack or inside another object
+// and is never allocated on the heap. Every loop has a fixed length, so the compiler can unroll and
+// vectorize it, and the arithmetic is constexpr, so constant transforms can be computed at compile time.
+//
+// view() returns a TileView of the cells, so a FixedMatrix can be passed to anything that takes a view,
+// e.g. gemm() or verify(). from() copies a matrix from a view, e.g. a tile of a Matrix<T> or a Slice<T>,
+// and store() copies it back.
+//
+
+// Loops over the cells are fully unrolled, for matrices up to 16 cells wide
+#define FIXED_UNROLL _Pragma("GCC unroll 16")
+
+template<typename T, int M, int N>
+class FixedMatrix
+{
+  static_assert(M > 0 && N > 0, "FixedMatrix<T, M, N> requires positive dimensions");
+
+public:
+  // A matrix of zeros
+  constexpr FixedMatrix()
+    : m_values{}
+  {
+  }
+
+  // A matrix with the given cells, in row-major order; any cells that are not given are zero. Giving too
+  // many cells is a compile-time error.
+  template<typename... Values, typename = std::enable_if_t<(sizeof...(Values) > 1) && (std::is_convertible_v<Values, T> && ...)>>
+  constexpr FixedMatrix(Values... values)
+    : m_values{ T(values)... }
+  {
+    static_assert(sizeof...(Values) <= size_t(M) * N, "too many cells for a FixedMatrix<T, M, N>");
+  }
+
+  // A matrix with only its first cell given, which must be asked for explicitly, so that a scalar is never
+  // silently converted into a matrix
+  template<typename Value, typename = std::enable_if_t<std::is_convertible_v<Value, T>>>
+  constexpr explicit FixedMatrix(Value value)
+    : m_values{ T(value) }
+  {
+  }
+
+  static constexpr FixedMatrix identity()
+  {
+    static_assert(M == N, "only square matrices have an identity");
+
+    FixedMatrix matrix;
+    FIXED_UNROLL
+    for (int i = 0; i < M; i++) {
+      matrix(i, i) = T(1);
+    }
+
+    return matrix;
+  }
+
+  // Copies an M x N matrix from a view
+  static FixedMatrix from(TileView<const T> source)
+  {
+    assert(source.rows() == M && source.columns() == N);
+
+    FixedMatrix matrix;
+    for (int i = 0; i < M; i++) {
+      for (int j = 0; j < N; j++) {
+        matrix(i, j) = source(i, j);
+      }
+    }
+
+    return matrix;
+  }
+
+  static constexpr int rows()
+  {
+    return M;
+  }
+
+  static constexpr int columns()
+  {
+    return N;
+  }
+
+  static constexpr int size()
+  {
+    return M * N;
+  }
+
+  // Unlike Matrix<T>::get, cells are not bounds checked, other than by assertions
+  constexpr T operator()(int m, int n) const
+  {
+    assert(0 <= m && m < M && 0 <= n && n < N);
+    return m_values[m * N + n];
+  }
+
+  constexpr T& operator()(int m, int n)
+  {
+    assert(0 <= m && m < M && 0 <= n && n < N);
+    return m_values[m * N + n];
+  }
+
+  constexpr T get(int m, int n) const
+  {
+    return (*this)(m, n);
+  }
+
+  constexpr void set(int m, int n, T value)
+  {
+    (*this)(m, n) = value;
+  }
+
+  T* data()
+  {
+    return m_values;
+  }
+
+  const T* data() const
+  {
+    return m_values;
+  }
+
+  TileView<T> view()
+  {
+    return { m_values, M, N, N };
+  }
+
+  TileView<const T> view() const
+  {
+    return { m_values, M, N, N };
+  }
+
+  // Copies the matrix into a view of the same size
+  void store(TileView<T> destination) const
+  {
+    assert(destination.rows() == M && destination.columns() == N);
+    for (int i = 0; i < M; i++) {
+      for (int j = 0; j < N; j++) {
+        destination(i, j) = (*this)(i, j);
+      }
+    }
+  }
+
+  Matrix<T> to_matrix() const
+  {
+    Matrix<T> matrix(M, N);
+    store(matrix.view());
+    return matrix;
+  }
+
+  constexpr FixedMatrix<T, N, M> transpose() const
+  {
+    FixedMatrix<T, N, M> result;
+    FIXED_UNROLL
+    for (int i = 0; i < M; i++) {
+      FIXED_UNROLL
+      for (int j = 0; j < N; j++) {
+        result(j, i) = (*this)(i, j);
+      }
+    }
+
+    return result;
+  }
+
+  constexpr FixedMatrix& operator+=(const FixedMatrix &rhs)
+  {
+    FIXED_UNROLL
+    for (int i = 0; i < M * N; i++) {
+      m_values[i] += rhs.m_values[i];
+    }
+
+    return *this;
+  }
+
+  constexpr FixedMatrix& operator-=(const FixedMatrix &rhs)
+  {
+    FIXED_UNROLL
+    for (int i = 0; i < M * N; i++) {
+      m_values[i] -= rhs.m_values[i];
+    }
+
+    return *this;
+  }
+
+  constexpr FixedMatrix& operator*=(T scale)
+  {
+    FIXED_UNROLL
+    for (int i = 0; i < M * N; i++) {
+      m_values[i] *= scale;
+    }
+
+    return *this;
+  }
+
+  constexpr bool operator==(const FixedMatrix &rhs) const
+  {
+    for (int i = 0; i < M * N; i++) {
+      if (m_values[i] != rhs.m_values[i]) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  constexpr bool operator!=(const FixedMatrix &rhs) const
+  {
+    return !(*this == rhs);
+  }
+
+private:
+  T m_values[M * N];
+};
+
+// Computes A * B; each row of B is scaled and added to a row of C, so the innermost loop is contiguous
+template<typename T, int M, int K, int N>
+constexpr FixedMatrix<T, M, N> operator*(const FixedMatrix<T, M, K> &a, const FixedMatrix<T, K, N> &b)
+{
+  FixedMatrix<T, M, N> c;
+  FIXED_UNROLL
+  for (int i = 0; i < M; i++) {
+    FIXED_UNROLL
+    for (int k = 0; k < K; k++) {
+      const T a_ik = a(i, k);
+      FIXED_UNROLL
+      for (int j = 0; j < N; j++) {
+        c(i, j) += a_ik * b(k, j);
+      }
+    }
+  }
+
+  return c;
+}
+
+template<typename T, int M, int N>
+constexpr FixedMatrix<T, M, N> operator+(FixedMatrix<T, M, N> a, const FixedMatrix<T, M, N> &b)
+{
+  return a += b;
+}
+
+template<typename T, int M, int N>
+constexpr FixedMatrix<T, M, N> operator-(FixedMatrix<T, M, N> a, const FixedMatrix<T, M, N> &b)
+{
+  return a -= b;
+}
+
+template<typename T, int M, int N>
+constexpr FixedMatrix<T, M, N> operator*(FixedMatrix<T, M, N> a, T scale)
+{
+  return a *= scale;
+}
+
+template<typename T, int M, int N>
+constexpr FixedMatrix<T, M, N> operator*(T scale, FixedMatrix<T, M, N> a)
+{
+  return a *= scale;
+}
+
+#undef FIXED_UNROLL
+
+template<typename T, int M, int N>
+std::ostream& operator<<(std::ostream &os, const FixedMatrix<T, M, N> &matrix)
+{
+  for (int m = 0; m < M; m++) {
+    for (int n = 0; n < N; n++) {
+      os << matrix(m, n) << " ";
+    }
+    os << std::endl;
+  }
+
+  return os;
+}
@@ -0,0 +1,251 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+
+#include "Gemm_Kernels.h"
+#include "Matrix.h"
+
+//
+// Cache-blocked GEMM, loosely following the structure used by GotoBLAS and BLIS.
+//
+// The k dimension is split into panels of kc, so that a packed kc x nr micro-panel of B stays in L1.
+// An mc x kc block of A is packed so that it stays in L2, and a kc x nc block of B is packed so that
+// it stays in L3. Within those blocks, a register-blocked micro-kernel computes one mr x nr tile of C
+// at a time, reading both operands sequentially from the packed buffers.
+//
+
+// Cache block sizes, in elements
+template<typename T>
+struct GemmBlocking
+{
+  static constexpr int mc = 128;
+  static constexpr int kc = int(2048 / sizeof(T));
+  static constexpr int nc = 4096;
+};
+
+// Rounds n up to a multiple of 'multiple'
+inline int gemm_round_up(int n, int multiple)
+{
+  return (n + multiple - 1) / multiple * multiple;
+}
+
+// Scratch memory that grows as needed. The contents are not initialised, since packing overwrites every
+// element that the kernels read.
+template<typename T>
+class GemmBuffer
+{
+public:
+  T* reserve(size_t size)
+  {
+    if (size > m_size) {
+      m_data.reset(new T[size]);
+      m_size = size;
+    }
+
+    return m_data.get();
+  }
+
+private:
+  std::unique_ptr<T[]> m_data;
+  size_t m_size = 0;
+};
+
+// Copy an mc x kc block of A into micro-panels of mr rows, zero padding the last panel
+template<typename T>
+void gemm_pack_a(int mc, int kc, const T *a, int lda, int mr, T *buffer)
+{
+  for (int ir = 0; ir < mc; ir += mr) {
+    const int rows = std::min(mr, mc - ir);
+    for (int p = 0; p < kc; p++) {
+      for (int i = 0; i < rows; i++) {
+        buffer[i] = a[size_t(ir + i) * lda + p];
+      }
+      for (int i = rows; i < mr; i++) {
+        buffer[i] = 0;
+      }
+      buffer += mr;
+    }
+  }
+}
+
+// Copy a kc x nc block of B into micro-panels of nr columns, zero padding the last panel
+template<typename T>
+void gemm_pack_b(int kc, int nc, const T *b, int ldb, int nr, T *buffer)
+{
+  for (int jr = 0; jr < nc; jr += nr) {
+    const int columns = std::min(nr, nc - jr);
+    for (int p = 0; p < kc; p++) {
+      const T *row = b + size_t(p) * ldb + jr;
+      for (int j = 0; j < columns; j++) {
+        buffer[j] = row[j];
+      }
+      for (int j = columns; j < nr; j++) {
+        buffer[j] = 0;
+      }
+      buffer += nr;
+    }
+  }
+}
+
+//
+// Computes C = A * B, where A is m x k, B is k x n and C is m x n. Each operand is stored in row-major
+// order, with the distance between rows given by its leading dimension (lda, ldb, ldc). This means that
+// sub-blocks of a larger matrix can be multiplied in place.
+//
+// When 'accumulate' is true, the product is added to the existing contents of C.
+//
+// The arithmetic is that of 'Semiring' (see Semiring.h), so for example MinPlus<float> computes
+// C(i, j) = min over k of A(i, k) + B(k, j), and "adding" to C takes the minimum.
+//
+template<typename Semiring, typename T = typename Semiring::value_type>
+void semiring_gemm(int m, int n, int k, const T *a, int lda, const T *b, int ldb, T *c, int ldc, bool accumulate = false)
+{
+  if (!accumulate) {
+    for (int i = 0; i < m; i++) {
+      std::fill(c + size_t(i) * ldc, c + size_t(i) * ldc + n, Semiring::zero());
+    }
+  }
+
+  if (m == 0 || n == 0 || k == 0) {
+    return;
+  }
+
+  const GemmKernel<T> &kernel = semiring_kernel<Semiring>();
+  const int mr = kernel.mr;
+  const int nr = kernel.nr;
+
+  // block sizes must be a multiple of the micro-kernel tile size
+  const int mc_max = std::max(mr, GemmBlocking<T>::mc / mr * mr);
+  const int nc_max = std::max(nr, GemmBlocking<T>::nc / nr * nr);
+  const int kc_max = GemmBlocking<T>::kc;
+
+  // packing buffers are reused between calls made on the same thread, and only need to be as large as
+  // the blocks of this product, so small products do not touch megabytes of memory
+  const size_t a_size = size_t(std::min(mc_max, gemm_round_up(m, mr))) * std::min(kc_max, k);
+  const size_t b_size = size_t(std::min(nc_max, gemm_round_up(n, nr))) * std::min(kc_max, k);
+  thread_local GemmBuffer<T> a_buffer;
+  thread_local GemmBuffer<T> b_buffer;
+  T *packed_a = a_buffer.reserve(a_size);
+  T *packed_b = b_buffer.reserve(b_size);
+
+  // scratch tile for the ragged edges of C
+  thread_local GemmBuffer<T> edge_buffer;
+  T *edge = edge_buffer.reserve(size_t(mr) * nr);
+
+  for (int jc = 0; jc < n; jc += nc_max) {
+    const int nc = std::min(nc_max, n - jc);
+
+    for (int pc = 0; pc < k; pc += kc_max) {
+      const int kc = std::min(kc_max, k - pc);
+      gemm_pack_b(kc, nc, b + size_t(pc) * ldb + jc, ldb, nr, packed_b);
+
+      for (int ic = 0; ic < m; ic += mc_max) {
+        const int mc = std::min(mc_max, m - ic);
+        gemm_pack_a(mc, kc, a + size_t(ic) * lda + pc, lda, mr, packed_a);
+
+        for (int jr = 0; jr < nc; jr += nr) {
+          const int columns = std::min(nr, nc - jr);
+          const T *panel_b = packed_b + jr * kc;
+
+          for (int ir = 0; ir < mc; ir += mr) {
+            const int rows = std::min(mr, mc - ir);
+            const T *panel_a = packed_a + ir * kc;
+            T *tile = c + size_t(ic + ir) * ldc + jc + jr;
+
+            if (rows == mr && columns == nr) {
+              kernel.fn(kc, panel_a, panel_b, tile, ldc);
+              continue;
+            }
+
+            // compute a full tile, then only copy out the cells that are part of C
+            std::fill(edge, edge + mr * nr, Semiring::zero());
+            kernel.fn(kc, panel_a, panel_b, edge, nr);
+            for (int i = 0; i < rows; i++) {
+              for (int j = 0; j < columns; j++) {
+                tile[i * ldc + j] = Semiring::add(tile[i * ldc + j], edge[i * nr + j]);
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+// Computes C = A * B using ordinary arithmetic
+template<typename T>
+void gemm(int m, int n, int k, const T *a, int lda, const T *b, int ldb, T *c, int ldc, bool accumulate = false)
+{
+  semiring_gemm<PlusTimes<T>>(m, n, k, a, lda, b, ldb, c, ldc, accumulate);
+}
+
+// Computes rows [m_begin, m_end) of matrix_c = matrix_a * matrix_b in 'Semiring'
+template<typename Semiring, typename T = typename Semiring::value_type>
+void semiring_gemm(const Matrix<T> &matrix_a, const Matrix<T> &matrix_b, Matrix<T> &matrix_c, int m_begin, int m_end)
+{
+  // check input matrix sizes
+  assert(matrix_a.columns() == matrix_b.rows());
+
+  // check output matrix size
+  assert(matrix_c.rows() == matrix_a.rows());
+  assert(matrix_c.columns() == matrix_b.columns());
+  assert(0 <= m_begin && m_begin <= m_end && m_end <= matrix_c.rows());
+
+  const int lda = matrix_a.columns();
+  const int ldb = matrix_b.columns();
+  const int ldc = matrix_c.columns();
+
+  semiring_gemm<Semiring>(
+      m_end - m_begin,
+      matrix_b.columns(),
+      matrix_a.columns(),
+      matrix_a.data() + size_t(m_begin) * lda,
+      lda,
+      matrix_b.data(),
+      ldb,
+      matrix_c.data() + size_t(m_begin) * ldc,
+      ldc);
+}
+
+template<typename Semiring, typename T = typename Semiring::value_type>
+void semiring_gemm(const Matrix<T> &matrix_a, const Matrix<T> &matrix_b, Matrix<T> &matrix_c)
+{
+  semiring_gemm<Semiring>(matrix_a, matrix_b, matrix_c, 0, matrix_c.rows());
+}
+
+// Computes rows [m_begin, m_end) of matrix_c = matrix_a * matrix_b
+template<typename T>
+void gemm(const Matrix<T> &matrix_a, const Matrix<T> &matrix_b, Matrix<T> &matrix_c, int m_begin, int m_end)
+{
+  semiring_gemm<PlusTimes<T>>(matrix_a, matrix_b, matrix_c, m_begin, m_end);
+}
+
+template<typename T>
+void gemm(const Matrix<T> &matrix_a, const Matrix<T> &matrix_b, Matrix<T> &matrix_c)
+{
+  gemm(matrix_a, matrix_b, matrix_c, 0, matrix_c.rows());
+}
+
+// Computes matrix_c = matrix_a * matrix_b, for views with any stride
+template<typename T>
+void gemm(TileView<const T> matrix_a, TileView<const T> matrix_b, TileView<T> matrix_c)
+{
+  // check matrix sizes
+  assert(matrix_a.columns() == matrix_b.rows());
+  assert(matrix_c.rows() == matrix_a.rows());
+  assert(matrix_c.columns() == matrix_b.columns());
+
+  gemm(
+      matrix_c.rows(),
+      matrix_c.columns(),
+      matrix_a.columns(),
+      matrix_a.data(),
+      matrix_a.stride(),
+      matrix_b.data(),
+      matrix_b.stride(),
+      matrix_c.data(),
+      matrix_c.stride());
+}
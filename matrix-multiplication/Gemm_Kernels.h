@@ -0,0 +1,352 @@
+#pragma once
+
+//
+// Micro-kernels for the GEMM engine in Gemm.h.
+//
+// The portable kernel is always available. On x86-64, hand-vectorized AVX2 and AVX-512 kernels are also
+// compiled, using function-level target attributes so that the rest of the program does not need to be
+// built with -mavx2 or -mavx512f. The fastest kernel supported by the host CPU is chosen the first time
+// gemm_kernel<T>() is called, which means that one binary can run on older and newer hosts.
+//
+// Kernels are written for a semiring (see Semiring.h). Ordinary arithmetic has the most kernels, but
+// (min, +) and (max, +) on float and int are also vectorized; other semirings use the portable kernel.
+//
+
+#include <type_traits>
+
+#include "Semiring.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define GEMM_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+// A micro-kernel computes an mr x nr tile of C += A * B in its semiring, from packed micro-panels of A and B
+template<typename T>
+struct GemmKernel
+{
+  const char *name;
+  int mr;
+  int nr;
+  void (*fn)(int kc, const T *a, const T *b, T *c, int ldc);
+};
+
+// Portable register-blocked micro-kernel; accumulators are kept in an array that the compiler can map
+// onto registers, since MR and NR are known at compile time
+template<typename Semiring, int MR, int NR, typename T = typename Semiring::value_type>
+void gemm_micro_kernel(int kc, const T *__restrict a, const T *__restrict b, T *__restrict c, int ldc)
+{
+  T acc[MR][NR];
+  for (int i = 0; i < MR; i++) {
+    for (int j = 0; j < NR; j++) {
+      acc[i][j] = Semiring::zero();
+    }
+  }
+
+  for (int p = 0; p < kc; p++) {
+#pragma GCC unroll 16
+    for (int i = 0; i < MR; i++) {
+#pragma GCC unroll 16
+      for (int j = 0; j < NR; j++) {
+        acc[i][j] = Semiring::add(acc[i][j], Semiring::multiply(a[i], b[j]));
+      }
+    }
+
+    a += MR;
+    b += NR;
+  }
+
+  for (int i = 0; i < MR; i++) {
+    for (int j = 0; j < NR; j++) {
+      c[i * ldc + j] = Semiring::add(c[i * ldc + j], acc[i][j]);
+    }
+  }
+}
+
+#ifdef GEMM_X86_KERNELS
+
+#define GEMM_AVX2 __attribute__((target("avx2,fma")))
+#define GEMM_AVX512 __attribute__((target("avx512f")))
+
+// Loops over the tile must be fully unrolled, so that the accumulators can be kept in registers
+#define GEMM_UNROLL _Pragma("GCC unroll 16")
+
+//
+// Each micro-panel of B is NV vectors wide. For every k, one element of A is broadcast and multiplied
+// against the NV vectors of B, so the MR x NV accumulators never leave registers. The tile sizes are
+// chosen so that accumulators, B vectors and the broadcast fit in 16 (AVX2) or 32 (AVX-512) registers.
+//
+
+struct Avx2Double
+{
+  using Vec = __m256d;
+  static constexpr int width = 4;
+  GEMM_AVX2 static Vec zero() { return _mm256_setzero_pd(); }
+  GEMM_AVX2 static Vec load(const double *p) { return _mm256_loadu_pd(p); }
+  GEMM_AVX2 static Vec broadcast(const double *p) { return _mm256_broadcast_sd(p); }
+  GEMM_AVX2 static Vec fma(Vec a, Vec b, Vec c) { return _mm256_fmadd_pd(a, b, c); }
+  GEMM_AVX2 static void add_store(double *p, Vec v) { _mm256_storeu_pd(p, _mm256_add_pd(_mm256_loadu_pd(p), v)); }
+  GEMM_AVX2 static void store(double *p, Vec v) { _mm256_storeu_pd(p, v); }
+};
+
+struct Avx2Float
+{
+  using Vec = __m256;
+  static constexpr int width = 8;
+  GEMM_AVX2 static Vec zero() { return _mm256_setzero_ps(); }
+  GEMM_AVX2 static Vec load(const float *p) { return _mm256_loadu_ps(p); }
+  GEMM_AVX2 static Vec broadcast(const float *p) { return _mm256_broadcast_ss(p); }
+  GEMM_AVX2 static Vec fma(Vec a, Vec b, Vec c) { return _mm256_fmadd_ps(a, b, c); }
+  GEMM_AVX2 static void add_store(float *p, Vec v) { _mm256_storeu_ps(p, _mm256_add_ps(_mm256_loadu_ps(p), v)); }
+  GEMM_AVX2 static void store(float *p, Vec v) { _mm256_storeu_ps(p, v); }
+};
+
+struct Avx512Double
+{
+  using Vec = __m512d;
+  static constexpr int width = 8;
+  GEMM_AVX512 static Vec zero() { return _mm512_setzero_pd(); }
+  GEMM_AVX512 static Vec load(const double *p) { return _mm512_loadu_pd(p); }
+  GEMM_AVX512 static Vec broadcast(const double *p) { return _mm512_set1_pd(*p); }
+  GEMM_AVX512 static Vec fma(Vec a, Vec b, Vec c) { return _mm512_fmadd_pd(a, b, c); }
+  GEMM_AVX512 static void add_store(double *p, Vec v) { _mm512_storeu_pd(p, _mm512_add_pd(_mm512_loadu_pd(p), v)); }
+  GEMM_AVX512 static void store(double *p, Vec v) { _mm512_storeu_pd(p, v); }
+};
+
+struct Avx512Float
+{
+  using Vec = __m512;
+  static constexpr int width = 16;
+  GEMM_AVX512 static Vec zero() { return _mm512_setzero_ps(); }
+  GEMM_AVX512 static Vec load(const float *p) { return _mm512_loadu_ps(p); }
+  GEMM_AVX512 static Vec broadcast(const float *p) { return _mm512_set1_ps(*p); }
+  GEMM_AVX512 static Vec fma(Vec a, Vec b, Vec c) { return _mm512_fmadd_ps(a, b, c); }
+  GEMM_AVX512 static void add_store(float *p, Vec v) { _mm512_storeu_ps(p, _mm512_add_ps(_mm512_loadu_ps(p), v)); }
+  GEMM_AVX512 static void store(float *p, Vec v) { _mm512_storeu_ps(p, v); }
+};
+
+//
+// The same kernels serve the (min, +) and (max, +) semirings, with fma() standing for the semiring's
+// multiply-add, i.e. min(a + b, c), and add_store() combining a tile with C using min or max. Floating
+// point infinities already behave correctly under addition; the integer versions replace any sum that
+// involves infinity with infinity, as MinPlus<int>::multiply() does.
+//
+
+template<typename Semiring>
+struct Avx2TropicalFloat
+{
+  using Vec = __m256;
+  static constexpr int width = 8;
+  static constexpr bool min = std::is_same_v<Semiring, MinPlus<float>>;
+  GEMM_AVX2 static Vec combine(Vec a, Vec b) { return min ? _mm256_min_ps(a, b) : _mm256_max_ps(a, b); }
+  GEMM_AVX2 static Vec zero() { return _mm256_set1_ps(Semiring::zero()); }
+  GEMM_AVX2 static Vec load(const float *p) { return _mm256_loadu_ps(p); }
+  GEMM_AVX2 static Vec broadcast(const float *p) { return _mm256_broadcast_ss(p); }
+  GEMM_AVX2 static Vec fma(Vec a, Vec b, Vec c) { return combine(_mm256_add_ps(a, b), c); }
+  GEMM_AVX2 static void add_store(float *p, Vec v) { _mm256_storeu_ps(p, combine(_mm256_loadu_ps(p), v)); }
+};
+
+template<typename Semiring>
+struct Avx2TropicalInt
+{
+  using Vec = __m256i;
+  static constexpr int width = 8;
+  static constexpr bool min = std::is_same_v<Semiring, MinPlus<int>>;
+  GEMM_AVX2 static Vec combine(Vec a, Vec b) { return min ? _mm256_min_epi32(a, b) : _mm256_max_epi32(a, b); }
+  GEMM_AVX2 static Vec zero() { return _mm256_set1_epi32(Semiring::zero()); }
+  GEMM_AVX2 static Vec load(const int *p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+  GEMM_AVX2 static Vec broadcast(const int *p) { return _mm256_set1_epi32(*p); }
+
+  GEMM_AVX2 static Vec fma(Vec a, Vec b, Vec c)
+  {
+    const Vec infinity = zero();
+    const Vec absorbed = _mm256_or_si256(_mm256_cmpeq_epi32(a, infinity), _mm256_cmpeq_epi32(b, infinity));
+    return combine(_mm256_blendv_epi8(_mm256_add_epi32(a, b), infinity, absorbed), c);
+  }
+
+  GEMM_AVX2 static void add_store(int *p, Vec v) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), combine(load(p), v)); }
+};
+
+template<typename Semiring>
+struct Avx512TropicalFloat
+{
+  using Vec = __m512;
+  static constexpr int width = 16;
+  static constexpr bool min = std::is_same_v<Semiring, MinPlus<float>>;
+  GEMM_AVX512 static Vec combine(Vec a, Vec b) { return min ? _mm512_min_ps(a, b) : _mm512_max_ps(a, b); }
+  GEMM_AVX512 static Vec zero() { return _mm512_set1_ps(Semiring::zero()); }
+  GEMM_AVX512 static Vec load(const float *p) { return _mm512_loadu_ps(p); }
+  GEMM_AVX512 static Vec broadcast(const float *p) { return _mm512_set1_ps(*p); }
+  GEMM_AVX512 static Vec fma(Vec a, Vec b, Vec c) { return combine(_mm512_add_ps(a, b), c); }
+  GEMM_AVX512 static void add_store(float *p, Vec v) { _mm512_storeu_ps(p, combine(_mm512_loadu_ps(p), v)); }
+};
+
+template<typename Semiring>
+struct Avx512TropicalInt
+{
+  using Vec = __m512i;
+  static constexpr int width = 16;
+  static constexpr bool min = std::is_same_v<Semiring, MinPlus<int>>;
+  GEMM_AVX512 static Vec combine(Vec a, Vec b) { return min ? _mm512_min_epi32(a, b) : _mm512_max_epi32(a, b); }
+  GEMM_AVX512 static Vec zero() { return _mm512_set1_epi32(Semiring::zero()); }
+  GEMM_AVX512 static Vec load(const int *p) { return _mm512_loadu_si512(p); }
+  GEMM_AVX512 static Vec broadcast(const int *p) { return _mm512_set1_epi32(*p); }
+
+  GEMM_AVX512 static Vec fma(Vec a, Vec b, Vec c)
+  {
+    const Vec infinity = zero();
+    const __mmask16 absorbed = _mm512_cmpeq_epi32_mask(a, infinity) | _mm512_cmpeq_epi32_mask(b, infinity);
+    return combine(_mm512_mask_mov_epi32(_mm512_add_epi32(a, b), absorbed, infinity), c);
+  }
+
+  GEMM_AVX512 static void add_store(int *p, Vec v) { _mm512_storeu_si512(p, combine(load(p), v)); }
+};
+
+// The AVX2 and AVX-512 kernels are identical apart from their target attribute, which cannot be
+// templated, so the body is shared using a macro
+#define GEMM_SIMD_KERNEL_BODY                                             \
+  using Vec = typename Ops::Vec;                                          \
+  constexpr int W = Ops::width;                                           \
+                                                                          \
+  Vec acc[MR][NV];                                                        \
+  GEMM_UNROLL                                                             \
+  for (int i = 0; i < MR; i++) {                                          \
+    GEMM_UNROLL                                                           \
+    for (int j = 0; j < NV; j++) {                                        \
+      acc[i][j] = Ops::zero();                                            \
+    }                                                                     \
+  }                                                                       \
+                                                                          \
+  for (int p = 0; p < kc; p++) {                                          \
+    Vec row[NV];                                                          \
+    GEMM_UNROLL                                                           \
+    for (int j = 0; j < NV; j++) {                                        \
+      row[j] = Ops::load(b + j * W);                                      \
+    }                                                                     \
+    GEMM_UNROLL                                                           \
+    for (int i = 0; i < MR; i++) {                                        \
+      const Vec ai = Ops::broadcast(a + i);                               \
+      GEMM_UNROLL                                                         \
+      for (int j = 0; j < NV; j++) {                                      \
+        acc[i][j] = Ops::fma(ai, row[j], acc[i][j]);                      \
+      }                                                                   \
+    }                                                                     \
+                                                                          \
+    a += MR;                                                              \
+    b += NV * W;                                                          \
+  }                                                                       \
+                                                                          \
+  GEMM_UNROLL                                                             \
+  for (int i = 0; i < MR; i++) {                                          \
+    GEMM_UNROLL                                                           \
+    for (int j = 0; j < NV; j++) {                                        \
+      Ops::add_store(c + i * ldc + j * W, acc[i][j]);                     \
+    }                                                                     \
+  }
+
+template<typename Ops, int MR, int NV, typename T>
+GEMM_AVX2 void gemm_avx2_kernel(int kc, const T *a, const T *b, T *c, int ldc)
+{
+  GEMM_SIMD_KERNEL_BODY
+}
+
+template<typename Ops, int MR, int NV, typename T>
+GEMM_AVX512 void gemm_avx512_kernel(int kc, const T *a, const T *b, T *c, int ldc)
+{
+  GEMM_SIMD_KERNEL_BODY
+}
+
+#undef GEMM_SIMD_KERNEL_BODY
+#undef GEMM_UNROLL
+
+#endif
+
+// Vectorized kernels for a semiring, if there are any
+template<typename Semiring>
+struct GemmSimdKernels
+{
+  static constexpr bool available = false;
+};
+
+#ifdef GEMM_X86_KERNELS
+
+template<>
+struct GemmSimdKernels<PlusTimes<double>>
+{
+  static constexpr bool available = true;
+  static GemmKernel<double> avx2() { return { "avx2", 6, 8, gemm_avx2_kernel<Avx2Double, 6, 2, double> }; }
+  static GemmKernel<double> avx512() { return { "avx512", 12, 16, gemm_avx512_kernel<Avx512Double, 12, 2, double> }; }
+};
+
+template<>
+struct GemmSimdKernels<PlusTimes<float>>
+{
+  static constexpr bool available = true;
+  static GemmKernel<float> avx2() { return { "avx2", 6, 16, gemm_avx2_kernel<Avx2Float, 6, 2, float> }; }
+  static GemmKernel<float> avx512() { return { "avx512", 12, 32, gemm_avx512_kernel<Avx512Float, 12, 2, float> }; }
+};
+
+// there are no fused instructions for (min, +) or (max, +), so the tiles are the same as for float, apart
+// from the integer AVX2 kernels, which need spare registers for the infinity masks
+template<template<typename> class Tropical>
+struct GemmTropicalKernels
+{
+  static constexpr bool available = true;
+  static GemmKernel<float> avx2() { return { "avx2", 6, 16, gemm_avx2_kernel<Avx2TropicalFloat<Tropical<float>>, 6, 2, float> }; }
+  static GemmKernel<float> avx512() { return { "avx512", 12, 32, gemm_avx512_kernel<Avx512TropicalFloat<Tropical<float>>, 12, 2, float> }; }
+};
+
+template<> struct GemmSimdKernels<MinPlus<float>> : GemmTropicalKernels<MinPlus> {};
+template<> struct GemmSimdKernels<MaxPlus<float>> : GemmTropicalKernels<MaxPlus> {};
+
+template<template<typename> class Tropical>
+struct GemmTropicalIntKernels
+{
+  static constexpr bool available = true;
+  static GemmKernel<int> avx2() { return { "avx2", 4, 16, gemm_avx2_kernel<Avx2TropicalInt<Tropical<int>>, 4, 2, int> }; }
+  static GemmKernel<int> avx512() { return { "avx512", 12, 32, gemm_avx512_kernel<Avx512TropicalInt<Tropical<int>>, 12, 2, int> }; }
+};
+
+template<> struct GemmSimdKernels<MinPlus<int>> : GemmTropicalIntKernels<MinPlus> {};
+template<> struct GemmSimdKernels<MaxPlus<int>> : GemmTropicalIntKernels<MaxPlus> {};
+
+#endif
+
+template<typename Semiring>
+GemmKernel<typename Semiring::value_type> gemm_generic_kernel()
+{
+  return { "generic", 8, 4, gemm_micro_kernel<Semiring, 8, 4> };
+}
+
+template<typename Semiring>
+GemmKernel<typename Semiring::value_type> gemm_select_kernel()
+{
+#ifdef GEMM_X86_KERNELS
+  if constexpr (GemmSimdKernels<Semiring>::available) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+      return GemmSimdKernels<Semiring>::avx512();
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+      return GemmSimdKernels<Semiring>::avx2();
+    }
+  }
+#endif
+
+  return gemm_generic_kernel<Semiring>();
+}
+
+// Returns the micro-kernel used by semiring_gemm(), which is chosen once based on the features of the host CPU
+template<typename Semiring>
+const GemmKernel<typename Semiring::value_type>& semiring_kernel()
+{
+  static const GemmKernel<typename Semiring::value_type> kernel = gemm_select_kernel<Semiring>();
+  return kernel;
+}
+
+// Returns the micro-kernel used by gemm()
+template<typename T>
+const GemmKernel<T>& gemm_kernel()
+{
+  return semiring_kernel<PlusTimes<T>>();
+}
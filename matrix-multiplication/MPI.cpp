@@ -2,12 +2,15 @@
 
 #include <cassert>
 #include <chrono>
+#include <cstring>
 #include <iostream>
 #include <vector>
 
 #include <mpi.h>
 
+#include "MPI_Util.h"
 #include "Matrix.h"
+#include "Verify.h"
 
 using namespace std;
 using namespace std::chrono;
@@ -46,9 +49,11 @@ int usage(char **argv)
 {
   cout << endl;
   cout << "Usage:" << endl;
-  cout << "  " << argv[0] << " <M1> <N1/M2> <N2> [seed]" << endl;
+  cout << "  " << argv[0] << " <M1> <N1/M2> <N2> [seed] [even|calibrated]" << endl;
   cout << endl;
   cout << "Multiples a random M1xN1 matrix by a random M2xN2 matrix" << endl;
+  cout << endl;
+  cout << "Rows are divided evenly between processes, or in proportion to their measured speed" << endl;
 
   return 1;
 }
@@ -59,7 +64,7 @@ int main(int argc, char **argv)
     return usage(argv);
   }
 
-  if (argc != 4 && argc != 5) {
+  if (argc < 4 || argc > 6) {
     cout << "Invalid argument count: " << argc << endl;
     return usage(argv);
   }
@@ -82,6 +87,16 @@ int main(int argc, char **argv)
     return usage(argv);
   }
 
+  bool calibrated = false;
+  if (argc == 6) {
+    if (strcmp(argv[5], "calibrated") == 0) {
+      calibrated = true;
+    } else if (strcmp(argv[5], "even") != 0) {
+      cout << "Argument [even|calibrated] is invalid" << endl;
+      return usage(argv);
+    }
+  }
+
   MPI_Init(NULL, NULL);
 
   // how many processes are there?
@@ -97,16 +112,14 @@ int main(int argc, char **argv)
   Matrix<double> matrix_c(m_a, n_b);
 
   // matrices that are used on all nodes
-  Matrix<double> matrix_a_partition(m_a / cluster_size, n_a);
   Matrix<double> matrix_b(n_a, n_b);
-  Matrix<double> matrix_c_partition(m_a / cluster_size, n_b);
 
   if (host_rank == 0) {
     cout << "Cluster size: " << cluster_size << endl;
 
     // parse random seed
     std::optional<int> seed;
-    if (argc == 5) {
+    if (argc >= 5) {
       seed = atoi(argv[4]);
       cout << "Random seeds: " << *seed << ", " << (*seed + 1) << endl;
     }
@@ -131,17 +144,6 @@ int main(int argc, char **argv)
 
   auto start = high_resolution_clock::now();
 
-  // processes only need a subset of rows from matrix A, corresponding to their output rows
-  MPI_Scatter(
-      matrix_a.data(),              // address of send buffer (root node)
-      m_a * n_a / cluster_size,     // number of elements sent to each process (root node)
-      MPI_DOUBLE,                   // data type of send buffer elements (root node)
-      matrix_a_partition.data(),    // address of receive buffer
-      m_a * n_a / cluster_size,     // number of elements in receive buffer
-      MPI_DOUBLE,                   // data type of receive buffer elements
-      0,                            // ranking of sending process
-      MPI_COMM_WORLD);              // communicator
-
   // all processes need all data from matrix B
   MPI_Bcast(
       matrix_b.data(),              // starting address of buffer
@@ -150,21 +152,59 @@ int main(int argc, char **argv)
       0,                            // rank of broadcast root
       MPI_COMM_WORLD);              // communicator
 
+  // decide how many rows each process will compute; calibration multiplies a few rows against the real
+  // matrix B; each calibration run is roughly a tenth of an even share of the work
+  vector<int> row_counts;
+  if (calibrated) {
+    const int sample_rows = max(1, m_a / (cluster_size * 10));
+    Matrix<double> sample_a(sample_rows, n_a);
+    Matrix<double> sample_c(sample_rows, n_b);
+    sample_a.view().fill(1);
+
+    row_counts = calibrate_rows(m_a, sample_rows, [&]() {
+      multiply_matrices(sample_a, matrix_b, sample_c);
+    }, MPI_COMM_WORLD);
+  } else {
+    row_counts = partition_rows(m_a, cluster_size);
+  }
+
+  const vector<int> a_counts = scale_partitions(row_counts, n_a);
+  const vector<int> a_offsets = partition_offsets(row_counts, n_a);
+  const vector<int> c_counts = scale_partitions(row_counts, n_b);
+  const vector<int> c_offsets = partition_offsets(row_counts, n_b);
+
+  Matrix<double> matrix_a_partition(row_counts[host_rank], n_a);
+  Matrix<double> matrix_c_partition(row_counts[host_rank], n_b);
+
+  // processes only need a subset of rows from matrix A, corresponding to their output rows
+  MPI_Scatterv(
+      matrix_a.data(),              // address of send buffer (root node)
+      a_counts.data(),              // number of elements sent to each process (root node)
+      a_offsets.data(),             // offset of the elements sent to each process (root node)
+      MPI_DOUBLE,                   // data type of send buffer elements (root node)
+      matrix_a_partition.data(),    // address of receive buffer
+      a_counts[host_rank],          // number of elements in receive buffer
+      MPI_DOUBLE,                   // data type of receive buffer elements
+      0,                            // ranking of sending process
+      MPI_COMM_WORLD);              // communicator
+
   // do the work
   multiply_matrices(matrix_a_partition, matrix_b, matrix_c_partition);
 
   // gather the results
-  MPI_Gather(
+  MPI_Gatherv(
       matrix_c_partition.data(),    // starting address of send buffer
-      m_a * n_b / cluster_size,     // number of elements in send buffer
+      c_counts[host_rank],          // number of elements in send buffer
       MPI_DOUBLE,                   // data type of send buffer elements
       matrix_c.data(),              // starting address of receive buffer (root node)
-      m_a * n_b / cluster_size,     // number of elements for any single receive (root node)
+      c_counts.data(),              // number of elements received from each process (root node)
+      c_offsets.data(),             // offset of the elements received from each process (root node)
       MPI_DOUBLE,                   // data type of receive buffer elements (root node)
       0,                            // ranking of receiving process
       MPI_COMM_WORLD);              // communicator
 
   auto stop = high_resolution_clock::now();
+  bool verified = true;
 
   // only display complete results on the root node
   if (host_rank == 0) {
@@ -173,12 +213,23 @@ int main(int argc, char **argv)
     cout << matrix_c << endl;
 #endif
 
+    if (calibrated) {
+      cout << "Rows per process:";
+      for (int rows : row_counts) {
+        cout << " " << rows;
+      }
+      cout << endl;
+    }
+
     // how long did it take?
     auto duration = duration_cast<microseconds>(stop - start);
     cout << "Duration: " << duration.count() << " microseconds (" << (double(duration.count()) / 1000000.0f) << " seconds)" << endl;
+
+    // check the result, if asked to
+    verified = verify(matrix_a, matrix_b, matrix_c);
   }
 
   MPI_Finalize();
 
-  return 0;
+  return verified ? 0 : 1;
 }
@@ -2,6 +2,7 @@
 
 #include <cassert>
 #include <chrono>
+#include <cstring>
 #include <iostream>
 #include <vector>
 
@@ -15,7 +16,9 @@
 //
 #include "MPI_CUDA_K.h"
 
+#include "MPI_Util.h"
 #include "Matrix.h"
+#include "Verify.h"
 
 using namespace std;
 using namespace std::chrono;
@@ -24,51 +27,22 @@ int usage(char **argv)
 {
   cout << endl;
   cout << "Usage:" << endl;
-  cout << "  " << argv[0] << " <M1> <N1/M2> <N2> [seed]" << endl;
+  cout << "  " << argv[0] << " <M1> <N1/M2> <N2> [seed] [even|calibrated]" << endl;
   cout << endl;
   cout << "Multiples a random M1xN1 matrix by a random M2xN2 matrix" << endl;
+  cout << endl;
+  cout << "Rows are divided evenly between processes, or in proportion to their measured speed" << endl;
 
   return 1;
 }
 
-// only used for verification in this example
-template<typename T>
-void multiply_matrices(const Matrix<T> &matrix_a, const Matrix<T> &matrix_b, Matrix<T> &matrix_c)
-{
-  // check input matrix sizes
-  const auto n_a = matrix_a.columns();
-  const auto m_b = matrix_b.rows();
-  assert(matrix_a.columns() == matrix_b.rows());
-
-  // check output matrix size
-  const auto m_a = matrix_a.rows();
-  const auto n_b = matrix_b.columns();
-  assert(matrix_c.rows() == matrix_a.rows());
-  assert(matrix_c.columns() == matrix_b.columns());
-
-  // fill output matrix
-  for (int m = 0; m < m_a; m++) {
-    for (int n = 0; n < n_b; n++) {
-
-      // find value of cell [m,n]
-      T sum = 0;
-      for (int i = 0; i < n_a; i++) {
-        sum += matrix_a.get(m, i) * matrix_b.get(i, n);
-      }
-
-      // store value
-      matrix_c.set(m, n, sum);
-    }
-  }
-}
-
 int main(int argc, char **argv)
 {
   if (argc == 1) {
     return usage(argv);
   }
 
-  if (argc != 4 && argc != 5) {
+  if (argc < 4 || argc > 6) {
     cout << "Invalid argument count: " << argc << endl;
     return usage(argv);
   }
@@ -91,6 +65,16 @@ int main(int argc, char **argv)
     return usage(argv);
   }
 
+  bool calibrated = false;
+  if (argc == 6) {
+    if (strcmp(argv[5], "calibrated") == 0) {
+      calibrated = true;
+    } else if (strcmp(argv[5], "even") != 0) {
+      cout << "Argument [even|calibrated] is invalid" << endl;
+      return usage(argv);
+    }
+  }
+
   MPI_Init(NULL, NULL);
 
   // how many processes are there?
@@ -106,16 +90,14 @@ int main(int argc, char **argv)
   Matrix<double> matrix_c(m_a, n_b);
 
   // matrices that are used on all nodes
-  Matrix<double> matrix_a_partition(m_a / cluster_size, n_a);
   Matrix<double> matrix_b(n_a, n_b);
-  Matrix<double> matrix_c_partition(m_a / cluster_size, n_b);
 
   if (host_rank == 0) {
     cout << "Cluster size: " << cluster_size << endl;
 
     // parse random seed
     std::optional<int> seed;
-    if (argc == 5) {
+    if (argc >= 5) {
       seed = atoi(argv[4]);
       cout << "Random seeds: " << *seed << ", " << (*seed + 1) << endl;
     }
@@ -140,17 +122,6 @@ int main(int argc, char **argv)
 
   auto start = high_resolution_clock::now();
 
-  // processes only need a subset of rows from matrix A, corresponding to their output rows
-  MPI_Scatter(
-      matrix_a.data(),              // address of send buffer (root node)
-      m_a * n_a / cluster_size,     // number of elements sent to each process (root node)
-      MPI_DOUBLE,                   // data type of send buffer elements (root node)
-      matrix_a_partition.data(),    // address of receive buffer
-      m_a * n_a / cluster_size,     // number of elements in receive buffer
-      MPI_DOUBLE,                   // data type of receive buffer elements
-      0,                            // ranking of sending process
-      MPI_COMM_WORLD);              // communicator
-
   // all processes need all data from matrix B
   MPI_Bcast(
       matrix_b.data(),              // starting address of buffer
@@ -159,6 +130,42 @@ int main(int argc, char **argv)
       0,                            // rank of broadcast root
       MPI_COMM_WORLD);              // communicator
 
+  // decide how many rows each process will compute; calibration multiplies a few rows against the real
+  // matrix B; each calibration run is roughly a tenth of an even share of the work
+  vector<int> row_counts;
+  if (calibrated) {
+    const int sample_rows = max(1, m_a / (cluster_size * 10));
+    Matrix<double> sample_a(sample_rows, n_a);
+    Matrix<double> sample_c(sample_rows, n_b);
+    sample_a.view().fill(1);
+
+    row_counts = calibrate_rows(m_a, sample_rows, [&]() {
+      multiply_matrices_cuda(sample_a.data(), matrix_b.data(), sample_rows, n_a, n_b, sample_c.data());
+    }, MPI_COMM_WORLD);
+  } else {
+    row_counts = partition_rows(m_a, cluster_size);
+  }
+
+  const vector<int> a_counts = scale_partitions(row_counts, n_a);
+  const vector<int> a_offsets = partition_offsets(row_counts, n_a);
+  const vector<int> c_counts = scale_partitions(row_counts, n_b);
+  const vector<int> c_offsets = partition_offsets(row_counts, n_b);
+
+  Matrix<double> matrix_a_partition(row_counts[host_rank], n_a);
+  Matrix<double> matrix_c_partition(row_counts[host_rank], n_b);
+
+  // processes only need a subset of rows from matrix A, corresponding to their output rows
+  MPI_Scatterv(
+      matrix_a.data(),              // address of send buffer (root node)
+      a_counts.data(),              // number of elements sent to each process (root node)
+      a_offsets.data(),             // offset of the elements sent to each process (root node)
+      MPI_DOUBLE,                   // data type of send buffer elements (root node)
+      matrix_a_partition.data(),    // address of receive buffer
+      a_counts[host_rank],          // number of elements in receive buffer
+      MPI_DOUBLE,                   // data type of receive buffer elements
+      0,                            // ranking of sending process
+      MPI_COMM_WORLD);              // communicator
+
   // do the work
   multiply_matrices_cuda(
       matrix_a_partition.data(),
@@ -169,17 +176,19 @@ int main(int argc, char **argv)
       matrix_c_partition.data());
 
   // gather the results
-  MPI_Gather(
+  MPI_Gatherv(
       matrix_c_partition.data(),    // starting address of send buffer
-      m_a * n_b / cluster_size,     // number of elements in send buffer
+      c_counts[host_rank],          // number of elements in send buffer
       MPI_DOUBLE,                   // data type of send buffer elements
       matrix_c.data(),              // starting address of receive buffer (root node)
-      m_a * n_b / cluster_size,     // number of elements for any single receive (root node)
+      c_counts.data(),              // number of elements received from each process (root node)
+      c_offsets.data(),             // offset of the elements received from each process (root node)
       MPI_DOUBLE,                   // data type of receive buffer elements (root node)
       0,                            // ranking of receiving process
       MPI_COMM_WORLD);              // communicator
 
   auto stop = high_resolution_clock::now();
+  bool verified = true;
 
   // only display complete results on the root node
   if (host_rank == 0) {
@@ -188,28 +197,24 @@ int main(int argc, char **argv)
     cout << matrix_c << endl;
 #endif
 
+    if (calibrated) {
+      cout << "Rows per process:";
+      for (int rows : row_counts) {
+        cout << " " << rows;
+      }
+      cout << endl;
+    }
+
     // how long did it take?
     auto duration = duration_cast<microseconds>(stop - start);
     cout << "Duration: " << duration.count() << " microseconds (" << (double(duration.count()) / 1000000.0f) << " seconds)" << endl;
   
-    cout << "Checking result..." << endl;
-    Matrix<double> matrix_d(m_a, n_b);
-    multiply_matrices(matrix_a, matrix_b, matrix_d);
-
-#ifdef DEBUG
-    cout << endl;
-    cout << "Matrix D: " << endl;
-    cout << matrix_d << endl;
-#endif
-  
-    if (matrix_c == matrix_d) {
-      cout << "OK!" << endl;
-    } else {
-      cout << "Incorrect!" << endl;
-    }
+    // a full reference multiplication would take as long as the cluster did, so the result is
+    // checked using Freivalds' algorithm instead, which only needs matrix-vector products
+    verified = verify(matrix_a, matrix_b, matrix_c, true);
   }
 
   MPI_Finalize();
 
-  return 0;
+  return verified ? 0 : 1;
 }
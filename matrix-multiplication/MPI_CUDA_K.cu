@@ -48,6 +48,11 @@ void multiply_matrices_cuda(
     int n_b,
     double* matrix_c)
 {
+  // a process may be given no rows, and CUDA does not allow an empty grid to be launched
+  if (m_a == 0 || n_b == 0) {
+    return;
+  }
+
   // allocate GPU memory for matrix A
   const size_t sz_matrix_a = m_a * n_a * sizeof(double);
   double* dev_matrix_a;
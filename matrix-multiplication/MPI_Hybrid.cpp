@@ -0,0 +1,226 @@
+// #define DEBUG
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include <mpi.h>
+
+#include "Gemm.h"
+#include "MPI_Util.h"
+#include "Matrix.h"
+#include "Verify.h"
+#include "WorkStealingPool.h"
+
+using namespace std;
+using namespace std::chrono;
+
+// Computes this process's rows of C using every worker in the pool; only the main thread calls MPI
+template<typename T>
+void multiply_matrices(const Matrix<T> &matrix_a, const Matrix<T> &matrix_b, Matrix<T> &matrix_c, WorkStealingPool &pool)
+{
+  // check input matrix sizes
+  assert(matrix_a.columns() == matrix_b.rows());
+
+  // check output matrix size
+  assert(matrix_c.rows() == matrix_a.rows());
+  assert(matrix_c.columns() == matrix_b.columns());
+
+  // a few tasks per worker, so that the pool can balance the load
+  const int m_a = matrix_a.rows();
+  const int rows_per_task = max(16, m_a / (4 * pool.size()));
+
+  pool.parallel_for(0, m_a, rows_per_task, [&](int m_begin, int m_end) {
+    gemm(matrix_a, matrix_b, matrix_c, m_begin, m_end);
+  });
+}
+
+int usage(char **argv)
+{
+  cout << endl;
+  cout << "Usage:" << endl;
+  cout << "  " << argv[0] << " <M1> <N1/M2> <N2> [seed] [threads-per-process]" << endl;
+  cout << endl;
+  cout << "Multiples a random M1xN1 matrix by a random M2xN2 matrix, using multiple threads in each process" << endl;
+  cout << endl;
+  cout << "By default, the cores on each node are divided between the processes running on that node" << endl;
+
+  return 1;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc == 1) {
+    return usage(argv);
+  }
+
+  if (argc < 4 || argc > 6) {
+    cout << "Invalid argument count: " << argc << endl;
+    return usage(argv);
+  }
+
+  int m_a = atoi(argv[1]);
+  if (m_a <= 0) {
+    cout << "Argument <M1> is invalid" << endl;
+    return usage(argv);
+  }
+
+  int n_a = atoi(argv[2]);
+  if (n_a <= 0) {
+    cout << "Argument <N1/M2> is invalid" << endl;
+    return usage(argv);
+  }
+
+  int n_b = atoi(argv[3]);
+  if (n_b <= 0) {
+    cout << "Argument <N2> is invalid" << endl;
+    return usage(argv);
+  }
+
+  int num_threads = 0;
+  if (argc == 6) {
+    num_threads = atoi(argv[5]);
+    if (num_threads <= 0) {
+      cout << "Argument [threads-per-process] is invalid" << endl;
+      return usage(argv);
+    }
+  }
+
+  // worker threads never call MPI, so only the main thread needs to be able to
+  int provided;
+  MPI_Init_thread(NULL, NULL, MPI_THREAD_FUNNELED, &provided);
+  if (provided < MPI_THREAD_FUNNELED) {
+    cerr << "MPI implementation does not support MPI_THREAD_FUNNELED" << endl;
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+
+  // how many processes are there?
+  int cluster_size;
+  MPI_Comm_size(MPI_COMM_WORLD, &cluster_size);
+
+  // who am I?
+  int host_rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &host_rank);
+
+  // how many processes are sharing this node?
+  MPI_Comm node_comm;
+  MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, host_rank, MPI_INFO_NULL, &node_comm);
+  int node_size;
+  MPI_Comm_size(node_comm, &node_size);
+  MPI_Comm_free(&node_comm);
+
+  if (num_threads == 0) {
+    num_threads = max(1, int(thread::hardware_concurrency()) / node_size);
+  }
+
+  WorkStealingPool pool(num_threads);
+
+  // matrices that are only used on the root node
+  const bool root = host_rank == 0;
+  Matrix<double> matrix_a(root ? m_a : 0, root ? n_a : 0);
+  Matrix<double> matrix_c(root ? m_a : 0, root ? n_b : 0);
+
+  // every process needs a copy of B, but there is only one per process rather than one per core
+  Matrix<double> matrix_b(n_a, n_b);
+
+  if (root) {
+    cout << "Cluster size: " << cluster_size << endl;
+    cout << "Threads per process: " << num_threads << endl;
+
+    // parse random seed
+    std::optional<int> seed;
+    if (argc >= 5) {
+      seed = atoi(argv[4]);
+      cout << "Random seeds: " << *seed << ", " << (*seed + 1) << endl;
+    }
+
+    // generate random data on the root node
+    matrix_a.randomise(-100, 100, seed);
+
+    if (seed) {
+      seed = *seed + 1;
+    }
+
+    matrix_b.randomise(-100, 100, seed);
+
+#ifdef DEBUG
+    cout << endl;
+    cout << "Matrix A:" << endl;
+    cout << matrix_a << endl;
+    cout << "Matrix B:" << endl;
+    cout << matrix_b << endl;
+#endif
+  }
+
+  const vector<int> row_counts = partition_rows(m_a, cluster_size);
+  const vector<int> a_counts = scale_partitions(row_counts, n_a);
+  const vector<int> a_offsets = partition_offsets(row_counts, n_a);
+  const vector<int> c_counts = scale_partitions(row_counts, n_b);
+  const vector<int> c_offsets = partition_offsets(row_counts, n_b);
+
+  Matrix<double> matrix_a_partition(row_counts[host_rank], n_a);
+  Matrix<double> matrix_c_partition(row_counts[host_rank], n_b);
+
+  auto start = high_resolution_clock::now();
+
+  // processes only need a subset of rows from matrix A, corresponding to their output rows
+  MPI_Scatterv(
+      matrix_a.data(),              // address of send buffer (root node)
+      a_counts.data(),              // number of elements sent to each process (root node)
+      a_offsets.data(),             // offset of the elements sent to each process (root node)
+      MPI_DOUBLE,                   // data type of send buffer elements (root node)
+      matrix_a_partition.data(),    // address of receive buffer
+      a_counts[host_rank],          // number of elements in receive buffer
+      MPI_DOUBLE,                   // data type of receive buffer elements
+      0,                            // ranking of sending process
+      MPI_COMM_WORLD);              // communicator
+
+  // all processes need all data from matrix B
+  MPI_Bcast(
+      matrix_b.data(),              // starting address of buffer
+      n_a * n_b,                    // number of entries in buffer
+      MPI_DOUBLE,                   // data type of buffer
+      0,                            // rank of broadcast root
+      MPI_COMM_WORLD);              // communicator
+
+  // do the work
+  multiply_matrices(matrix_a_partition, matrix_b, matrix_c_partition, pool);
+
+  // gather the results
+  MPI_Gatherv(
+      matrix_c_partition.data(),    // starting address of send buffer
+      c_counts[host_rank],          // number of elements in send buffer
+      MPI_DOUBLE,                   // data type of send buffer elements
+      matrix_c.data(),              // starting address of receive buffer (root node)
+      c_counts.data(),              // number of elements received from each process (root node)
+      c_offsets.data(),             // offset of the elements received from each process (root node)
+      MPI_DOUBLE,                   // data type of receive buffer elements (root node)
+      0,                            // ranking of receiving process
+      MPI_COMM_WORLD);              // communicator
+
+  auto stop = high_resolution_clock::now();
+  bool verified = true;
+
+  // only display complete results on the root node
+  if (root) {
+#ifdef DEBUG
+    cout << "Matrix C:" << endl;
+    cout << matrix_c << endl;
+#endif
+
+    // how long did it take?
+    auto duration = duration_cast<microseconds>(stop - start);
+    cout << "Duration: " << duration.count() << " microseconds (" << (double(duration.count()) / 1000000.0f) << " seconds)" << endl;
+
+    // check the result, if asked to
+    verified = verify(matrix_a, matrix_b, matrix_c);
+  }
+
+  MPI_Finalize();
+
+  return verified ? 0 : 1;
+}
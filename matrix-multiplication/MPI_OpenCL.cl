@@ -22,3 +22,91 @@ __kernel void multiply_matrices_k(
 
   matrix_c[m * n_b + n] = sum;
 }
+
+
+//
+// Tile sizes are supplied as build options (e.g. -DTILE_SIZE=32), so that the best configuration can
+// be chosen for each device at run time. Each work-group computes a TILE_SIZE x TILE_SIZE tile of C,
+// and each work-item computes WORK_PER_ITEM cells in one row of that tile.
+//
+#ifndef TILE_SIZE
+#define TILE_SIZE 16
+#endif
+
+#ifndef TILE_K
+#define TILE_K 16
+#endif
+
+#ifndef WORK_PER_ITEM
+#define WORK_PER_ITEM 4
+#endif
+
+// cells computed by one work-item are this many columns apart
+#define ITEMS_PER_ROW (TILE_SIZE / WORK_PER_ITEM)
+
+//
+// Unlike multiply_matrices_k, dimension 0 indexes columns, so that neighbouring work-items read and
+// write neighbouring addresses. Tiles of A and B are staged in local memory, TILE_K columns (or rows)
+// at a time, so that each value loaded from global memory is reused TILE_SIZE times. Cells outside the
+// matrices are loaded as zeros, so the work-groups on the bottom and right edges need no special cases.
+//
+__kernel __attribute__((reqd_work_group_size(ITEMS_PER_ROW, TILE_SIZE, 1)))
+void multiply_matrices_tiled_k(
+    const __global double* matrix_a,
+    const __global double* matrix_b,
+    int m_a,
+    int n_a,
+    int n_b,
+    __global double* matrix_c)
+{
+  __local double tile_a[TILE_SIZE][TILE_K];
+  __local double tile_b[TILE_K][TILE_SIZE];
+
+  const int local_n = get_local_id(0);
+  const int local_m = get_local_id(1);
+  const int m_offset = get_group_id(1) * TILE_SIZE;
+  const int n_offset = get_group_id(0) * TILE_SIZE;
+
+  // the whole work-group cooperates to load each tile
+  const int id = local_m * ITEMS_PER_ROW + local_n;
+  const int items = TILE_SIZE * ITEMS_PER_ROW;
+
+  double sum[WORK_PER_ITEM];
+  for (int w = 0; w < WORK_PER_ITEM; w++) {
+    sum[w] = 0;
+  }
+
+  for (int k_offset = 0; k_offset < n_a; k_offset += TILE_K) {
+    for (int i = id; i < TILE_SIZE * TILE_K; i += items) {
+      const int m = m_offset + i / TILE_K;
+      const int k = k_offset + i % TILE_K;
+      tile_a[i / TILE_K][i % TILE_K] = (m < m_a && k < n_a) ? matrix_a[(size_t) m * n_a + k] : 0;
+    }
+
+    for (int i = id; i < TILE_K * TILE_SIZE; i += items) {
+      const int k = k_offset + i / TILE_SIZE;
+      const int n = n_offset + i % TILE_SIZE;
+      tile_b[i / TILE_SIZE][i % TILE_SIZE] = (k < n_a && n < n_b) ? matrix_b[(size_t) k * n_b + n] : 0;
+    }
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (int k = 0; k < TILE_K; k++) {
+      const double a = tile_a[local_m][k];
+      for (int w = 0; w < WORK_PER_ITEM; w++) {
+        sum[w] += a * tile_b[k][local_n + w * ITEMS_PER_ROW];
+      }
+    }
+
+    // wait for every work-item to finish with these tiles before they are overwritten
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+
+  const int m = m_offset + local_m;
+  for (int w = 0; w < WORK_PER_ITEM; w++) {
+    const int n = n_offset + local_n + w * ITEMS_PER_ROW;
+    if (m < m_a && n < n_b) {
+      matrix_c[(size_t) m * n_b + n] = sum[w];
+    }
+  }
+}
@@ -1,122 +1,476 @@
 // #define DEBUG
 
+#include <algorithm>
 #include <cassert>
 #include <chrono>
 #include <cstdio>
 #include <iostream>
+#include <limits>
+#include <string>
 #include <vector>
 
 #include <mpi.h>
 
 #include "Matrix.h"
+#include "MPI_Util.h"
 #include "File_Util.h"
 #include "OpenCL_Util.h"
+#include "Verify.h"
 
 using namespace std;
 using namespace std::chrono;
 
+// Stages of the pipeline; each has its own command queue, so that they can run concurrently
+enum Stage
+{
+  UPLOAD,
+  COMPUTE,
+  DOWNLOAD,
+  STAGES
+};
+
+// number of bands that can be in the pipeline at once: one in each stage
+const int PIPELINE_DEPTH = STAGES;
+
 // OpenCL globals
 static cl_device_id     ocl_device;
 static cl_context       ocl_context;
-static cl_command_queue ocl_queue;
+static cl_command_queue ocl_queues[STAGES];
 static cl_program       ocl_program;
 static cl_kernel        ocl_kernel;
-static cl_mem           ocl_matrix_a;
 static cl_mem           ocl_matrix_b;
-static cl_mem           ocl_matrix_c;
+static vector<cl_mem>   ocl_bands_a;
+static vector<cl_mem>   ocl_bands_c;
+
+// on CPU devices, buffers wrap host memory instead of being copied to and from it
+static bool             ocl_zero_copy;
 
-void init_ocl()
+// Tile sizes for multiply_matrices_tiled_k, which are passed to the compiler as build options
+struct KernelConfig
 {
-  // init OpenCL
-  cout << "Init OpenCL" << endl;
-  ocl_device = opencl_init();
-  ocl_context = opencl_create_context(ocl_device);
-  ocl_queue = opencl_create_command_queue(ocl_device, ocl_context);
+  int tile_size;
+  int tile_k;
+  int work_per_item;
+};
+
+// candidates for autotuning, from small work-groups that suit CPUs to large tiles that suit GPUs
+static const KernelConfig KERNEL_CONFIGS[] = {
+  {8, 8, 1},
+  {8, 16, 2},
+  {16, 8, 2},
+  {16, 16, 1},
+  {16, 16, 4},
+  {32, 8, 4},
+  {32, 16, 4},
+  {32, 16, 8},
+  {32, 32, 8},
+  {64, 16, 8},
+  {64, 16, 16},
+};
+
+// number of rows of A that each configuration is timed with
+const int TUNING_ROWS = 256;
+
+// configuration of ocl_kernel, or nullptr if it is the naive kernel
+static const KernelConfig *ocl_config = nullptr;
+
+// time spent building programs at startup, and how many of them were loaded from the cache
+static double ocl_build_seconds = 0;
+static int    ocl_programs = 0;
+static int    ocl_cached_programs = 0;
+
+cl_program load_program(const string &kernel_source, const char *options = nullptr)
+{
+  auto start = high_resolution_clock::now();
 
-  // compile kernel
-  cout << "Reading kernel source" << endl;
-  auto kernel_source = read_from_file("MPI_OpenCL.cl");
-  ocl_program = opencl_compile_program(ocl_device, ocl_context, kernel_source.c_str());
-  ocl_kernel = opencl_create_kernel(ocl_program, "multiply_matrices_k");
-  cout << "Kernel loaded" << endl;
+  bool from_cache;
+  cl_program program = opencl_load_program(ocl_device, ocl_context, kernel_source.c_str(), options, &from_cache);
+
+  ocl_build_seconds += duration<double>(high_resolution_clock::now() - start).count();
+  ocl_programs++;
+  if (from_cache) {
+    ocl_cached_programs++;
+  }
+
+  return program;
 }
 
-void init_ocl_buffers(int m_a, int n_a, int n_b)
+string build_options(const KernelConfig &config)
 {
-  ocl_matrix_a = opencl_create_buffer(ocl_context, CL_MEM_READ_ONLY, m_a * n_a * sizeof(double));
-  ocl_matrix_b = opencl_create_buffer(ocl_context, CL_MEM_READ_ONLY, n_a * n_b * sizeof(double));
-  ocl_matrix_c = opencl_create_buffer(ocl_context, CL_MEM_WRITE_ONLY, m_a * n_b * sizeof(double));
+  return "-DTILE_SIZE=" + to_string(config.tile_size) +
+      " -DTILE_K=" + to_string(config.tile_k) +
+      " -DWORK_PER_ITEM=" + to_string(config.work_per_item);
 }
 
-void multiply_matrices_ocl(const double* matrix_a, const double* matrix_b, int m_a, int n_a, int n_b, double* matrix_c)
+// Whether the work-group and local memory needed by a configuration are within the device's limits
+bool fits_device(const KernelConfig &config)
 {
-  // copy matrices to device memory
-  OPENCL_CHECK( clEnqueueWriteBuffer(ocl_queue, ocl_matrix_a, CL_TRUE, 0, m_a * n_a * sizeof(double), matrix_a, 0, NULL, NULL) );
-  OPENCL_CHECK( clEnqueueWriteBuffer(ocl_queue, ocl_matrix_b, CL_TRUE, 0, n_a * n_b * sizeof(double), matrix_b, 0, NULL, NULL) );
+  if (config.tile_size % config.work_per_item != 0) {
+    return false;
+  }
 
+  size_t max_group_size;
+  size_t max_item_sizes[3];
+  cl_ulong local_memory;
+  OPENCL_CHECK( clGetDeviceInfo(ocl_device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(max_group_size), &max_group_size, NULL) );
+  OPENCL_CHECK( clGetDeviceInfo(ocl_device, CL_DEVICE_MAX_WORK_ITEM_SIZES, sizeof(max_item_sizes), max_item_sizes, NULL) );
+  OPENCL_CHECK( clGetDeviceInfo(ocl_device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(local_memory), &local_memory, NULL) );
+
+  const size_t items_per_row = config.tile_size / config.work_per_item;
+  return items_per_row * config.tile_size <= max_group_size &&
+      items_per_row <= max_item_sizes[0] &&
+      size_t(config.tile_size) <= max_item_sizes[1] &&
+      2 * size_t(config.tile_size) * config.tile_k * sizeof(double) <= local_memory;
+}
+
+// Enqueues a kernel to multiply m_a rows of A by B, once the commands in wait_list have finished
+cl_event enqueue_kernel(
+    cl_command_queue queue,
+    cl_kernel kernel,
+    const KernelConfig *config,
+    cl_mem matrix_a,
+    cl_mem matrix_b,
+    int m_a,
+    int n_a,
+    int n_b,
+    cl_mem matrix_c,
+    const vector<cl_event> &wait_list)
+{
   // set kernel args
-  opencl_set_kernel_cl_mem_arg(ocl_kernel, ocl_matrix_a, 0);
-  opencl_set_kernel_cl_mem_arg(ocl_kernel, ocl_matrix_b, 1);
-  opencl_set_kernel_int_arg(ocl_kernel, m_a, 2);
-  opencl_set_kernel_int_arg(ocl_kernel, n_a, 3);
-  opencl_set_kernel_int_arg(ocl_kernel, n_b, 4);
-  opencl_set_kernel_cl_mem_arg(ocl_kernel, ocl_matrix_c, 5);
-
-  // overall problem size
-  const size_t global[] = {
+  opencl_set_kernel_cl_mem_arg(kernel, matrix_a, 0);
+  opencl_set_kernel_cl_mem_arg(kernel, matrix_b, 1);
+  opencl_set_kernel_int_arg(kernel, m_a, 2);
+  opencl_set_kernel_int_arg(kernel, n_a, 3);
+  opencl_set_kernel_int_arg(kernel, n_b, 4);
+  opencl_set_kernel_cl_mem_arg(kernel, matrix_c, 5);
+
+  // overall problem size; the naive kernel uses one work-item per cell, with dimension 0 for rows
+  size_t global[] = {
       (size_t) m_a,
       (size_t) n_b
   };
 
+  // the tiled kernel uses one work-group per tile, with dimension 0 for columns, and lets the
+  // work-groups on the edges run past the end of the matrices
+  size_t local[2];
+  if (config) {
+    const size_t tiles_m = (m_a + config->tile_size - 1) / config->tile_size;
+    const size_t tiles_n = (n_b + config->tile_size - 1) / config->tile_size;
+    local[0] = config->tile_size / config->work_per_item;
+    local[1] = config->tile_size;
+    global[0] = tiles_n * local[0];
+    global[1] = tiles_m * local[1];
+  }
+
   // enqueues a command to execute a kernel on a device
   cl_event event = nullptr;
-  OPENCL_CHECK( clEnqueueNDRangeKernel(ocl_queue, ocl_kernel, 2, NULL, global, NULL, 0, NULL, &event) );
-
-  // waits on the host thread for commands identified by event objects to complete
-  OPENCL_CHECK( clWaitForEvents(1, &event) );
+  OPENCL_CHECK( clEnqueueNDRangeKernel(
+      queue, kernel, 2, NULL, global, config ? local : NULL,
+      cl_uint(wait_list.size()), wait_list.empty() ? NULL : wait_list.data(), &event) );
 
-  // enqueue commands to read from a buffer object to host memory
-  OPENCL_CHECK( clEnqueueReadBuffer(ocl_queue, ocl_matrix_c, CL_TRUE, 0, m_a * n_b * sizeof(double), matrix_c, 0, NULL, NULL) );
+  return event;
 }
 
-// only used for verification in this example
-template<typename T>
-void multiply_matrices(const Matrix<T> &matrix_a, const Matrix<T> &matrix_b, Matrix<T> &matrix_c)
+//
+// Chooses the fastest configuration of the tiled kernel for this device, by building each candidate
+// that fits and timing it on the first few rows of a problem of the same shape.
+//
+void tune_ocl(const string &kernel_source, int m_a, int n_a, int n_b)
 {
-  // check input matrix sizes
-  const auto n_a = matrix_a.columns();
-  const auto m_b = matrix_b.rows();
-  assert(matrix_a.columns() == matrix_b.rows());
-
-  // check output matrix size
-  const auto m_a = matrix_a.rows();
-  const auto n_b = matrix_b.columns();
-  assert(matrix_c.rows() == matrix_a.rows());
-  assert(matrix_c.columns() == matrix_b.columns());
-
-  // fill output matrix
-  for (int m = 0; m < m_a; m++) {
-    for (int n = 0; n < n_b; n++) {
-
-      // find value of cell [m,n]
-      T sum = 0;
-      for (int i = 0; i < n_a; i++) {
-        sum += matrix_a.get(m, i) * matrix_b.get(i, n);
+  const int rows = max(1, min(m_a, TUNING_ROWS));
+  cl_command_queue queue = ocl_queues[COMPUTE];
+
+  cl_mem matrix_a = opencl_create_buffer(ocl_context, CL_MEM_READ_ONLY, size_t(rows) * n_a * sizeof(double));
+  cl_mem matrix_b = opencl_create_buffer(ocl_context, CL_MEM_READ_ONLY, size_t(n_a) * n_b * sizeof(double));
+  cl_mem matrix_c = opencl_create_buffer(ocl_context, CL_MEM_WRITE_ONLY, size_t(rows) * n_b * sizeof(double));
+
+  // timings should not depend on whatever happened to be in device memory
+  const double zero = 0;
+  OPENCL_CHECK( clEnqueueFillBuffer(queue, matrix_a, &zero, sizeof(zero), 0, size_t(rows) * n_a * sizeof(double), 0, NULL, NULL) );
+  OPENCL_CHECK( clEnqueueFillBuffer(queue, matrix_b, &zero, sizeof(zero), 0, size_t(n_a) * n_b * sizeof(double), 0, NULL, NULL) );
+  OPENCL_CHECK( clFinish(queue) );
+
+  double best = numeric_limits<double>::infinity();
+  int tried = 0;
+  for (const auto &config : KERNEL_CONFIGS) {
+    if (!fits_device(config)) {
+      continue;
+    }
+
+    auto options = build_options(config);
+    cl_program program = load_program(kernel_source, options.c_str());
+    cl_kernel kernel = opencl_create_kernel(program, "multiply_matrices_tiled_k");
+
+    // registers or local memory used by the compiled kernel may limit the work-group size further
+    size_t max_group_size;
+    OPENCL_CHECK( clGetKernelWorkGroupInfo(kernel, ocl_device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(max_group_size), &max_group_size, NULL) );
+
+    if (size_t(config.tile_size / config.work_per_item) * config.tile_size <= max_group_size) {
+      tried++;
+
+      // the first run may include one-off costs, so the fastest of several runs is used
+      double time = numeric_limits<double>::infinity();
+      for (int run = 0; run < 3; run++) {
+        auto start = high_resolution_clock::now();
+        cl_event event = enqueue_kernel(queue, kernel, &config, matrix_a, matrix_b, rows, n_a, n_b, matrix_c, {});
+        OPENCL_CHECK( clWaitForEvents(1, &event) );
+        time = min(time, duration<double>(high_resolution_clock::now() - start).count());
+        OPENCL_CHECK( clReleaseEvent(event) );
+      }
+
+#ifdef DEBUG
+      cout << "  " << options << ": " << int64_t(time * 1e6) << " microseconds" << endl;
+#endif
+
+      if (time < best) {
+        swap(program, ocl_program);
+        swap(kernel, ocl_kernel);
+        ocl_config = &config;
+        best = time;
       }
+    }
 
-      // store value
-      matrix_c.set(m, n, sum);
+    // release whichever kernel was not chosen
+    if (kernel) {
+      OPENCL_CHECK( clReleaseKernel(kernel) );
+    }
+    if (program) {
+      OPENCL_CHECK( clReleaseProgram(program) );
     }
   }
+
+  OPENCL_CHECK( clReleaseMemObject(matrix_a) );
+  OPENCL_CHECK( clReleaseMemObject(matrix_b) );
+  OPENCL_CHECK( clReleaseMemObject(matrix_c) );
+
+  if (!ocl_config) {
+    cerr << "No configuration of the tiled kernel fits this device" << endl;
+    exit(1);
+  }
+
+  char device_name[256];
+  OPENCL_CHECK( clGetDeviceInfo(ocl_device, CL_DEVICE_NAME, sizeof(device_name), device_name, NULL) );
+  cout << "Tuned kernel for " << device_name << ": " << build_options(*ocl_config) << " (fastest of " << tried << ")" << endl;
+}
+
+// Number of rows in each band, when m_a rows are split into the given number of bands
+int band_rows(int m_a, int bands)
+{
+  return (m_a + bands - 1) / bands;
+}
+
+void init_ocl(bool tiled, int m_a, int n_a, int n_b, int bands)
+{
+  auto start = high_resolution_clock::now();
+
+  // init OpenCL
+  cout << "Init OpenCL" << endl;
+  ocl_device = opencl_init();
+  ocl_context = opencl_create_context(ocl_device);
+
+  // profiling is enabled so that the time spent in each stage can be reported
+  for (auto &queue : ocl_queues) {
+    queue = opencl_create_command_queue(ocl_device, ocl_context, CL_QUEUE_PROFILING_ENABLE);
+  }
+
+  cl_device_type device_type;
+  OPENCL_CHECK( clGetDeviceInfo(ocl_device, CL_DEVICE_TYPE, sizeof(device_type), &device_type, NULL) );
+  ocl_zero_copy = (device_type & CL_DEVICE_TYPE_CPU) != 0;
+
+  // zero-copy buffers have to wrap the host matrices, so they are only created once those exist;
+  // otherwise there is one buffer per band that can be in the pipeline, which are reused in turn
+  if (!ocl_zero_copy && m_a > 0) {
+    const int rows = band_rows(m_a, bands);
+    ocl_matrix_b = opencl_create_buffer(ocl_context, CL_MEM_READ_ONLY, size_t(n_a) * n_b * sizeof(double));
+    for (int band = 0; band < min(bands, PIPELINE_DEPTH); band++) {
+      ocl_bands_a.push_back(opencl_create_buffer(ocl_context, CL_MEM_READ_ONLY, size_t(rows) * n_a * sizeof(double)));
+      ocl_bands_c.push_back(opencl_create_buffer(ocl_context, CL_MEM_WRITE_ONLY, size_t(rows) * n_b * sizeof(double)));
+    }
+  }
+
+  // compile kernel
+  cout << "Reading kernel source" << endl;
+  auto kernel_source = read_from_file("MPI_OpenCL.cl");
+  if (tiled) {
+    tune_ocl(kernel_source, m_a, n_a, n_b);
+  } else {
+    ocl_program = load_program(kernel_source);
+    ocl_kernel = opencl_create_kernel(ocl_program, "multiply_matrices_k");
+  }
+  cout << "Kernel loaded" << endl;
+
+  // building programs from source can dominate startup, which is what the program cache avoids
+  auto startup = duration_cast<microseconds>(high_resolution_clock::now() - start);
+  cout << "Startup: " << startup.count() << " microseconds, of which building " << ocl_programs << " programs ("
+      << ocl_cached_programs << " from cache): " << int64_t(ocl_build_seconds * 1e6) << " microseconds" << endl;
+}
+
+// Time the device spent on each stage, and from the first command starting to the last one ending, in seconds
+struct Profile
+{
+  double upload;
+  double compute;
+  double download;
+  double elapsed;
+};
+
+cl_ulong event_time(cl_event event, cl_profiling_info param)
+{
+  cl_ulong nanoseconds;
+  OPENCL_CHECK( clGetEventProfilingInfo(event, param, sizeof(nanoseconds), &nanoseconds, NULL) );
+  return nanoseconds;
+}
+
+//
+// Computes C = A * B one band of rows at a time, so that copying one band to or from the device can
+// overlap with computing another. Each stage has its own in-order queue, and events order the stages
+// of each band: the upload of band k+1, the kernel for band k and the download of band k-1 can all run
+// at the same time.
+//
+// Band buffers are reused once a band has left the pipeline, so the kernel for a band must also wait
+// for the previous download from its buffer, and the upload must wait for the previous kernel.
+//
+// On CPU devices, the buffers wrap the host matrices (CL_MEM_USE_HOST_PTR), so there is nothing to
+// upload, and downloading is just mapping the results, which does not copy them.
+//
+Profile multiply_matrices_ocl(const double* matrix_a, const double* matrix_b, int m_a, int n_a, int n_b, double* matrix_c, int bands)
+{
+  Profile profile = {};
+  if (m_a == 0) {
+    return profile;
+  }
+
+  const int rows_per_band = band_rows(m_a, bands);
+  bands = (m_a + rows_per_band - 1) / rows_per_band;
+
+  vector<cl_mem> bands_a = ocl_bands_a;
+  vector<cl_mem> bands_c = ocl_bands_c;
+  cl_mem buffer_b = ocl_matrix_b;
+  if (ocl_zero_copy) {
+    cl_int err;
+    buffer_b = clCreateBuffer(ocl_context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR,
+        size_t(n_a) * n_b * sizeof(double), const_cast<double*>(matrix_b), &err);
+    OPENCL_CHECK(err);
+
+    for (int band = 0; band < bands; band++) {
+      const size_t offset = size_t(band) * rows_per_band;
+      const int rows = min(rows_per_band, m_a - band * rows_per_band);
+
+      bands_a.push_back(clCreateBuffer(ocl_context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR,
+          size_t(rows) * n_a * sizeof(double), const_cast<double*>(matrix_a) + offset * n_a, &err));
+      OPENCL_CHECK(err);
+      bands_c.push_back(clCreateBuffer(ocl_context, CL_MEM_WRITE_ONLY | CL_MEM_USE_HOST_PTR,
+          size_t(rows) * n_b * sizeof(double), matrix_c + offset * n_b, &err));
+      OPENCL_CHECK(err);
+    }
+  }
+
+  const int slots = int(bands_a.size());
+  vector<cl_event> uploads(bands, nullptr);
+  vector<cl_event> kernels(bands, nullptr);
+  vector<cl_event> downloads(bands, nullptr);
+  vector<void*> mapped(bands, nullptr);
+
+  cl_event upload_b = nullptr;
+  if (!ocl_zero_copy) {
+    OPENCL_CHECK( clEnqueueWriteBuffer(ocl_queues[UPLOAD], buffer_b, CL_FALSE, 0, size_t(n_a) * n_b * sizeof(double), matrix_b, 0, NULL, &upload_b) );
+  }
+
+  for (int band = 0; band < bands; band++) {
+    const size_t offset = size_t(band) * rows_per_band;
+    const int rows = min(rows_per_band, m_a - band * rows_per_band);
+    const int slot = band % slots;
+
+    if (!ocl_zero_copy) {
+      // the band that last used this buffer must have been read by its kernel
+      const cl_event *previous = band >= slots ? &kernels[band - slots] : NULL;
+      OPENCL_CHECK( clEnqueueWriteBuffer(
+          ocl_queues[UPLOAD], bands_a[slot], CL_FALSE, 0, size_t(rows) * n_a * sizeof(double), matrix_a + offset * n_a,
+          previous ? 1 : 0, previous, &uploads[band]) );
+    }
+
+    vector<cl_event> wait_list;
+    if (uploads[band]) {
+      wait_list.push_back(uploads[band]);
+    }
+    if (band == 0 && upload_b) {
+      wait_list.push_back(upload_b);
+    }
+    if (band >= slots) {
+      wait_list.push_back(downloads[band - slots]);
+    }
+    kernels[band] = enqueue_kernel(ocl_queues[COMPUTE], ocl_kernel, ocl_config, bands_a[slot], buffer_b, rows, n_a, n_b, bands_c[slot], wait_list);
+
+    cl_int err = CL_SUCCESS;
+    if (ocl_zero_copy) {
+      mapped[band] = clEnqueueMapBuffer(
+          ocl_queues[DOWNLOAD], bands_c[slot], CL_FALSE, CL_MAP_READ, 0, size_t(rows) * n_b * sizeof(double),
+          1, &kernels[band], &downloads[band], &err);
+    } else {
+      err = clEnqueueReadBuffer(
+          ocl_queues[DOWNLOAD], bands_c[slot], CL_FALSE, 0, size_t(rows) * n_b * sizeof(double), matrix_c + offset * n_b,
+          1, &kernels[band], &downloads[band]);
+    }
+    OPENCL_CHECK(err);
+
+    // submit each band straight away, so that the device can start on it while later bands are enqueued
+    for (auto &queue : ocl_queues) {
+      OPENCL_CHECK( clFlush(queue) );
+    }
+  }
+
+  for (auto &queue : ocl_queues) {
+    OPENCL_CHECK( clFinish(queue) );
+  }
+
+  // every command has finished, so the profiling information is available
+  cl_ulong first = numeric_limits<cl_ulong>::max();
+  cl_ulong last = 0;
+  auto add = [&](cl_event event, double &stage) {
+    if (event) {
+      const cl_ulong start = event_time(event, CL_PROFILING_COMMAND_START);
+      const cl_ulong end = event_time(event, CL_PROFILING_COMMAND_END);
+      stage += (end - start) * 1e-9;
+      first = min(first, start);
+      last = max(last, end);
+      OPENCL_CHECK( clReleaseEvent(event) );
+    }
+  };
+
+  add(upload_b, profile.upload);
+  for (int band = 0; band < bands; band++) {
+    add(uploads[band], profile.upload);
+    add(kernels[band], profile.compute);
+    add(downloads[band], profile.download);
+  }
+  profile.elapsed = (last - first) * 1e-9;
+
+  if (ocl_zero_copy) {
+    for (int band = 0; band < bands; band++) {
+      OPENCL_CHECK( clEnqueueUnmapMemObject(ocl_queues[DOWNLOAD], bands_c[band], mapped[band], 0, NULL, NULL) );
+    }
+    OPENCL_CHECK( clFinish(ocl_queues[DOWNLOAD]) );
+
+    for (int band = 0; band < bands; band++) {
+      OPENCL_CHECK( clReleaseMemObject(bands_a[band]) );
+      OPENCL_CHECK( clReleaseMemObject(bands_c[band]) );
+    }
+    OPENCL_CHECK( clReleaseMemObject(buffer_b) );
+  }
+
+  return profile;
 }
 
 int usage(char **argv)
 {
   cout << endl;
   cout << "Usage:" << endl;
-  cout << "  " << argv[0] << " <M1> <N1/M2> <N2> [seed]" << endl;
+  cout << "  " << argv[0] << " <M1> <N1/M2> <N2> [seed] [naive|tiled] [bands]" << endl;
   cout << endl;
   cout << "Multiples a random M1xN1 matrix by a random M2xN2 matrix" << endl;
+  cout << endl;
+  cout << "The tiled kernel is used by default, with tile sizes tuned for each device" << endl;
+  cout << "Splitting each process's rows into several bands overlaps transfers with computation" << endl;
 
   return 1;
 }
@@ -127,7 +481,7 @@ int main(int argc, char **argv)
     return usage(argv);
   }
 
-  if (argc != 4 && argc != 5) {
+  if (argc < 4 || argc > 7) {
     cout << "Invalid argument count: " << argc << endl;
     return usage(argv);
   }
@@ -150,6 +504,25 @@ int main(int argc, char **argv)
     return usage(argv);
   }
 
+  bool tiled = true;
+  if (argc >= 6) {
+    string kernel = argv[5];
+    if (kernel != "naive" && kernel != "tiled") {
+      cout << "Argument [naive|tiled] is invalid" << endl;
+      return usage(argv);
+    }
+    tiled = kernel == "tiled";
+  }
+
+  int bands = 1;
+  if (argc == 7) {
+    bands = atoi(argv[6]);
+    if (bands <= 0) {
+      cout << "Argument [bands] is invalid" << endl;
+      return usage(argv);
+    }
+  }
+
   MPI_Init(NULL, NULL);
 
   // how many processes are there?
@@ -160,24 +533,30 @@ int main(int argc, char **argv)
   int host_rank;
   MPI_Comm_rank(MPI_COMM_WORLD, &host_rank);
 
-  init_ocl();
-  init_ocl_buffers(m_a, n_a, n_b);
+  // rows that do not divide evenly between processes are given to the first few
+  const vector<int> row_counts = partition_rows(m_a, cluster_size);
+  const vector<int> a_counts = scale_partitions(row_counts, n_a);
+  const vector<int> a_offsets = partition_offsets(row_counts, n_a);
+  const vector<int> c_counts = scale_partitions(row_counts, n_b);
+  const vector<int> c_offsets = partition_offsets(row_counts, n_b);
+
+  init_ocl(tiled, row_counts[host_rank], n_a, n_b, bands);
 
   // matrices that are only used on the root node
   Matrix<double> matrix_a(m_a, n_a);
   Matrix<double> matrix_c(m_a, n_b);
 
   // matrices that are used on all nodes
-  Matrix<double> matrix_a_partition(m_a / cluster_size, n_a);
+  Matrix<double> matrix_a_partition(row_counts[host_rank], n_a);
   Matrix<double> matrix_b(n_a, n_b);
-  Matrix<double> matrix_c_partition(m_a / cluster_size, n_b);
+  Matrix<double> matrix_c_partition(row_counts[host_rank], n_b);
 
   if (host_rank == 0) {
     cout << "Cluster size: " << cluster_size << endl;
 
     // parse random seed
     std::optional<int> seed;
-    if (argc == 5) {
+    if (argc >= 5) {
       seed = atoi(argv[4]);
       cout << "Random seeds: " << *seed << ", " << (*seed + 1) << endl;
     }
@@ -203,12 +582,13 @@ int main(int argc, char **argv)
   auto start = high_resolution_clock::now();
 
   // processes only need a subset of rows from matrix A, corresponding to their output rows
-  MPI_Scatter(
+  MPI_Scatterv(
       matrix_a.data(),              // address of send buffer (root node)
-      m_a * n_a / cluster_size,     // number of elements sent to each process (root node)
+      a_counts.data(),              // number of elements sent to each process (root node)
+      a_offsets.data(),             // offset of the elements sent to each process (root node)
       MPI_DOUBLE,                   // data type of send buffer elements (root node)
       matrix_a_partition.data(),    // address of receive buffer
-      m_a * n_a / cluster_size,     // number of elements in receive buffer
+      a_counts[host_rank],          // number of elements in receive buffer
       MPI_DOUBLE,                   // data type of receive buffer elements
       0,                            // ranking of sending process
       MPI_COMM_WORLD);              // communicator
@@ -222,26 +602,33 @@ int main(int argc, char **argv)
       MPI_COMM_WORLD);              // communicator
 
   // do the work
-  multiply_matrices_ocl(
+  Profile profile = multiply_matrices_ocl(
       matrix_a_partition.data(),
       matrix_b.data(),
       matrix_a_partition.rows(),
       matrix_a_partition.columns(),
       matrix_b.columns(),
-      matrix_c_partition.data());
+      matrix_c_partition.data(),
+      bands);
 
   // gather the results
-  MPI_Gather(
+  MPI_Gatherv(
       matrix_c_partition.data(),    // starting address of send buffer
-      m_a * n_b / cluster_size,     // number of elements in send buffer
+      c_counts[host_rank],          // number of elements in send buffer
       MPI_DOUBLE,                   // data type of send buffer elements
       matrix_c.data(),              // starting address of receive buffer (root node)
-      m_a * n_b / cluster_size,     // number of elements for any single receive (root node)
+      c_counts.data(),              // number of elements received from each process (root node)
+      c_offsets.data(),             // offset of the elements received from each process (root node)
       MPI_DOUBLE,                   // data type of receive buffer elements (root node)
       0,                            // ranking of receiving process
       MPI_COMM_WORLD);              // communicator
 
   auto stop = high_resolution_clock::now();
+  bool verified = true;
+
+  // the slowest device determines how long each stage took
+  Profile slowest;
+  MPI_Reduce(&profile, &slowest, 4, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
 
   // only display complete results on the root node
   if (host_rank == 0) {
@@ -254,24 +641,19 @@ int main(int argc, char **argv)
     auto duration = duration_cast<microseconds>(stop - start);
     cout << "Duration: " << duration.count() << " microseconds (" << (double(duration.count()) / 1000000.0f) << " seconds)" << endl;
 
-    cout << "Checking result..." << endl;
-    Matrix<double> matrix_d(m_a, n_b);
-    multiply_matrices(matrix_a, matrix_b, matrix_d);
+    // if the stages add up to more than the elapsed time, then some of them overlapped
+    cout << "Device profile (slowest process, " << bands << " bands):" << endl;
+    cout << "  Upload:      " << int64_t(slowest.upload * 1e6) << " microseconds" << endl;
+    cout << "  Compute:     " << int64_t(slowest.compute * 1e6) << " microseconds" << endl;
+    cout << "  Download:    " << int64_t(slowest.download * 1e6) << " microseconds" << endl;
+    cout << "  Elapsed:     " << int64_t(slowest.elapsed * 1e6) << " microseconds" << endl;
 
-#ifdef DEBUG
-    cout << endl;
-    cout << "Matrix D: " << endl;
-    cout << matrix_d << endl;
-#endif
-  
-    if (matrix_c == matrix_d) {
-      cout << "OK!" << endl;
-    } else {
-      cout << "Incorrect!" << endl;
-    }
+    // a full reference multiplication would take as long as the cluster did, so the result is
+    // checked using Freivalds' algorithm instead, which only needs matrix-vector products
+    verified = verify(matrix_a, matrix_b, matrix_c, true);
   }
 
   MPI_Finalize();
 
-  return 0;
+  return verified ? 0 : 1;
 }
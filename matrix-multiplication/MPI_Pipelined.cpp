@@ -0,0 +1,324 @@
+// #define DEBUG
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <optional>
+#include <vector>
+
+#include <mpi.h>
+
+#include "Gemm.h"
+#include "MPI_Util.h"
+#include "Matrix.h"
+#include "Verify.h"
+
+using namespace std;
+using namespace std::chrono;
+
+const int DEFAULT_PANEL_COLUMNS = 256;
+
+// while computing, progress is made on outstanding requests after every chunk of this many rows
+const int PROGRESS_ROWS = 64;
+
+// Time spent in each phase by one process, in seconds
+struct Phases
+{
+  double wait_a;
+  double wait_b;
+  double compute;
+  double wait_c;
+};
+
+double seconds_since(high_resolution_clock::time_point start)
+{
+  return duration<double>(high_resolution_clock::now() - start).count();
+}
+
+//
+// Computes this process's rows of C = A * B, one column panel of B at a time.
+//
+// Panels of B are broadcast using MPI_Ibcast, into two alternating buffers, so that the next panel is
+// in flight while the current one is being multiplied. As soon as a panel of C is finished it is sent
+// back to the root node using MPI_Igatherv, straight into its final location in matrix_c.
+//
+// Nothing here blocks until its data is needed, but many MPI implementations only make progress on
+// non-blocking operations from inside MPI calls, so MPI_Test is called periodically while computing.
+//
+template<typename T>
+Phases multiply_matrices(
+    const Matrix<T> &matrix_a,
+    const Matrix<T> &matrix_b,
+    Matrix<T> &matrix_c,
+    int n_a,
+    int n_b,
+    const vector<int> &row_counts,
+    int panel_columns,
+    int host_rank)
+{
+  Phases phases = {};
+  const bool root = host_rank == 0;
+
+  const int rows = row_counts[host_rank];
+  const vector<int> row_offsets = partition_offsets(row_counts);
+
+  // the rows of A that belong to this process
+  Matrix<T> partition_a(rows, n_a);
+
+  // each panel of C is stored contiguously, so that it can be sent while later panels are computed
+  const int panels = (n_b + panel_columns - 1) / panel_columns;
+  vector<T> partition_c(size_t(rows) * n_b);
+
+  // panels of B are received into alternating buffers
+  vector<T> buffers[2];
+  if (!root) {
+    buffers[0].resize(size_t(n_a) * panel_columns);
+    buffers[1].resize(size_t(n_a) * panel_columns);
+  }
+
+  const vector<int> a_counts = scale_partitions(row_counts, n_a);
+  const vector<int> a_offsets = partition_offsets(row_counts, n_a);
+
+  MPI_Request scatter_request;
+  MPI_Iscatterv(
+      matrix_a.data(),              // address of send buffer (root node)
+      a_counts.data(),              // number of elements sent to each process (root node)
+      a_offsets.data(),             // offset of the elements sent to each process (root node)
+      MPI_DOUBLE,                   // data type of send buffer elements (root node)
+      partition_a.data(),           // address of receive buffer
+      rows * n_a,                   // number of elements in receive buffer
+      MPI_DOUBLE,                   // data type of receive buffer elements
+      0,                            // ranking of sending process
+      MPI_COMM_WORLD,               // communicator
+      &scatter_request);            // request
+
+  // the root broadcasts each panel directly out of matrix_b, using a strided data type
+  auto broadcast_panel = [&](int panel, MPI_Request *request) {
+    const int n_offset = panel * panel_columns;
+    const int columns = min(panel_columns, n_b - n_offset);
+    if (root) {
+      MPI_Datatype panel_type;
+      MPI_Type_vector(n_a, columns, n_b, MPI_DOUBLE, &panel_type);
+      MPI_Type_commit(&panel_type);
+      MPI_Ibcast(const_cast<T*>(matrix_b.data()) + n_offset, 1, panel_type, 0, MPI_COMM_WORLD, request);
+      MPI_Type_free(&panel_type);
+    } else {
+      MPI_Ibcast(buffers[panel % 2].data(), n_a * columns, MPI_DOUBLE, 0, MPI_COMM_WORLD, request);
+    }
+  };
+
+  // each process sends one row segment per row, which the root receives into rows of matrix_c
+  auto gather_panel = [&](int panel, const T *source, MPI_Request *request) {
+    const int n_offset = panel * panel_columns;
+    const int columns = min(panel_columns, n_b - n_offset);
+
+    MPI_Datatype row_type = MPI_DATATYPE_NULL;
+    if (root) {
+      MPI_Datatype segment_type;
+      MPI_Type_contiguous(columns, MPI_DOUBLE, &segment_type);
+      MPI_Type_create_resized(segment_type, 0, MPI_Aint(n_b) * sizeof(T), &row_type);
+      MPI_Type_commit(&row_type);
+      MPI_Type_free(&segment_type);
+    }
+
+    MPI_Igatherv(
+        source,                     // starting address of send buffer
+        rows * columns,             // number of elements in send buffer
+        MPI_DOUBLE,                 // data type of send buffer elements
+        matrix_c.data() + n_offset, // starting address of receive buffer (root node)
+        row_counts.data(),          // number of rows received from each process (root node)
+        row_offsets.data(),         // first row received from each process (root node)
+        row_type,                   // data type of one received row (root node)
+        0,                          // ranking of receiving process
+        MPI_COMM_WORLD,             // communicator
+        request);                   // request
+
+    if (root) {
+      MPI_Type_free(&row_type);
+    }
+  };
+
+  MPI_Request panel_requests[2];
+  vector<MPI_Request> gather_requests(panels);
+  broadcast_panel(0, &panel_requests[0]);
+
+  auto start = high_resolution_clock::now();
+  MPI_Wait(&scatter_request, MPI_STATUS_IGNORE);
+  phases.wait_a = seconds_since(start);
+
+  for (int panel = 0; panel < panels; panel++) {
+    const int n_offset = panel * panel_columns;
+    const int columns = min(panel_columns, n_b - n_offset);
+
+    // start receiving the next panel before waiting for this one
+    MPI_Request *next = nullptr;
+    if (panel + 1 < panels) {
+      next = &panel_requests[(panel + 1) % 2];
+      broadcast_panel(panel + 1, next);
+    }
+
+    start = high_resolution_clock::now();
+    MPI_Wait(&panel_requests[panel % 2], MPI_STATUS_IGNORE);
+    phases.wait_b += seconds_since(start);
+
+    const T *b = root ? matrix_b.data() + n_offset : buffers[panel % 2].data();
+    const int ldb = root ? n_b : columns;
+    T *c = partition_c.data() + size_t(rows) * n_offset;
+
+    start = high_resolution_clock::now();
+    for (int m = 0; m < rows; m += PROGRESS_ROWS) {
+      const int chunk = min(PROGRESS_ROWS, rows - m);
+      gemm(chunk, columns, n_a, partition_a.row(m).data(), n_a, b, ldb, c + size_t(m) * columns, columns);
+
+      if (next) {
+        int done;
+        MPI_Test(next, &done, MPI_STATUS_IGNORE);
+        if (done) {
+          next = nullptr;
+        }
+      }
+    }
+    phases.compute += seconds_since(start);
+
+    gather_panel(panel, c, &gather_requests[panel]);
+  }
+
+  start = high_resolution_clock::now();
+  MPI_Waitall(panels, gather_requests.data(), MPI_STATUSES_IGNORE);
+  phases.wait_c = seconds_since(start);
+
+  return phases;
+}
+
+int usage(char **argv)
+{
+  cout << endl;
+  cout << "Usage:" << endl;
+  cout << "  " << argv[0] << " <M1> <N1/M2> <N2> [seed] [panel-columns]" << endl;
+  cout << endl;
+  cout << "Multiples a random M1xN1 matrix by a random M2xN2 matrix, overlapping communication with computation" << endl;
+
+  return 1;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc == 1) {
+    return usage(argv);
+  }
+
+  if (argc < 4 || argc > 6) {
+    cout << "Invalid argument count: " << argc << endl;
+    return usage(argv);
+  }
+
+  int m_a = atoi(argv[1]);
+  if (m_a <= 0) {
+    cout << "Argument <M1> is invalid" << endl;
+    return usage(argv);
+  }
+
+  int n_a = atoi(argv[2]);
+  if (n_a <= 0) {
+    cout << "Argument <N1/M2> is invalid" << endl;
+    return usage(argv);
+  }
+
+  int n_b = atoi(argv[3]);
+  if (n_b <= 0) {
+    cout << "Argument <N2> is invalid" << endl;
+    return usage(argv);
+  }
+
+  int panel_columns = DEFAULT_PANEL_COLUMNS;
+  if (argc == 6) {
+    panel_columns = atoi(argv[5]);
+    if (panel_columns <= 0) {
+      cout << "Argument [panel-columns] is invalid" << endl;
+      return usage(argv);
+    }
+  }
+
+  MPI_Init(NULL, NULL);
+
+  // how many processes are there?
+  int cluster_size;
+  MPI_Comm_size(MPI_COMM_WORLD, &cluster_size);
+
+  // who am I?
+  int host_rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &host_rank);
+
+  // complete matrices are only used on the root node
+  const bool root = host_rank == 0;
+  Matrix<double> matrix_a(root ? m_a : 0, root ? n_a : 0);
+  Matrix<double> matrix_b(root ? n_a : 0, root ? n_b : 0);
+  Matrix<double> matrix_c(root ? m_a : 0, root ? n_b : 0);
+
+  if (root) {
+    cout << "Cluster size: " << cluster_size << endl;
+
+    // parse random seed
+    std::optional<int> seed;
+    if (argc >= 5) {
+      seed = atoi(argv[4]);
+      cout << "Random seeds: " << *seed << ", " << (*seed + 1) << endl;
+    }
+
+    // generate random data on the root node
+    matrix_a.randomise(-100, 100, seed);
+
+    if (seed) {
+      seed = *seed + 1;
+    }
+
+    matrix_b.randomise(-100, 100, seed);
+
+#ifdef DEBUG
+    cout << endl;
+    cout << "Matrix A:" << endl;
+    cout << matrix_a << endl;
+    cout << "Matrix B:" << endl;
+    cout << matrix_b << endl;
+#endif
+  }
+
+  // rows that do not divide evenly between processes are given to the first few
+  const vector<int> row_counts = partition_rows(m_a, cluster_size);
+
+  auto start = high_resolution_clock::now();
+  Phases phases = multiply_matrices(matrix_a, matrix_b, matrix_c, n_a, n_b, row_counts, panel_columns, host_rank);
+  auto stop = high_resolution_clock::now();
+  bool verified = true;
+
+  // the slowest process determines how much of each phase was exposed
+  Phases slowest;
+  MPI_Reduce(&phases, &slowest, 4, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
+  // only display complete results on the root node
+  if (root) {
+#ifdef DEBUG
+    cout << "Matrix C:" << endl;
+    cout << matrix_c << endl;
+#endif
+
+    // how long did it take?
+    auto duration = duration_cast<microseconds>(stop - start);
+    cout << "Duration: " << duration.count() << " microseconds (" << (double(duration.count()) / 1000000.0f) << " seconds)" << endl;
+
+    // time spent waiting is communication that was not hidden behind computation
+    cout << "Phases (slowest process):" << endl;
+    cout << "  Waiting for rows of A:      " << int64_t(slowest.wait_a * 1e6) << " microseconds" << endl;
+    cout << "  Waiting for panels of B:    " << int64_t(slowest.wait_b * 1e6) << " microseconds" << endl;
+    cout << "  Computing:                  " << int64_t(slowest.compute * 1e6) << " microseconds" << endl;
+    cout << "  Waiting for panels of C:    " << int64_t(slowest.wait_c * 1e6) << " microseconds" << endl;
+
+    // check the result, if asked to
+    verified = verify(matrix_a, matrix_b, matrix_c);
+  }
+
+  MPI_Finalize();
+
+  return verified ? 0 : 1;
+}
@@ -0,0 +1,451 @@
+// #define DEBUG
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <mpi.h>
+
+#include "Gemm.h"
+#include "Matrix.h"
+#include "Verify.h"
+
+using namespace std;
+using namespace std::chrono;
+
+const int DEFAULT_BLOCK_SIZE = 256;
+
+//
+// Matrices are distributed over a two dimensional grid of processes, using a block-cyclic layout. Rows
+// are divided into blocks of 'block_size', which are dealt out to the rows of the process grid in
+// round-robin order; columns are dealt out to the columns of the grid in the same way. Each process
+// stores the cells that it owns as one compact local matrix.
+//
+struct Grid
+{
+  int rows;
+  int columns;
+
+  // position of this process
+  int row;
+  int column;
+
+  // processes in the same row, and in the same column, as this process
+  MPI_Comm row_comm;
+  MPI_Comm column_comm;
+
+  int block_size;
+};
+
+// Chooses the most square grid that uses every process
+Grid create_grid(int cluster_size, int host_rank, int block_size)
+{
+  Grid grid;
+  grid.rows = int(sqrt(double(cluster_size)));
+  while (cluster_size % grid.rows != 0) {
+    grid.rows--;
+  }
+  grid.columns = cluster_size / grid.rows;
+
+  grid.row = host_rank / grid.columns;
+  grid.column = host_rank % grid.columns;
+
+  // ranks within the row communicator are grid columns, and vice versa
+  MPI_Comm_split(MPI_COMM_WORLD, grid.row, grid.column, &grid.row_comm);
+  MPI_Comm_split(MPI_COMM_WORLD, grid.column, grid.row, &grid.column_comm);
+
+  grid.block_size = block_size;
+  return grid;
+}
+
+// Number of the indices [0, n) that are owned by process 'index' of 'count'
+int local_count(int n, int block_size, int index, int count)
+{
+  const int blocks = n / block_size;
+  const int extra = blocks % count;
+
+  int local = blocks / count * block_size;
+  if (index < extra) {
+    local += block_size;
+  } else if (index == extra) {
+    local += n % block_size;
+  }
+
+  return local;
+}
+
+// Global index of the local index 'l' on process 'index' of 'count'
+int global_index(int l, int block_size, int index, int count)
+{
+  return (l / block_size * count + index) * block_size + l % block_size;
+}
+
+//
+// Copies the tile of 'matrix' that belongs to each process into 'buffer', in rank order. If 'unpack' is
+// true, the tiles are instead copied from 'buffer' back into 'matrix', after being collected using
+// MPI_Gatherv.
+//
+template<typename T>
+void pack_tiles(Matrix<T> &matrix, const Grid &grid, vector<T> &buffer, vector<int> &counts, vector<int> &offsets, bool unpack)
+{
+  const int cluster_size = grid.rows * grid.columns;
+  counts.resize(cluster_size);
+  offsets.resize(cluster_size);
+  buffer.resize(matrix.size());
+
+  int offset = 0;
+  for (int rank = 0; rank < cluster_size; rank++) {
+    const int row = rank / grid.columns;
+    const int column = rank % grid.columns;
+    const int rows = local_count(matrix.rows(), grid.block_size, row, grid.rows);
+    const int columns = local_count(matrix.columns(), grid.block_size, column, grid.columns);
+
+    counts[rank] = rows * columns;
+    offsets[rank] = offset;
+
+    for (int m = 0; m < rows; m++) {
+      RowView<T> source = matrix.row(global_index(m, grid.block_size, row, grid.rows));
+      for (int n = 0; n < columns; n++) {
+        T &cell = source[global_index(n, grid.block_size, column, grid.columns)];
+        if (unpack) {
+          cell = buffer[offset++];
+        } else {
+          buffer[offset++] = cell;
+        }
+      }
+    }
+  }
+}
+
+// Allocates the local tile of this process, for a rows x columns matrix
+template<typename T>
+Matrix<T> local_tile(int rows, int columns, const Grid &grid)
+{
+  return Matrix<T>(
+      local_count(rows, grid.block_size, grid.row, grid.rows),
+      local_count(columns, grid.block_size, grid.column, grid.columns));
+}
+
+//
+// Fills the local tile of a matrix with random values. Each block of the global matrix has its own
+// random engine, seeded from 'seed' and the position of the block, so every process generates its own
+// tiles without any communication, and the matrix is the same for any number of processes.
+//
+template<typename T>
+void randomise_tiles(Matrix<T> &tile, const Grid &grid, unsigned seed)
+{
+  const int block_size = grid.block_size;
+  uniform_real_distribution<T> dist(-100, 100);
+
+  for (int m0 = 0; m0 < tile.rows(); m0 += block_size) {
+    for (int n0 = 0; n0 < tile.columns(); n0 += block_size) {
+      const int block_row = global_index(m0, block_size, grid.row, grid.rows) / block_size;
+      const int block_column = global_index(n0, block_size, grid.column, grid.columns) / block_size;
+      seed_seq sequence{ seed, unsigned(block_row), unsigned(block_column) };
+      mt19937 engine(sequence);
+
+      TileView<T> block = tile.view().clip(m0, block_size, n0, block_size);
+      for (int m = 0; m < block.rows(); m++) {
+        for (T &value : block.row(m)) {
+          value = dist(engine);
+        }
+      }
+    }
+  }
+}
+
+#ifdef DEBUG
+// Collects the local tiles of a matrix on the root node
+template<typename T>
+void gather_tiles(Matrix<T> &tile, Matrix<T> &matrix, const Grid &grid, int host_rank)
+{
+  vector<T> buffer;
+  vector<int> counts;
+  vector<int> offsets;
+  if (host_rank == 0) {
+    // only the counts and offsets are needed at this point
+    pack_tiles(matrix, grid, buffer, counts, offsets, false);
+  }
+
+  MPI_Gatherv(
+      tile.data(),                  // starting address of send buffer
+      int(tile.size()),             // number of elements in send buffer
+      MPI_DOUBLE,                   // data type of send buffer elements
+      buffer.data(),                // starting address of receive buffer (root node)
+      counts.data(),                // number of elements received from each process (root node)
+      offsets.data(),               // offset of the elements received from each process (root node)
+      MPI_DOUBLE,                   // data type of receive buffer elements (root node)
+      0,                            // ranking of receiving process
+      MPI_COMM_WORLD);              // communicator
+
+  if (host_rank == 0) {
+    pack_tiles(matrix, grid, buffer, counts, offsets, true);
+  }
+}
+
+// Collects a whole matrix on the root node and prints it; this is only done when debugging, since the
+// matrix may not fit in the memory of one node
+template<typename T>
+void print_tiles(const char *name, Matrix<T> &tile, int rows, int columns, const Grid &grid, int host_rank)
+{
+  Matrix<T> matrix(host_rank == 0 ? rows : 0, host_rank == 0 ? columns : 0);
+  gather_tiles(tile, matrix, grid, host_rank);
+
+  if (host_rank == 0) {
+    cout << name << ":" << endl;
+    cout << matrix << endl;
+  }
+}
+#endif
+
+//
+// Computes the local tile of C = A * B using SUMMA (van de Geijn and Watts, 1997).
+//
+// The shared dimension is processed one block at a time. At each step, the processes that own the
+// current block column of A broadcast their part of it along their grid row, and the processes that
+// own the current block row of B broadcast their part of it along their grid column. Every process
+// then has the parts of both panels that it needs to update its tile of C.
+//
+template<typename T>
+void multiply_matrices(const Matrix<T> &tile_a, const Matrix<T> &tile_b, Matrix<T> &tile_c, int n_a, const Grid &grid)
+{
+  // check local tile sizes
+  assert(tile_c.rows() == tile_a.rows());
+  assert(tile_c.columns() == tile_b.columns());
+
+  const int rows = tile_c.rows();
+  const int columns = tile_c.columns();
+  const int block_size = grid.block_size;
+
+  vector<T> panel_a(size_t(rows) * block_size);
+  vector<T> panel_b(size_t(block_size) * columns);
+
+  tile_c.view().fill(0);
+
+  const int steps = (n_a + block_size - 1) / block_size;
+  for (int step = 0; step < steps; step++) {
+    const int width = min(block_size, n_a - step * block_size);
+
+    // block columns of A are dealt out to grid columns, so this is the owner's local column offset
+    const int owner_column = step % grid.columns;
+    if (grid.column == owner_column) {
+      const int n_offset = step / grid.columns * block_size;
+      for (int m = 0; m < rows; m++) {
+        const T *source = tile_a.row(m).data() + n_offset;
+        copy(source, source + width, panel_a.data() + size_t(m) * width);
+      }
+    }
+
+    MPI_Bcast(panel_a.data(), rows * width, MPI_DOUBLE, owner_column, grid.row_comm);
+
+    // rows of a tile are contiguous, so the owner's block row of B can be copied in one go
+    const int owner_row = step % grid.rows;
+    if (grid.row == owner_row) {
+      const T *source = tile_b.data() + size_t(step / grid.rows * block_size) * columns;
+      copy(source, source + size_t(width) * columns, panel_b.data());
+    }
+
+    MPI_Bcast(panel_b.data(), width * columns, MPI_DOUBLE, owner_row, grid.column_comm);
+
+    gemm(rows, columns, width, panel_a.data(), width, panel_b.data(), columns, tile_c.data(), columns, true);
+  }
+}
+
+//
+// Checks the local tiles of C = A * B using Freivalds' algorithm (see Verify.h), without gathering any
+// of the matrices. Every process multiplies its own tiles by the parts of the random vectors that they
+// need, and the partial products, which are only O(n) in size, are summed using MPI_Allreduce. Every
+// process therefore reaches the same conclusion.
+//
+template<typename T>
+bool verify_tiles(const Matrix<T> &tile_a, const Matrix<T> &tile_b, const Matrix<T> &tile_c, int m_a, int n_a, int n_b, const Grid &grid, int rounds, unsigned seed)
+{
+  const int block_size = grid.block_size;
+
+  // copies the rows of a global n x rounds matrix that correspond to local indices
+  auto select_rows = [&](const vector<T> &global, int count, int index, int grid_count) {
+    vector<T> local(size_t(count) * rounds);
+    for (int l = 0; l < count; l++) {
+      const T *source = global.data() + size_t(global_index(l, block_size, index, grid_count)) * rounds;
+      copy(source, source + rounds, local.data() + size_t(l) * rounds);
+    }
+    return local;
+  };
+
+  // the reverse, which leaves the rows owned by other processes as zeros, ready to be summed
+  auto place_rows = [&](const vector<T> &local, int count, int index, int grid_count, int n) {
+    vector<T> global(size_t(n) * rounds);
+    for (int l = 0; l < count; l++) {
+      const T *source = local.data() + size_t(l) * rounds;
+      copy(source, source + rounds, global.data() + size_t(global_index(l, block_size, index, grid_count)) * rounds);
+    }
+    MPI_Allreduce(MPI_IN_PLACE, global.data(), n * rounds, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    return global;
+  };
+
+  // every process generates the same vectors, and uses the rows that match its columns of B and C
+  const vector<T> r = select_rows(freivalds_vectors<T>(n_b, rounds, seed), tile_b.columns(), grid.column, grid.columns);
+
+  vector<T> b_r(size_t(tile_b.rows()) * rounds);
+  vector<T> b_r_abs(size_t(tile_b.rows()) * rounds);
+  multiply_vectors(tile_b.view(), r.data(), r.data(), rounds, b_r.data(), b_r_abs.data());
+  b_r = place_rows(b_r, tile_b.rows(), grid.row, grid.rows, n_a);
+  b_r_abs = place_rows(b_r_abs, tile_b.rows(), grid.row, grid.rows, n_a);
+
+  // rows of B are dealt out to grid rows, but columns of A are dealt out to grid columns
+  const vector<T> x = select_rows(b_r, tile_a.columns(), grid.column, grid.columns);
+  const vector<T> x_abs = select_rows(b_r_abs, tile_a.columns(), grid.column, grid.columns);
+
+  vector<T> ab_r(size_t(tile_a.rows()) * rounds);
+  vector<T> scale(size_t(tile_a.rows()) * rounds);
+  multiply_vectors(tile_a.view(), x.data(), x_abs.data(), rounds, ab_r.data(), scale.data());
+  ab_r = place_rows(ab_r, tile_a.rows(), grid.row, grid.rows, m_a);
+  scale = place_rows(scale, tile_a.rows(), grid.row, grid.rows, m_a);
+
+  vector<T> c_r(size_t(tile_c.rows()) * rounds);
+  multiply_vectors<T>(tile_c.view(), r.data(), nullptr, rounds, c_r.data(), nullptr);
+  c_r = place_rows(c_r, tile_c.rows(), grid.row, grid.rows, m_a);
+
+  return freivalds_compare(ab_r.data(), scale.data(), c_r.data(), m_a, rounds, n_a, n_b);
+}
+
+int usage(char **argv)
+{
+  cout << endl;
+  cout << "Usage:" << endl;
+  cout << "  " << argv[0] << " <M1> <N1/M2> <N2> [seed] [block-size]" << endl;
+  cout << endl;
+  cout << "Multiples a random M1xN1 matrix by a random M2xN2 matrix, on a 2D grid of processes" << endl;
+
+  return 1;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc == 1) {
+    return usage(argv);
+  }
+
+  if (argc < 4 || argc > 6) {
+    cout << "Invalid argument count: " << argc << endl;
+    return usage(argv);
+  }
+
+  int m_a = atoi(argv[1]);
+  if (m_a <= 0) {
+    cout << "Argument <M1> is invalid" << endl;
+    return usage(argv);
+  }
+
+  int n_a = atoi(argv[2]);
+  if (n_a <= 0) {
+    cout << "Argument <N1/M2> is invalid" << endl;
+    return usage(argv);
+  }
+
+  int n_b = atoi(argv[3]);
+  if (n_b <= 0) {
+    cout << "Argument <N2> is invalid" << endl;
+    return usage(argv);
+  }
+
+  int block_size = DEFAULT_BLOCK_SIZE;
+  if (argc == 6) {
+    block_size = atoi(argv[5]);
+    if (block_size <= 0) {
+      cout << "Argument [block-size] is invalid" << endl;
+      return usage(argv);
+    }
+  }
+
+  MPI_Init(NULL, NULL);
+
+  // how many processes are there?
+  int cluster_size;
+  MPI_Comm_size(MPI_COMM_WORLD, &cluster_size);
+
+  // who am I?
+  int host_rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &host_rank);
+
+  Grid grid = create_grid(cluster_size, host_rank, block_size);
+
+  const bool root = host_rank == 0;
+  if (root) {
+    cout << "Cluster size: " << cluster_size << endl;
+    cout << "Process grid: " << grid.rows << "x" << grid.columns << ", block size " << block_size << endl;
+  }
+
+  // parse random seed; without one, the root chooses a seed for every process
+  unsigned seed = 0;
+  if (argc >= 5) {
+    seed = atoi(argv[4]);
+    if (root) {
+      cout << "Random seeds: " << seed << ", " << (seed + 1) << endl;
+    }
+  } else {
+    seed = root ? random_device()() : 0;
+    MPI_Bcast(&seed, 1, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
+  }
+
+  // every process generates its own tiles, so the complete matrices never exist on any one node
+  Matrix<double> tile_a = local_tile<double>(m_a, n_a, grid);
+  Matrix<double> tile_b = local_tile<double>(n_a, n_b, grid);
+  Matrix<double> tile_c = local_tile<double>(m_a, n_b, grid);
+  randomise_tiles(tile_a, grid, seed);
+  randomise_tiles(tile_b, grid, seed + 1);
+
+#ifdef DEBUG
+  print_tiles("Matrix A", tile_a, m_a, n_a, grid, host_rank);
+  print_tiles("Matrix B", tile_b, n_a, n_b, grid, host_rank);
+#endif
+
+  // start together, and stop when the slowest process has finished
+  MPI_Barrier(MPI_COMM_WORLD);
+  auto start = high_resolution_clock::now();
+
+  // do the work
+  multiply_matrices(tile_a, tile_b, tile_c, n_a, grid);
+
+  MPI_Barrier(MPI_COMM_WORLD);
+  auto stop = high_resolution_clock::now();
+
+#ifdef DEBUG
+  print_tiles("Matrix C", tile_c, m_a, n_b, grid, host_rank);
+#endif
+
+  // how long did it take?
+  if (root) {
+    auto duration = duration_cast<microseconds>(stop - start);
+    cout << "Duration: " << duration.count() << " microseconds (" << (double(duration.count()) / 1000000.0f) << " seconds)" << endl;
+  }
+
+  // check the result, if asked to; the environment is only read on the root node, since it is not
+  // always passed on to other nodes
+  double bound = root ? verification_bound().value_or(0) : 0;
+  MPI_Bcast(&bound, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+
+  bool verified = true;
+  if (bound > 0) {
+    auto verify_start = high_resolution_clock::now();
+    unsigned verify_seed = root ? random_device()() : 0;
+    MPI_Bcast(&verify_seed, 1, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
+
+    const int rounds = freivalds_rounds(bound);
+    verified = verify_tiles(tile_a, tile_b, tile_c, m_a, n_a, n_b, grid, rounds, verify_seed);
+    if (root) {
+      print_verification(verified, rounds, bound, verify_start);
+    }
+  }
+
+  MPI_Comm_free(&grid.row_comm);
+  MPI_Comm_free(&grid.column_comm);
+
+  MPI_Finalize();
+
+  return verified ? 0 : 1;
+}
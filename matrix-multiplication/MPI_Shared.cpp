@@ -0,0 +1,233 @@
+// #define DEBUG
+
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <optional>
+#include <vector>
+
+#include <mpi.h>
+
+#include "Gemm.h"
+#include "MPI_Util.h"
+#include "Matrix.h"
+#include "Verify.h"
+
+using namespace std;
+using namespace std::chrono;
+
+int usage(char **argv)
+{
+  cout << endl;
+  cout << "Usage:" << endl;
+  cout << "  " << argv[0] << " <M1> <N1/M2> <N2> [seed]" << endl;
+  cout << endl;
+  cout << "Multiples a random M1xN1 matrix by a random M2xN2 matrix, sharing one copy of M2xN2 per node" << endl;
+
+  return 1;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc == 1) {
+    return usage(argv);
+  }
+
+  if (argc != 4 && argc != 5) {
+    cout << "Invalid argument count: " << argc << endl;
+    return usage(argv);
+  }
+
+  int m_a = atoi(argv[1]);
+  if (m_a <= 0) {
+    cout << "Argument <M1> is invalid" << endl;
+    return usage(argv);
+  }
+
+  int n_a = atoi(argv[2]);
+  if (n_a <= 0) {
+    cout << "Argument <N1/M2> is invalid" << endl;
+    return usage(argv);
+  }
+
+  int n_b = atoi(argv[3]);
+  if (n_b <= 0) {
+    cout << "Argument <N2> is invalid" << endl;
+    return usage(argv);
+  }
+
+  MPI_Init(NULL, NULL);
+
+  // how many processes are there?
+  int cluster_size;
+  MPI_Comm_size(MPI_COMM_WORLD, &cluster_size);
+
+  // who am I?
+  int host_rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &host_rank);
+
+  // processes that can share memory with this one, i.e. that are running on the same node
+  MPI_Comm node_comm;
+  MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, host_rank, MPI_INFO_NULL, &node_comm);
+  int node_rank;
+  MPI_Comm_rank(node_comm, &node_rank);
+
+  // the first process on each node is its leader; the root node is always the leader of its node
+  const bool leader = node_rank == 0;
+  MPI_Comm leader_comm;
+  MPI_Comm_split(MPI_COMM_WORLD, leader ? 0 : MPI_UNDEFINED, host_rank, &leader_comm);
+
+  int node_count = 0;
+  if (leader) {
+    MPI_Comm_size(leader_comm, &node_count);
+  }
+
+  // matrix B lives in a window of memory that is shared by every process on the node, and that is
+  // allocated by the leader
+  double *matrix_b_shared;
+  MPI_Win window;
+  MPI_Win_allocate_shared(
+      leader ? MPI_Aint(n_a) * n_b * sizeof(double) : 0,
+      sizeof(double),
+      MPI_INFO_NULL,
+      node_comm,
+      &matrix_b_shared,
+      &window);
+
+  // every other process needs the address of the leader's part of the window
+  MPI_Aint window_size;
+  int displacement_unit;
+  MPI_Win_shared_query(window, 0, &window_size, &displacement_unit, &matrix_b_shared);
+
+  // the window is only accessed using loads and stores, so a passive epoch is held throughout
+  MPI_Win_lock_all(MPI_MODE_NOCHECK, window);
+
+  // on the root node, B is generated and verified in place, so the node never holds a second copy
+  const TileView<double> matrix_b(matrix_b_shared, n_a, n_b, n_b);
+
+  // matrices that are only used on the root node
+  const bool root = host_rank == 0;
+  Matrix<double> matrix_a(root ? m_a : 0, root ? n_a : 0);
+  Matrix<double> matrix_c(root ? m_a : 0, root ? n_b : 0);
+
+  if (root) {
+    cout << "Cluster size: " << cluster_size << endl;
+    cout << "Nodes: " << node_count << " (one copy of matrix B per node)" << endl;
+
+    // parse random seed
+    std::optional<int> seed;
+    if (argc == 5) {
+      seed = atoi(argv[4]);
+      cout << "Random seeds: " << *seed << ", " << (*seed + 1) << endl;
+    }
+
+    // generate random data on the root node
+    matrix_a.randomise(-100, 100, seed);
+
+    if (seed) {
+      seed = *seed + 1;
+    }
+
+    randomise(matrix_b, -100.0, 100.0, seed);
+
+#ifdef DEBUG
+    cout << endl;
+    cout << "Matrix A:" << endl;
+    cout << matrix_a << endl;
+    cout << "Matrix B:" << endl;
+    cout << matrix_b << endl;
+#endif
+  }
+
+  const vector<int> row_counts = partition_rows(m_a, cluster_size);
+  const vector<int> a_counts = scale_partitions(row_counts, n_a);
+  const vector<int> a_offsets = partition_offsets(row_counts, n_a);
+  const vector<int> c_counts = scale_partitions(row_counts, n_b);
+  const vector<int> c_offsets = partition_offsets(row_counts, n_b);
+
+  Matrix<double> matrix_a_partition(row_counts[host_rank], n_a);
+  Matrix<double> matrix_c_partition(row_counts[host_rank], n_b);
+
+  auto start = high_resolution_clock::now();
+
+  // processes only need a subset of rows from matrix A, corresponding to their output rows
+  MPI_Scatterv(
+      matrix_a.data(),              // address of send buffer (root node)
+      a_counts.data(),              // number of elements sent to each process (root node)
+      a_offsets.data(),             // offset of the elements sent to each process (root node)
+      MPI_DOUBLE,                   // data type of send buffer elements (root node)
+      matrix_a_partition.data(),    // address of receive buffer
+      a_counts[host_rank],          // number of elements in receive buffer
+      MPI_DOUBLE,                   // data type of receive buffer elements
+      0,                            // ranking of sending process
+      MPI_COMM_WORLD);              // communicator
+
+  // matrix B only needs to be sent to one process per node, straight into the shared window
+  if (leader) {
+    MPI_Bcast(
+        matrix_b_shared,            // starting address of buffer
+        n_a * n_b,                  // number of entries in buffer
+        MPI_DOUBLE,                 // data type of buffer
+        0,                          // rank of broadcast root
+        leader_comm);               // communicator
+  }
+
+  // make the leader's writes visible to the other processes on the node before they read B
+  MPI_Win_sync(window);
+  MPI_Barrier(node_comm);
+  MPI_Win_sync(window);
+
+  // do the work, reading B in place
+  gemm(
+      row_counts[host_rank],
+      n_b,
+      n_a,
+      matrix_a_partition.data(),
+      n_a,
+      static_cast<const double*>(matrix_b_shared),
+      n_b,
+      matrix_c_partition.data(),
+      n_b);
+
+  // gather the results
+  MPI_Gatherv(
+      matrix_c_partition.data(),    // starting address of send buffer
+      c_counts[host_rank],          // number of elements in send buffer
+      MPI_DOUBLE,                   // data type of send buffer elements
+      matrix_c.data(),              // starting address of receive buffer (root node)
+      c_counts.data(),              // number of elements received from each process (root node)
+      c_offsets.data(),             // offset of the elements received from each process (root node)
+      MPI_DOUBLE,                   // data type of receive buffer elements (root node)
+      0,                            // ranking of receiving process
+      MPI_COMM_WORLD);              // communicator
+
+  auto stop = high_resolution_clock::now();
+  bool verified = true;
+
+  // only display complete results on the root node
+  if (root) {
+#ifdef DEBUG
+    cout << "Matrix C:" << endl;
+    cout << matrix_c << endl;
+#endif
+
+    // how long did it take?
+    auto duration = duration_cast<microseconds>(stop - start);
+    cout << "Duration: " << duration.count() << " microseconds (" << (double(duration.count()) / 1000000.0f) << " seconds)" << endl;
+
+    // check the result, if asked to
+    verified = verify<double>(matrix_a.view(), matrix_b, matrix_c.view());
+  }
+
+  MPI_Win_unlock_all(window);
+  MPI_Win_free(&window);
+
+  if (leader) {
+    MPI_Comm_free(&leader_comm);
+  }
+  MPI_Comm_free(&node_comm);
+
+  MPI_Finalize();
+
+  return verified ? 0 : 1;
+}
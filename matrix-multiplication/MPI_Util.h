@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+#include <mpi.h>
+
+// Divides 'rows' between 'parts' processes as evenly as possible; the first (rows % parts) get one extra
+inline std::vector<int> partition_rows(int rows, int parts)
+{
+  std::vector<int> counts(parts, rows / parts);
+  for (int i = 0; i < rows % parts; i++) {
+    counts[i]++;
+  }
+
+  return counts;
+}
+
+// Divides 'rows' between processes in proportion to their weights, e.g. their measured throughput
+inline std::vector<int> partition_rows(int rows, const std::vector<double> &weights)
+{
+  const double total = std::accumulate(weights.begin(), weights.end(), 0.0);
+  if (!(total > 0)) {
+    return partition_rows(rows, int(weights.size()));
+  }
+
+  // round each share down, then give the leftover rows to the largest remainders
+  std::vector<int> counts(weights.size());
+  std::vector<double> remainders(weights.size());
+  int assigned = 0;
+  for (size_t i = 0; i < weights.size(); i++) {
+    const double share = rows * std::max(weights[i], 0.0) / total;
+    counts[i] = int(std::floor(share));
+    remainders[i] = share - counts[i];
+    assigned += counts[i];
+  }
+
+  std::vector<size_t> order(weights.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return remainders[a] > remainders[b]; });
+  for (int i = 0; assigned < rows; i++, assigned++) {
+    counts[order[i % order.size()]]++;
+  }
+
+  return counts;
+}
+
+//
+// Divides 'rows' between the processes in 'comm' in proportion to their speed, so that slower nodes do
+// not hold up the rest of the job. Every process must call this. Each one times sample(),
+// which should do the same work as computing sample_rows rows of the real problem, and the measured
+// throughputs are shared so that all processes arrive at the same partition.
+//
+template<typename F>
+std::vector<int> calibrate_rows(int rows, int sample_rows, F sample, MPI_Comm comm)
+{
+  // the first run may include one-off costs, such as initialising a device, so the faster run is used
+  double best = std::numeric_limits<double>::infinity();
+  for (int run = 0; run < 2; run++) {
+    auto start = std::chrono::high_resolution_clock::now();
+    sample();
+    best = std::min(best, std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count());
+  }
+
+  double throughput = sample_rows / std::max(best, 1e-9);
+
+  int size;
+  MPI_Comm_size(comm, &size);
+  std::vector<double> throughputs(size);
+  MPI_Allgather(&throughput, 1, MPI_DOUBLE, throughputs.data(), 1, MPI_DOUBLE, comm);
+
+  return partition_rows(rows, throughputs);
+}
+
+// Returns the offset of each partition, given the size of each, e.g. for use as displacements in MPI_Scatterv
+inline std::vector<int> partition_offsets(const std::vector<int> &counts, int scale = 1)
+{
+  std::vector<int> offsets(counts.size());
+  int offset = 0;
+  for (size_t i = 0; i < counts.size(); i++) {
+    offsets[i] = offset;
+    offset += counts[i] * scale;
+  }
+
+  return offsets;
+}
+
+// Multiplies each partition size by 'scale', e.g. to convert a number of rows into a number of elements
+inline std::vector<int> scale_partitions(const std::vector<int> &counts, int scale)
+{
+  std::vector<int> scaled(counts);
+  for (auto &count : scaled) {
+    count *= scale;
+  }
+
+  return scaled;
+}
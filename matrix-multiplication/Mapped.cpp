@@ -0,0 +1,142 @@
+// #define DEBUG
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <optional>
+
+#include "Gemm.h"
+#include "MappedMatrix.h"
+#include "Matrix.h"
+#include "Verify.h"
+
+using namespace std;
+using namespace std::chrono;
+
+int usage(char **argv)
+{
+  cout << endl;
+  cout << "Usage:" << endl;
+  cout << "  " << argv[0] << " generate <file> <rows> <columns> [seed]" << endl;
+  cout << "  " << argv[0] << " multiply <file-a> <file-b> <file-c>" << endl;
+  cout << endl;
+  cout << "Generates a random matrix file, or multiplies the matrices in two files and writes the result to a third" << endl;
+
+  return 1;
+}
+
+int generate(int argc, char **argv)
+{
+  if (argc != 5 && argc != 6) {
+    cout << "Invalid argument count: " << argc << endl;
+    return usage(argv);
+  }
+
+  int rows = atoi(argv[3]);
+  if (rows <= 0) {
+    cout << "Argument <rows> is invalid" << endl;
+    return usage(argv);
+  }
+
+  int columns = atoi(argv[4]);
+  if (columns <= 0) {
+    cout << "Argument <columns> is invalid" << endl;
+    return usage(argv);
+  }
+
+  optional<int> seed;
+  if (argc == 6) {
+    seed = atoi(argv[5]);
+    cout << "Random seed: " << *seed << endl;
+  }
+
+  auto matrix = MappedMatrix<double>::create(argv[2], rows, columns);
+  randomise(matrix.view(), -100.0, 100.0, seed);
+  matrix.commit();
+
+  return 0;
+}
+
+int multiply(int argc, char **argv)
+{
+  if (argc != 5) {
+    cout << "Invalid argument count: " << argc << endl;
+    return usage(argv);
+  }
+
+  // mapping the inputs does not read them, so this is independent of their size
+  auto start = high_resolution_clock::now();
+  const auto matrix_a = MappedMatrix<double>::open(argv[2]);
+  const auto matrix_b = MappedMatrix<double>::open(argv[3]);
+  auto load = high_resolution_clock::now();
+
+  if (matrix_a.columns() != matrix_b.rows()) {
+    cout << "Matrix dimensions do not match: " << matrix_a.rows() << "x" << matrix_a.columns() << " and "
+         << matrix_b.rows() << "x" << matrix_b.columns() << endl;
+    return 1;
+  }
+
+  const int m_a = matrix_a.rows();
+  const int n_a = matrix_a.columns();
+  const int n_b = matrix_b.columns();
+
+#ifdef DEBUG
+  cout << "Matrix A:" << endl;
+  cout << matrix_a.view() << endl;
+  cout << "Matrix B:" << endl;
+  cout << matrix_b.view() << endl;
+#endif
+
+  // the output is written straight into a mapped file, which only replaces <file-c> once it is complete,
+  // so <file-c> may also be one of the inputs
+  auto matrix_c = MappedMatrix<double>::create(argv[4], m_a, n_b);
+
+  // do the work
+  auto multiply_start = high_resolution_clock::now();
+  gemm(matrix_a.view(), matrix_b.view(), matrix_c.view());
+  auto stop = high_resolution_clock::now();
+
+  matrix_c.commit();
+
+#ifdef DEBUG
+  cout << "Matrix C:" << endl;
+  cout << matrix_c.view();
+#endif
+
+  // how long did it take?
+  auto load_duration = duration_cast<microseconds>(load - start);
+  cout << "Load: " << load_duration.count() << " microseconds" << endl;
+
+  auto duration = duration_cast<microseconds>(stop - multiply_start);
+  cout << "Duration: " << duration.count() << " microseconds (" << (double(duration.count()) / 1000000.0f) << " seconds)" << endl;
+
+  // how fast was it?
+  const double flops = 2.0 * m_a * n_a * n_b;
+  cout << "Throughput: " << (flops / max<double>(duration.count(), 1) / 1000.0) << " GFLOP/s (" << gemm_kernel<double>().name << " micro-kernel)" << endl;
+
+  // check the result, if asked to
+  if (!verify<double>(matrix_a.view(), matrix_b.view(), matrix_c.view())) {
+    return 1;
+  }
+
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 3) {
+    return usage(argv);
+  }
+
+  if (strcmp(argv[1], "generate") == 0) {
+    return generate(argc, argv);
+  }
+
+  if (strcmp(argv[1], "multiply") == 0) {
+    return multiply(argc, argv);
+  }
+
+  cout << "Unknown command: " << argv[1] << endl;
+  return usage(argv);
+}
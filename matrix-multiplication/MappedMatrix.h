@@ -0,0 +1,286 @@
+#pragma once
+
+#include <cassert>
+#include <climits>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "View.h"
+
+//
+// A binary file format for matrices, which can be memory-mapped instead of being parsed.
+//
+// The file begins with a fixed-size header, which is followed by the elements of the matrix. Elements
+// are stored in host byte order, with 'stride' elements between the start of each row, and begin at
+// 'data_offset', which is a multiple of 'alignment'. Because the elements are stored exactly as they
+// are laid out in memory, opening a file takes O(1) time regardless of its size; pages are read from
+// disk by the operating system on first access.
+//
+
+enum class MatrixFileType : uint32_t
+{
+  Float32 = 1,
+  Float64 = 2
+};
+
+enum class MatrixFileLayout : uint32_t
+{
+  RowMajor = 0,
+  ColumnMajor = 1
+};
+
+struct MatrixFileHeader
+{
+  // "MATRIX" followed by a format version
+  char magic[8];
+
+  MatrixFileType type;
+  MatrixFileLayout layout;
+
+  uint64_t alignment;
+  uint64_t data_offset;
+
+  uint64_t rows;
+  uint64_t columns;
+  uint64_t stride;
+
+  uint64_t reserved;
+};
+
+static_assert(sizeof(MatrixFileHeader) == 64, "MatrixFileHeader must be 64 bytes");
+
+template<typename T>
+struct MatrixFileTypeOf;
+
+template<>
+struct MatrixFileTypeOf<float>
+{
+  static constexpr MatrixFileType value = MatrixFileType::Float32;
+};
+
+template<>
+struct MatrixFileTypeOf<double>
+{
+  static constexpr MatrixFileType value = MatrixFileType::Float64;
+};
+
+//
+// A matrix file, mapped into memory. Use open() to map an existing file read-only, or create() to
+// create a new file that can be written through view().
+//
+template<typename T>
+class MappedMatrix
+{
+public:
+  static constexpr char magic[8] = { 'M', 'A', 'T', 'R', 'I', 'X', '0', '1' };
+
+  // the default alignment is a page, which is more than sufficient for SIMD loads
+  static constexpr size_t default_alignment = 4096;
+
+  static MappedMatrix open(const char *filename)
+  {
+    const int fd = ::open(filename, O_RDONLY);
+    if (fd < 0) {
+      fail(filename, "Failed to open file");
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(MatrixFileHeader)) {
+      fail(filename, "File is too small to be a matrix");
+    }
+
+    MatrixFileHeader header;
+    if (pread(fd, &header, sizeof(header), 0) != ssize_t(sizeof(header))) {
+      fail(filename, "Failed to read header");
+    }
+
+    if (std::memcmp(header.magic, magic, sizeof(magic)) != 0) {
+      fail(filename, "Not a matrix file");
+    }
+    if (header.type != MatrixFileTypeOf<T>::value) {
+      fail(filename, "Element type does not match");
+    }
+    if (header.layout != MatrixFileLayout::RowMajor) {
+      fail(filename, "Only row-major matrices are supported");
+    }
+    if (header.rows > INT_MAX || header.columns > INT_MAX || header.stride > INT_MAX || header.stride < header.columns) {
+      fail(filename, "Invalid dimensions");
+    }
+    if (header.alignment == 0 || header.data_offset % header.alignment != 0 || header.data_offset % alignof(T) != 0) {
+      fail(filename, "Invalid alignment");
+    }
+    if (header.data_offset < sizeof(MatrixFileHeader)) {
+      fail(filename, "Data overlaps the header");
+    }
+
+    // the header cannot be trusted, so the size of the matrix must not be allowed to overflow
+    size_t bytes = 0;
+    if (__builtin_mul_overflow(size_t(header.rows), size_t(header.stride), &bytes)
+        || __builtin_mul_overflow(bytes, sizeof(T), &bytes)
+        || __builtin_add_overflow(bytes, size_t(header.data_offset), &bytes)) {
+      fail(filename, "Invalid dimensions");
+    }
+    if (size_t(info.st_size) < bytes) {
+      fail(filename, "File is truncated");
+    }
+
+    // the mapping remains valid after the file is closed
+    void *address = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (address == MAP_FAILED) {
+      fail(filename, "Failed to map file");
+    }
+
+    return MappedMatrix(address, bytes, header, false);
+  }
+
+  //
+  // Creates a file with space for a rows x columns matrix, and maps it for writing. The matrix is written
+  // to a temporary file in the same directory, which only replaces 'filename' when commit() is called.
+  // An existing file of that name, which may be mapped as one of the inputs, is therefore never modified;
+  // it is replaced as a whole, and existing mappings keep the original contents. If the matrix is
+  // destroyed without being committed, the temporary file is removed.
+  //
+  static MappedMatrix create(const char *filename, int rows, int columns, size_t alignment = default_alignment)
+  {
+    MatrixFileHeader header = {};
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.type = MatrixFileTypeOf<T>::value;
+    header.layout = MatrixFileLayout::RowMajor;
+    header.alignment = alignment;
+    header.data_offset = (sizeof(MatrixFileHeader) + alignment - 1) / alignment * alignment;
+    header.rows = rows;
+    header.columns = columns;
+    header.stride = columns;
+
+    std::string temporary = std::string(filename) + ".XXXXXX";
+    const int fd = mkstemp(temporary.data());
+    if (fd < 0) {
+      fail(filename, "Failed to create file");
+    }
+
+    // the temporary file is removed before exiting if it cannot be set up
+    auto fail_temporary = [&](const char *message) {
+      unlink(temporary.c_str());
+      fail(filename, message);
+    };
+
+    if (fchmod(fd, 0644) != 0) {
+      fail_temporary("Failed to create file");
+    }
+
+    // the file is sparse until the matrix is written
+    const size_t bytes = header.data_offset + size_t(rows) * columns * sizeof(T);
+    if (ftruncate(fd, off_t(bytes)) != 0) {
+      fail_temporary("Failed to resize file");
+    }
+
+    void *address = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (address == MAP_FAILED) {
+      fail_temporary("Failed to map file");
+    }
+
+    std::memcpy(address, &header, sizeof(header));
+    MappedMatrix matrix(address, bytes, header, true);
+    matrix.m_filename = filename;
+    matrix.m_temporary = std::move(temporary);
+    return matrix;
+  }
+
+  MappedMatrix(MappedMatrix &&other) noexcept
+    : m_address(std::exchange(other.m_address, nullptr))
+    , m_bytes(std::exchange(other.m_bytes, 0))
+    , m_header(other.m_header)
+    , m_writable(other.m_writable)
+    , m_filename(std::move(other.m_filename))
+    , m_temporary(std::exchange(other.m_temporary, {}))
+  {
+  }
+
+  ~MappedMatrix()
+  {
+    if (m_address) {
+      munmap(m_address, m_bytes);
+    }
+    if (!m_temporary.empty()) {
+      unlink(m_temporary.c_str());
+    }
+  }
+
+  // Replaces the file named when the matrix was created with the matrix that has been written
+  void commit()
+  {
+    assert(m_writable && !m_temporary.empty());
+    if (std::rename(m_temporary.c_str(), m_filename.c_str()) != 0) {
+      fail(m_filename.c_str(), "Failed to replace file");
+    }
+    m_temporary.clear();
+  }
+
+  MappedMatrix(const MappedMatrix&) = delete;
+  MappedMatrix& operator=(const MappedMatrix&) = delete;
+  MappedMatrix& operator=(MappedMatrix&&) = delete;
+
+  int columns() const
+  {
+    return int(m_header.columns);
+  }
+
+  int rows() const
+  {
+    return int(m_header.rows);
+  }
+
+  // Only valid for files that were created, rather than opened
+  TileView<T> view()
+  {
+    assert(m_writable);
+    return { data(), rows(), columns(), int(m_header.stride) };
+  }
+
+  TileView<const T> view() const
+  {
+    return { data(), rows(), columns(), int(m_header.stride) };
+  }
+
+private:
+  MappedMatrix(void *address, size_t bytes, const MatrixFileHeader &header, bool writable)
+    : m_address(address)
+    , m_bytes(bytes)
+    , m_header(header)
+    , m_writable(writable)
+  {
+  }
+
+  T* data() const
+  {
+    return reinterpret_cast<T*>(static_cast<char*>(m_address) + m_header.data_offset);
+  }
+
+  [[noreturn]] static void fail(const char *filename, const char *message)
+  {
+    std::cerr << message << ": '" << filename << "'" << std::endl;
+    exit(1);
+  }
+
+  void *m_address;
+  size_t m_bytes;
+  MatrixFileHeader m_header;
+  bool m_writable;
+
+  // for created files, the file to replace, and the temporary file until it has been committed
+  std::string m_filename;
+  std::string m_temporary;
+};
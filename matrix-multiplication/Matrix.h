@@ -1,24 +1,109 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
 #include <cstdlib>
 #include <iostream>
+#include <new>
 #include <optional>
 #include <random>
+#include <type_traits>
+#include <utility>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#include "View.h"
+
+// Fills a view with random values; a matrix and a view of the same size get the same values for the same seed
+template<typename T>
+void randomise(TileView<T> matrix, T min, T max, std::optional<int> seed = {})
+{
+  std::uniform_real_distribution<T> dist(min, max);
+  std::mt19937 engine;
+  if (seed) {
+    engine.seed(*seed);
+  } else {
+    std::random_device rd;
+    engine.seed(rd());
+  }
+
+  for (int m = 0; m < matrix.rows(); m++) {
+    for (T &value : matrix.row(m)) {
+      value = dist(engine);
+    }
+  }
+}
+
+// How the storage for a Matrix<T> is allocated
+enum class MatrixAllocation
+{
+  // Aligned to a cache line, which is also sufficient for SIMD loads
+  Default,
+
+  // Aligned to a huge page boundary and, on Linux, marked as a candidate for transparent huge pages.
+  // This reduces TLB misses when multiplying large matrices.
+  HugePages
+};
 
 template<typename T>
 class Matrix
 {
+  // storage is allocated without running constructors
+  static_assert(std::is_trivially_copyable_v<T>, "Matrix<T> requires a trivially copyable element type");
+
 public:
-  Matrix(int rows, int columns)
+  static constexpr size_t alignment = 64;
+  static constexpr size_t huge_page_size = 2 * 1024 * 1024;
+
+  Matrix(int rows, int columns, MatrixAllocation allocation = MatrixAllocation::Default)
     : m_rows(rows)
     , m_columns(columns)
+    , m_allocation(allocation)
   {
-    m_values = new T[rows * columns];
+    m_values = allocate(size_t(rows) * columns, allocation);
+  }
+
+  // Copies are expensive for large matrices, so they must be made explicitly
+  explicit Matrix(const Matrix &other)
+    : Matrix(other.m_rows, other.m_columns, other.m_allocation)
+  {
+    std::copy(other.m_values, other.m_values + size(), m_values);
+  }
+
+  // Moving a matrix transfers ownership of its storage, leaving an empty 0x0 matrix behind
+  Matrix(Matrix &&other) noexcept
+    : m_rows(std::exchange(other.m_rows, 0))
+    , m_columns(std::exchange(other.m_columns, 0))
+    , m_allocation(other.m_allocation)
+    , m_values(std::exchange(other.m_values, nullptr))
+  {
+  }
+
+  Matrix& operator=(const Matrix &other)
+  {
+    if (this != &other) {
+      Matrix copy(other);
+      *this = std::move(copy);
+    }
+
+    return *this;
+  }
+
+  Matrix& operator=(Matrix &&other) noexcept
+  {
+    std::swap(m_rows, other.m_rows);
+    std::swap(m_columns, other.m_columns);
+    std::swap(m_allocation, other.m_allocation);
+    std::swap(m_values, other.m_values);
+    return *this;
   }
 
   ~Matrix()
   {
-    delete[] m_values;
+    std::free(m_values);
   }
 
   int columns() const
@@ -31,10 +116,16 @@ public:
     return m_values;
   }
 
+  const T* data() const
+  {
+    return m_values;
+  }
+
+  // Bounds checked; cells outside of the matrix are treated as zero
   T get(int row, int column) const
   {
     if (row < m_rows && column < m_columns) {
-      return m_values[row * m_columns + column];
+      return m_values[size_t(row) * m_columns + column];
     } else {
       return 0;
     }
@@ -42,20 +133,7 @@ public:
 
   void randomise(T min, T max, int m, int n, std::optional<int> seed = {})
   {
-    std::uniform_real_distribution<T> dist(min, max);
-    std::mt19937 engine;
-    if (seed) {
-      engine.seed(*seed);
-    } else {
-      std::random_device rd;
-      engine.seed(rd());
-    }
-
-    for (int i = 0; i < m; i++) {
-      for (int j = 0; j < n; j++) {
-        m_values[i * m_columns + j] = dist(engine);
-      }
-    }
+    ::randomise(view().tile(0, m, 0, n), min, max, seed);
   }
 
   void randomise(T min, T max, std::optional<int> seed = {})
@@ -63,6 +141,16 @@ public:
     randomise(min, max, m_rows, m_columns, seed);
   }
 
+  RowView<T> row(int m)
+  {
+    return view().row(m);
+  }
+
+  RowView<const T> row(int m) const
+  {
+    return view().row(m);
+  }
+
   int rows() const
   {
     return m_rows;
@@ -70,7 +158,22 @@ public:
 
   void set(int row, int column, T value)
   {
-    m_values[row * m_columns + column] = value;
+    m_values[size_t(row) * m_columns + column] = value;
+  }
+
+  size_t size() const
+  {
+    return size_t(m_rows) * m_columns;
+  }
+
+  TileView<T> view()
+  {
+    return { m_values, m_rows, m_columns, m_columns };
+  }
+
+  TileView<const T> view() const
+  {
+    return { m_values, m_rows, m_columns, m_columns };
   }
 
   bool operator==(const Matrix &rhs)
@@ -79,11 +182,9 @@ public:
       return false;
     }
 
-    for (int i = 0; i < m_rows; i++) {
-      for (int j = 0; j < m_columns; j++) {
-        if (abs(m_values[i * m_columns + j] - rhs.m_values[i * m_columns + j]) > 0.0001) {
-          return false;
-        }
+    for (size_t i = 0; i < size(); i++) {
+      if (std::abs(m_values[i] - rhs.m_values[i]) > 0.0001) {
+        return false;
       }
     }
 
@@ -91,9 +192,33 @@ public:
   }
 
 private:
+  static T* allocate(size_t count, MatrixAllocation allocation)
+  {
+    const size_t boundary = allocation == MatrixAllocation::HugePages ? huge_page_size : alignment;
+
+    // aligned_alloc requires the size to be a multiple of the alignment
+    const size_t bytes = std::max(count * sizeof(T), size_t(1));
+    const size_t rounded = (bytes + boundary - 1) / boundary * boundary;
+
+    void *ptr = std::aligned_alloc(boundary, rounded);
+    if (!ptr) {
+      throw std::bad_alloc();
+    }
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    if (allocation == MatrixAllocation::HugePages) {
+      // this is only advice, so failure is not an error
+      madvise(ptr, rounded, MADV_HUGEPAGE);
+    }
+#endif
+
+    return static_cast<T*>(ptr);
+  }
+
   int m_rows;
   int m_columns;
 
+  MatrixAllocation m_allocation;
   T* m_values;
 };
 
@@ -109,3 +234,16 @@ std::ostream& operator<<(std::ostream &os, const Matrix<T> &matrix)
 
   return os;
 }
+
+template<typename T>
+std::ostream& operator<<(std::ostream &os, TileView<T> matrix)
+{
+  for (int m = 0; m < matrix.rows(); m++) {
+    for (T value : matrix.row(m)) {
+      os << value << " ";
+    }
+    os << std::endl;
+  }
+
+  return os;
+}
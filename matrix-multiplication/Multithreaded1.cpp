@@ -7,6 +7,7 @@
 #include <vector>
 
 #include "Matrix.h"
+#include "Verify.h"
 
 using namespace std;
 using namespace std::chrono;
@@ -30,14 +31,17 @@ void work(Task<T> task)
 {
   const auto n_a = task.matrix_a.columns();
 
+  RowView<const T> row_a = task.matrix_a.row(task.m);
+  TileView<const T> matrix_b = task.matrix_b.view();
+
   // find value of cell [m,n]
   T sum = 0;
   for (int i = 0; i < n_a; i++) {
-    sum += task.matrix_a.get(task.m, i) * task.matrix_b.get(i, task.n);
+    sum += row_a[i] * matrix_b(i, task.n);
   }
 
   // store value
-  task.matrix_c.set(task.m, task.n, sum);
+  task.matrix_c.row(task.m)[task.n] = sum;
 }
 
 template<typename T>
@@ -163,5 +167,10 @@ int main(int argc, char **argv)
   auto duration = duration_cast<microseconds>(stop - start);
   cout << "Duration: " << duration.count() << " microseconds (" << (double(duration.count()) / 1000000.0f) << " seconds)" << endl;
 
+  // check the result, if asked to
+  if (!verify(matrix_a, matrix_b, matrix_c)) {
+    return 1;
+  }
+
   return 0;
 }
@@ -7,6 +7,7 @@
 #include <vector>
 
 #include "Matrix.h"
+#include "Verify.h"
 
 using namespace std;
 using namespace std::chrono;
@@ -29,17 +30,21 @@ template<typename T>
 void work(Task<T> task)
 {
   const auto n_a = task.matrix_a.columns();
+  TileView<const T> matrix_b = task.matrix_b.view();
 
   for (int m = task.m_begin; m < task.m_end; m++) {
-    for (int n = 0; n < task.matrix_c.columns(); n++) {
+    RowView<const T> row_a = task.matrix_a.row(m);
+    RowView<T> row_c = task.matrix_c.row(m);
+
+    for (int n = 0; n < row_c.size(); n++) {
       // find value of cell [m,n]
       T sum = 0;
       for (int i = 0; i < n_a; i++) {
-        sum += task.matrix_a.get(m, i) * task.matrix_b.get(i, n);
+        sum += row_a[i] * matrix_b(i, n);
       }
 
       // store value
-      task.matrix_c.set(m, n, sum);
+      row_c[n] = sum;
     }
   }
 }
@@ -65,7 +70,7 @@ void multiply_matrices(const Matrix<T> &matrix_a, const Matrix<T> &matrix_b, Mat
   for (int m_begin = 0; m_begin < m_a; m_begin += rows_per_thread) {
 
     // ensure work fragments do not fall outside input domain
-    const int m_end = min(n_a, m_begin + rows_per_thread);
+    const int m_end = min(m_a, m_begin + rows_per_thread);
 
     // describe work to be done
     Task<T> task = {
@@ -175,5 +180,10 @@ int main(int argc, char **argv)
   auto duration = duration_cast<microseconds>(stop - start);
   cout << "Duration: " << duration.count() << " microseconds (" << (double(duration.count()) / 1000000.0f) << " seconds)" << endl;
 
+  // check the result, if asked to
+  if (!verify(matrix_a, matrix_b, matrix_c)) {
+    return 1;
+  }
+
   return 0;
 }
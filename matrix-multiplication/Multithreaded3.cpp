@@ -0,0 +1,188 @@
+// #define DEBUG
+// #define PIN_THREADS
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "Gemm.h"
+#include "Matrix.h"
+#include "Verify.h"
+#include "WorkStealingPool.h"
+
+using namespace std;
+using namespace std::chrono;
+
+template<typename T>
+void multiply_matrices(const Matrix<T> &matrix_a, const Matrix<T> &matrix_b, Matrix<T> &matrix_c, int rows_per_task, WorkStealingPool &pool)
+{
+  // check input matrix sizes
+  const auto n_a = matrix_a.columns();
+  const auto m_b = matrix_b.rows();
+  assert(matrix_a.columns() == matrix_b.rows());
+
+  // check output matrix size
+  const auto m_a = matrix_a.rows();
+  const auto n_b = matrix_b.columns();
+  assert(matrix_c.rows() == matrix_a.rows());
+  assert(matrix_c.columns() == matrix_b.columns());
+
+  // tasks belonging to this product, so that other users of the pool are not waited for
+  WorkStealingPool::Group group;
+
+  // fill output matrix
+  for (int m_begin = 0; m_begin < m_a; m_begin += rows_per_task) {
+
+    // ensure work fragments do not fall outside input domain
+    const int m_end = min(m_a, m_begin + rows_per_task);
+
+    // hand the rows to an existing worker thread
+    pool.submit(group, [&matrix_a, &matrix_b, &matrix_c, m_begin, m_end]() {
+      gemm(matrix_a, matrix_b, matrix_c, m_begin, m_end);
+    });
+  }
+
+  // wait for this product's tasks to finish
+  pool.wait(group);
+}
+
+int usage(char **argv)
+{
+  cout << endl;
+  cout << "Usage:" << endl;
+  cout << "  " << argv[0] << " <M1> <N1/M2> <N2> <rows-per-task> <num-threads> [iterations] [seed]" << endl;
+  cout << endl;
+  cout << "Multiplies a random M1xN1 matrix by a random M2xN2 matrix, [iterations] times" << endl;
+
+  return 1;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc == 1) {
+    return usage(argv);
+  }
+
+  if (argc < 6 || argc > 8) {
+    cout << "Invalid argument count: " << argc << endl;
+    return usage(argv);
+  }
+
+  int m_a = atoi(argv[1]);
+  if (m_a <= 0) {
+    cout << "Argument <M1> is invalid" << endl;
+    return usage(argv);
+  }
+
+  int n_a = atoi(argv[2]);
+  if (n_a <= 0) {
+    cout << "Argument <N1/M2> is invalid" << endl;
+    return usage(argv);
+  }
+
+  int n_b = atoi(argv[3]);
+  if (n_b <= 0) {
+    cout << "Argument <N2> is invalid" << endl;
+    return usage(argv);
+  }
+
+  int rows_per_task = atoi(argv[4]);
+  if (rows_per_task <= 0) {
+    cout << "Argument <rows-per-task> is invalid" << endl;
+    return usage(argv);
+  }
+
+  int num_threads = atoi(argv[5]);
+  if (num_threads <= 0) {
+    cout << "Argument <num-threads> is invalid" << endl;
+    return usage(argv);
+  }
+
+  int iterations = 1;
+  if (argc >= 7) {
+    iterations = atoi(argv[6]);
+    if (iterations <= 0) {
+      cout << "Argument [iterations] is invalid" << endl;
+      return usage(argv);
+    }
+  }
+
+  optional<int> seed;
+  if (argc == 8) {
+    seed = atoi(argv[7]);
+    cout << "Random seeds: " << *seed << ", " << (*seed + 1) << endl;
+  }
+
+  // first input matrix
+  Matrix<double> matrix_a(m_a, n_a);
+  matrix_a.randomise(-100, 100, seed);
+
+  if (seed) {
+    seed = *seed + 1;
+  }
+
+  // second input matrix
+  Matrix<double> matrix_b(n_a, n_b);
+  matrix_b.randomise(-100, 100, seed);
+
+#ifdef DEBUG
+  cout << "Matrix A:" << endl;
+  cout << matrix_a << endl;
+  cout << "Matrix B:" << endl;
+  cout << matrix_b << endl;
+#endif
+
+  // output matrix
+  Matrix<double> matrix_c(m_a, n_b);
+
+#ifdef PIN_THREADS
+  WorkStealingPool pool(num_threads, true);
+#else
+  WorkStealingPool pool(num_threads);
+#endif
+
+  // the first call may be slower, since caches, packing buffers and sleeping workers are all cold
+  auto start = high_resolution_clock::now();
+  multiply_matrices(matrix_a, matrix_b, matrix_c, rows_per_task, pool);
+  auto stop = high_resolution_clock::now();
+
+#ifdef DEBUG
+  cout << "Matrix C:" << endl;
+  cout << matrix_c;
+#endif
+
+  // how long did it take?
+  auto duration = duration_cast<microseconds>(stop - start);
+  cout << "Duration: " << duration.count() << " microseconds (" << (double(duration.count()) / 1000000.0f) << " seconds)" << endl;
+
+  // check the result, if asked to
+  if (!verify(matrix_a, matrix_b, matrix_c)) {
+    return 1;
+  }
+
+  if (iterations == 1) {
+    return 0;
+  }
+
+  // measure steady-state latency, reusing the same pool for every call
+  vector<long> latencies;
+  for (int i = 0; i < iterations; i++) {
+    auto start = high_resolution_clock::now();
+    multiply_matrices(matrix_a, matrix_b, matrix_c, rows_per_task, pool);
+    auto stop = high_resolution_clock::now();
+    latencies.push_back(duration_cast<microseconds>(stop - start).count());
+  }
+
+  sort(latencies.begin(), latencies.end());
+  const auto percentile = [&](double p) {
+    return latencies[min(latencies.size() - 1, size_t(p * latencies.size()))];
+  };
+
+  cout << "Steady state (" << iterations << " calls): "
+       << "p50 " << percentile(0.50) << " microseconds, "
+       << "p99 " << percentile(0.99) << " microseconds" << endl;
+
+  return 0;
+}
@@ -1,5 +1,13 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "OpenCL_Util.h"
 
@@ -195,10 +203,12 @@ cl_context opencl_create_context(cl_device_id device)
   return context;
 }
 
-cl_command_queue opencl_create_command_queue(cl_device_id device, cl_context context)
+cl_command_queue opencl_create_command_queue(cl_device_id device, cl_context context, cl_command_queue_properties properties)
 {
+  const cl_queue_properties list[] = { CL_QUEUE_PROPERTIES, properties, 0 };
+
   cl_int err;
-  cl_command_queue queue = clCreateCommandQueueWithProperties(context, device, 0, &err);
+  cl_command_queue queue = clCreateCommandQueueWithProperties(context, device, properties ? list : NULL, &err);
   if (err < 0) {
     cerr << "Failed to create a command queue: " << opencl_error_string(err) << endl;
     exit(1);
@@ -207,7 +217,7 @@ cl_command_queue opencl_create_command_queue(cl_device_id device, cl_context con
   return queue;
 }
 
-cl_program opencl_compile_program(cl_device_id device, cl_context context, const char* source)
+cl_program opencl_compile_program(cl_device_id device, cl_context context, const char* source, const char* options)
 {
   cl_program program;
   size_t size = strlen(source);
@@ -220,15 +230,181 @@ cl_program opencl_compile_program(cl_device_id device, cl_context context, const
   }
 
 
-  err = clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
+  err = clBuildProgram(program, 1, &device, options, NULL, NULL);
   if (err < 0) {
     cerr << "Failed to build program: " << opencl_error_string(err) << endl;
+
+    // the build log explains what went wrong, e.g. which build option was invalid
+    size_t log_size = 0;
+    clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
+    string log(log_size, '\0');
+    clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, log_size, &log[0], NULL);
+    cerr << log.c_str() << endl;
     exit(1);
   }
 
   return program;
 }
 
+static const char CACHE_MAGIC[8] = { 'C', 'L', 'B', 'I', 'N', '0', '0', '1' };
+
+static string opencl_device_string(cl_device_id device, cl_device_info param)
+{
+  size_t size = 0;
+  OPENCL_CHECK( clGetDeviceInfo(device, param, 0, NULL, &size) );
+  string value(size, '\0');
+  OPENCL_CHECK( clGetDeviceInfo(device, param, size, &value[0], NULL) );
+
+  // drop the terminating null
+  return value.c_str();
+}
+
+// 64-bit FNV-1a, which is plenty to tell cache entries apart since each entry also stores its full key
+static uint64_t fnv1a(const string &data)
+{
+  uint64_t hash = 14695981039346656037ull;
+  for (unsigned char c : data) {
+    hash = (hash ^ c) * 1099511628211ull;
+  }
+
+  return hash;
+}
+
+//
+// Cache entries are named after a hash of the source, build options, device and driver version, so a
+// change to any of them results in a cache miss. Each entry holds:
+//
+//   magic       8 bytes
+//   key size    8 bytes
+//   key         the text that was hashed
+//   binary size 8 bytes
+//   binary      from CL_PROGRAM_BINARIES
+//
+static bool read_cache_entry(const string &path, const string &key, vector<unsigned char> &binary)
+{
+  FILE* file = fopen(path.c_str(), "rb");
+  if (!file) {
+    return false;
+  }
+
+  char magic[sizeof(CACHE_MAGIC)];
+  uint64_t key_size = 0;
+  uint64_t binary_size = 0;
+  bool ok = fread(magic, sizeof(magic), 1, file) == 1 &&
+      memcmp(magic, CACHE_MAGIC, sizeof(magic)) == 0 &&
+      fread(&key_size, sizeof(key_size), 1, file) == 1 &&
+      key_size == key.size();
+
+  if (ok) {
+    string stored(key_size, '\0');
+    ok = fread(&stored[0], 1, key_size, file) == key_size && stored == key &&
+        fread(&binary_size, sizeof(binary_size), 1, file) == 1 && binary_size > 0;
+
+    if (ok) {
+      binary.resize(binary_size);
+      ok = fread(binary.data(), 1, binary_size, file) == binary_size;
+    }
+  }
+
+  fclose(file);
+  return ok;
+}
+
+static void write_cache_entry(const string &directory, const string &path, const string &key, cl_program program)
+{
+  size_t binary_size = 0;
+  OPENCL_CHECK( clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(binary_size), &binary_size, NULL) );
+  if (binary_size == 0) {
+    return;
+  }
+
+  vector<unsigned char> binary(binary_size);
+  unsigned char *binaries[] = { binary.data() };
+  OPENCL_CHECK( clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(binaries), binaries, NULL) );
+
+  mkdir(directory.c_str(), 0755);
+
+  // several processes on the same node may write the same entry, so each writes to its own file and
+  // then renames it into place, which is atomic
+  const string temp_path = path + "." + to_string(getpid());
+  FILE* file = fopen(temp_path.c_str(), "wb");
+  if (!file) {
+    cerr << "Warning: failed to write OpenCL cache entry '" << temp_path << "'" << endl;
+    return;
+  }
+
+  const uint64_t key_size = key.size();
+  const uint64_t size = binary_size;
+  bool ok = fwrite(CACHE_MAGIC, sizeof(CACHE_MAGIC), 1, file) == 1 &&
+      fwrite(&key_size, sizeof(key_size), 1, file) == 1 &&
+      fwrite(key.data(), 1, key.size(), file) == key.size() &&
+      fwrite(&size, sizeof(size), 1, file) == 1 &&
+      fwrite(binary.data(), 1, binary.size(), file) == binary.size();
+  ok = fclose(file) == 0 && ok;
+
+  if (!ok || rename(temp_path.c_str(), path.c_str()) != 0) {
+    cerr << "Warning: failed to write OpenCL cache entry '" << path << "'" << endl;
+    remove(temp_path.c_str());
+  }
+}
+
+cl_program opencl_load_program(cl_device_id device, cl_context context, const char* source, const char* options, bool* from_cache)
+{
+  if (from_cache) {
+    *from_cache = false;
+  }
+
+  const char *directory = getenv("OPENCL_CACHE_DIR");
+  if (!directory) {
+    directory = "opencl_cache";
+  }
+
+  if (!*directory) {
+    return opencl_compile_program(device, context, source, options);
+  }
+
+  string key = source;
+  key += '\0';
+  key += options ? options : "";
+  key += '\0';
+  key += opencl_device_string(device, CL_DEVICE_NAME);
+  key += '\0';
+  key += opencl_device_string(device, CL_DRIVER_VERSION);
+
+  char name[32];
+  snprintf(name, sizeof(name), "/%016llx.bin", (unsigned long long) fnv1a(key));
+  const string path = directory + string(name);
+
+  // the binary still has to be built, but that is far quicker than compiling from source; if the
+  // runtime rejects it, e.g. because it was written by a different version, the source is used instead
+  vector<unsigned char> binary;
+  if (read_cache_entry(path, key, binary)) {
+    const size_t size = binary.size();
+    const unsigned char *binaries[] = { binary.data() };
+    cl_int status;
+    cl_int err;
+    cl_program program = clCreateProgramWithBinary(context, 1, &device, &size, binaries, &status, &err);
+    if (err == CL_SUCCESS && status == CL_SUCCESS) {
+      err = clBuildProgram(program, 1, &device, options, NULL, NULL);
+      if (err == CL_SUCCESS) {
+        if (from_cache) {
+          *from_cache = true;
+        }
+        return program;
+      }
+    }
+
+    if (program) {
+      clReleaseProgram(program);
+    }
+    cerr << "Warning: ignoring stale OpenCL cache entry '" << path << "'" << endl;
+  }
+
+  cl_program program = opencl_compile_program(device, context, source, options);
+  write_cache_entry(directory, path, key, program);
+  return program;
+}
+
 cl_kernel opencl_create_kernel(cl_program program, const char* name)
 {
   cl_int err;
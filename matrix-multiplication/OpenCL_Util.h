@@ -7,8 +7,13 @@
 void opencl_assert(cl_int err, const char *file, int line);
 cl_device_id opencl_init();
 cl_context opencl_create_context(cl_device_id);
-cl_command_queue opencl_create_command_queue(cl_device_id, cl_context);
-cl_program opencl_compile_program(cl_device_id , cl_context, const char* source);
+cl_command_queue opencl_create_command_queue(cl_device_id, cl_context, cl_command_queue_properties properties = 0);
+cl_program opencl_compile_program(cl_device_id , cl_context, const char* source, const char* options = nullptr);
+
+// Like opencl_compile_program, but reuses a program binary from an earlier run if one has been cached
+// in $OPENCL_CACHE_DIR (default "opencl_cache"); setting OPENCL_CACHE_DIR to an empty string disables the cache
+cl_program opencl_load_program(cl_device_id, cl_context, const char* source, const char* options = nullptr, bool* from_cache = nullptr);
+
 cl_kernel opencl_create_kernel(cl_program, const char* name);
 cl_mem opencl_create_buffer(cl_context, cl_mem_flags, size_t size);
 void opencl_set_kernel_cl_mem_arg(cl_kernel, cl_mem arg_value, int arg_index);
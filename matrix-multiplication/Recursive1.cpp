@@ -1,11 +1,14 @@
 // #define DEBUG
 
+#include <algorithm>
 #include <cassert>
 #include <chrono>
 #include <iostream>
 
+#include "Arena.h"
 #include "Matrix.h"
 #include "Slice.h"
+#include "Verify.h"
 
 using namespace std;
 using namespace std::chrono;
@@ -16,90 +19,118 @@ bool power_of_two(int n)
 }
 
 template<typename T>
-void add_matrices(const Matrix<T> &matrix_a, const Matrix<T> &matrix_b, Matrix<T> &matrix_c, int m_c, int n_c)
+TileView<T> temporary(Arena &arena, int rows, int columns)
+{
+  return { arena.allocate<T>(size_t(rows) * columns), rows, columns, columns };
+}
+
+template<typename T>
+void add_matrices(TileView<T> matrix_a, TileView<T> matrix_b, TileView<T> matrix_c)
 {
   // check input matrix sizes
   assert(matrix_a.rows() == matrix_b.rows());
   assert(matrix_a.columns() == matrix_b.columns());
 
-  // // check output matrix size
-  assert(m_c + matrix_a.rows() <= matrix_c.rows());
-  assert(n_c + matrix_b.columns() <= matrix_c.columns());
+  // check output matrix size
+  assert(matrix_c.rows() == matrix_a.rows());
+  assert(matrix_c.columns() == matrix_a.columns());
 
-  for (int m = 0; m < matrix_a.rows(); m++) {
-    for (int n = 0; n < matrix_a.columns(); n++) {
-      matrix_c.set(m_c + m, n_c + n, matrix_a.get(m, n) + matrix_b.get(m, n));
+  for (int m = 0; m < matrix_c.rows(); m++) {
+    RowView<T> a = matrix_a.row(m);
+    RowView<T> b = matrix_b.row(m);
+    RowView<T> c = matrix_c.row(m);
+    for (int n = 0; n < matrix_c.columns(); n++) {
+      c[n] = a[n] + b[n];
     }
   }
 }
 
+//
+// Writes the product of two size x size blocks of A and B to matrix_c.
+//
+// The blocks of A and B are clipped to the input matrices, so they may be smaller than size x size, or
+// even empty. The cells that were cut off are treated as zero.
+//
 template<typename T>
-Matrix<T> multiply_matrices(
-    const Matrix<T> &matrix_a,
-    const Matrix<T> &matrix_b,
-    int m_a,
-    int n_a,
-    int m_b,
-    int n_b,
-    int size)
+void multiply_matrices(TileView<const T> matrix_a, TileView<const T> matrix_b, int size, TileView<T> matrix_c, Arena &arena)
 {
   assert(size >= 2);
   assert(power_of_two(size));
 
-  // output matrix
-  Matrix<T> matrix_c(size, size);
+  // the product of a block of zero padding with anything is zero
+  if (matrix_a.rows() == 0 || matrix_a.columns() == 0 || matrix_b.columns() == 0) {
+    matrix_c.fill(0);
+    return;
+  }
 
   // base case
   if (size == 2) {
-    for (int m = 0; m < 2; m++) {
-      for (int n = 0; n < 2; n++) {
+    const int inner = min(matrix_a.columns(), matrix_b.rows());
+
+    matrix_c.fill(0);
+    for (int m = 0; m < matrix_a.rows(); m++) {
+      for (int n = 0; n < matrix_b.columns(); n++) {
         T sum = 0;
-        for (int i = 0; i < 2; i++) {
-          sum += matrix_a.get(m + m_a, i + n_a) * matrix_b.get(i + m_b, n + n_b);
+        for (int i = 0; i < inner; i++) {
+          sum += matrix_a(m, i) * matrix_b(i, n);
         }
-        matrix_c.set(m, n, sum);
+        matrix_c(m, n) = sum;
       }
     }
 
-    return matrix_c;
+    return;
   }
 
   // multiply sub-blocks using naive approach
   int subsize = size / 2;
 
+  TileView<const T> a_11 = matrix_a.clip(0, subsize, 0, subsize);
+  TileView<const T> a_12 = matrix_a.clip(0, subsize, subsize, subsize);
+  TileView<const T> a_21 = matrix_a.clip(subsize, subsize, 0, subsize);
+  TileView<const T> a_22 = matrix_a.clip(subsize, subsize, subsize, subsize);
+
+  TileView<const T> b_11 = matrix_b.clip(0, subsize, 0, subsize);
+  TileView<const T> b_12 = matrix_b.clip(0, subsize, subsize, subsize);
+  TileView<const T> b_21 = matrix_b.clip(subsize, subsize, 0, subsize);
+  TileView<const T> b_22 = matrix_b.clip(subsize, subsize, subsize, subsize);
+
+  // temporaries for the two products that are summed to produce each quadrant of C, which are
+  // released when this level returns
+  ArenaScope scope(arena);
+  TileView<T> left = temporary<T>(arena, subsize, subsize);
+  TileView<T> right = temporary<T>(arena, subsize, subsize);
+
   // c_11 = a_11 * b_11 + a_12 * b_21
-  add_matrices(
-      multiply_matrices(matrix_a, matrix_b, m_a, n_a, m_b, n_b, subsize),
-      multiply_matrices(matrix_a, matrix_b, m_a, n_a + subsize, m_b + subsize, n_b, subsize),
-      matrix_c,
-      0,
-      0);
+  multiply_matrices(a_11, b_11, subsize, left, arena);
+  multiply_matrices(a_12, b_21, subsize, right, arena);
+  add_matrices(left, right, matrix_c.tile(0, subsize, 0, subsize));
 
   // c_12 = a_11 * b_12 + a_12 * b_22
-  add_matrices(
-      multiply_matrices(matrix_a, matrix_b, m_a, n_a, m_b, n_b + subsize, subsize),
-      multiply_matrices(matrix_a, matrix_b, m_a, n_a + subsize, m_b + subsize, n_b + subsize, subsize),
-      matrix_c,
-      0,
-      subsize);
+  multiply_matrices(a_11, b_12, subsize, left, arena);
+  multiply_matrices(a_12, b_22, subsize, right, arena);
+  add_matrices(left, right, matrix_c.tile(0, subsize, subsize, subsize));
 
   // c_21 = a_21 * b_11 + a_22 * b_21
-  add_matrices(
-      multiply_matrices(matrix_a, matrix_b, m_a + subsize, n_a, m_b, n_b, subsize),
-      multiply_matrices(matrix_a, matrix_b, m_a + subsize, n_a + subsize, m_b + subsize, n_b, subsize),
-      matrix_c,
-      subsize,
-      0);
+  multiply_matrices(a_21, b_11, subsize, left, arena);
+  multiply_matrices(a_22, b_21, subsize, right, arena);
+  add_matrices(left, right, matrix_c.tile(subsize, subsize, 0, subsize));
 
   // c_22 = a_21 * b_12 + a_22 * b_22
-  add_matrices(
-      multiply_matrices(matrix_a, matrix_b, m_a + subsize, n_a, m_b, n_b + subsize, subsize),
-      multiply_matrices(matrix_a, matrix_b, m_a + subsize, n_a + subsize, m_b + subsize, n_b + subsize, subsize),
-      matrix_c,
-      subsize,
-      subsize);
-
-  return matrix_c;
+  multiply_matrices(a_21, b_12, subsize, left, arena);
+  multiply_matrices(a_22, b_22, subsize, right, arena);
+  add_matrices(left, right, matrix_c.tile(subsize, subsize, subsize, subsize));
+}
+
+// Amount of arena memory needed by multiply_matrices; each level holds two temporaries while it recurses
+template<typename T>
+size_t workspace_size(int size)
+{
+  if (size <= 2) {
+    return 0;
+  }
+
+  const int subsize = size / 2;
+  return 2 * Arena::footprint<T>(size_t(subsize) * subsize) + workspace_size<T>(subsize);
 }
 
 int usage(char **argv)
@@ -182,12 +213,16 @@ int main(int argc, char **argv)
   int max_rows = max(m_a, n_a);
   int max_cols = max(n_a, n_b);
 
-  // TODO: pass real size and just use virtual cells
+  // the recursion works on blocks of a power of two size, which are clipped to the input matrices
   int size = pow2roundup(max(max_rows, max_cols));
 
-  // TODO: maybe allow matrix c to be written in place
+  // output matrix
+  Matrix<double> matrix_c(size, size);
+
+  // do the work, including reserving memory for temporaries
   auto start = high_resolution_clock::now();
-  Matrix<double> matrix_c = multiply_matrices(matrix_a, matrix_b, 0, 0, 0, 0, size);
+  Arena arena(workspace_size<double>(size));
+  multiply_matrices<double>(matrix_a.view(), matrix_b.view(), size, matrix_c.view(), arena);
   auto stop = high_resolution_clock::now();
 
 #ifdef DEBUG
@@ -199,5 +234,14 @@ int main(int argc, char **argv)
   auto duration = duration_cast<microseconds>(stop - start);
   cout << "Duration: " << duration.count() << " microseconds (" << (double(duration.count()) / 1000000.0f) << " seconds)" << endl;
 
+  // temporaries all came from one heap allocation
+  cout << "Workspace: " << arena.peak() << " of " << arena.capacity() << " bytes used at peak, "
+       << arena.allocations() << " temporaries allocated" << endl;
+
+  // check the result, if asked to; only the top left corner of matrix_c is part of the product
+  if (!verify<double>(matrix_a.view(), matrix_b.view(), matrix_c.view().tile(0, m_a, 0, n_b))) {
+    return 1;
+  }
+
   return 0;
 }
@@ -4,140 +4,220 @@
 #include <cassert>
 #include <chrono>
 #include <iostream>
+#include <optional>
 
+#include "Arena.h"
+#include "Gemm.h"
 #include "Matrix.h"
-#include "Slice.h"
+#include "Verify.h"
 
 using namespace std;
 using namespace std::chrono;
 
-bool power_of_two(int n)
+// below this size, the blocked classical algorithm is faster than recursing further
+const int DEFAULT_CUTOFF = 1024;
+
+template<typename T>
+TileView<T> temporary(Arena &arena, int rows, int columns)
 {
-  return (n & (n - 1)) == 0;
+  return { arena.allocate<T>(size_t(rows) * columns), rows, columns, columns };
 }
 
+// Computes matrix_c = op(matrix_a, matrix_b), element by element
 template<typename T, typename O>
-void combine_matrices(const Matrix<T> &matrix_a, const Matrix<T> &matrix_b, Matrix<T> &matrix_c, int m_c, int n_c, O &op)
+void combine_matrices(TileView<T> matrix_a, TileView<T> matrix_b, TileView<T> matrix_c, O op)
 {
   // check input matrix sizes
-  assert(matrix_a.rows() == matrix_b.rows());
-  assert(matrix_a.columns() == matrix_b.columns());
+  assert(matrix_a.rows() == matrix_b.rows() && matrix_a.columns() == matrix_b.columns());
 
-  // // check output matrix size
-  assert(m_c + matrix_a.rows() <= matrix_c.rows());
-  assert(n_c + matrix_b.columns() <= matrix_c.columns());
+  // check output matrix size
+  assert(matrix_c.rows() == matrix_a.rows() && matrix_c.columns() == matrix_a.columns());
 
-  for (int m = 0; m < matrix_a.rows(); m++) {
-    for (int n = 0; n < matrix_a.columns(); n++) {
-      matrix_c.set(m_c + m, n_c + n, op(matrix_a.get(m, n), matrix_b.get(m, n)));
+  for (int m = 0; m < matrix_c.rows(); m++) {
+    RowView<T> a = matrix_a.row(m);
+    RowView<T> b = matrix_b.row(m);
+    RowView<T> c = matrix_c.row(m);
+    for (int n = 0; n < matrix_c.columns(); n++) {
+      c[n] = op(a[n], b[n]);
     }
   }
 }
 
+// Computes matrix_c = matrix_a * matrix_b, or adds the product to matrix_c, using the blocked algorithm
 template<typename T>
-Matrix<T> multiply_matrices(
-    const Matrix<T> &matrix_a,
-    const Matrix<T> &matrix_b,
-    int m_a,
-    int n_a,
-    int m_b,
-    int n_b,
-    int size)
+void multiply_classical(TileView<T> matrix_a, TileView<T> matrix_b, TileView<T> matrix_c, bool accumulate = false)
 {
-  assert(size >= 2);
-  assert(power_of_two(size));
+  gemm(
+      matrix_c.rows(),
+      matrix_c.columns(),
+      matrix_a.columns(),
+      matrix_a.data(),
+      matrix_a.stride(),
+      matrix_b.data(),
+      matrix_b.stride(),
+      matrix_c.data(),
+      matrix_c.stride(),
+      accumulate);
+}
 
-  // output matrix
-  Matrix<T> matrix_c(size, size);
+//
+// Computes matrix_c = matrix_a * matrix_b, using the Winograd variant of Strassen's algorithm. This uses
+// 7 sub-block multiplications and 15 additions at each level.
+//
+// Matrices of any shape are supported using dynamic peeling. When a dimension is odd, the recursive step
+// is applied to the largest even-sized sub-problem, and the leftover row, column or rank-1 update is
+// computed separately. At or below 'cutoff', the blocked classical algorithm is faster than recursing
+// further.
+//
+template<typename T>
+void multiply_matrices(TileView<T> matrix_a, TileView<T> matrix_b, TileView<T> matrix_c, int cutoff, Arena &arena)
+{
+  const int m = matrix_a.rows();
+  const int k = matrix_a.columns();
+  const int n = matrix_b.columns();
 
-  // base case
-  if (size == 2) {
-    for (int m = 0; m < 2; m++) {
-      for (int n = 0; n < 2; n++) {
-        T sum = 0;
-        for (int i = 0; i < 2; i++) {
-          sum += matrix_a.get(m + m_a, i + n_a) * matrix_b.get(i + m_b, n + n_b);
-        }
-        matrix_c.set(m, n, sum);
-      }
-    }
+  // check matrix sizes
+  assert(matrix_b.rows() == k);
+  assert(matrix_c.rows() == m && matrix_c.columns() == n);
 
-    return matrix_c;
+  // base case
+  if (min({ m, k, n }) <= max(cutoff, 1)) {
+    multiply_classical(matrix_a, matrix_b, matrix_c);
+    return;
   }
 
-  // multiply sub-blocks using naive approach
-  int subsize = size / 2;
+  // peel off the last row and column of any odd dimensions
+  const int m_even = m & ~1;
+  const int k_even = k & ~1;
+  const int n_even = n & ~1;
+
+  const int m_half = m_even / 2;
+  const int k_half = k_even / 2;
+  const int n_half = n_even / 2;
+
+  TileView<T> a_11 = matrix_a.tile(0, m_half, 0, k_half);
+  TileView<T> a_12 = matrix_a.tile(0, m_half, k_half, k_half);
+  TileView<T> a_21 = matrix_a.tile(m_half, m_half, 0, k_half);
+  TileView<T> a_22 = matrix_a.tile(m_half, m_half, k_half, k_half);
+
+  TileView<T> b_11 = matrix_b.tile(0, k_half, 0, n_half);
+  TileView<T> b_12 = matrix_b.tile(0, k_half, n_half, n_half);
+  TileView<T> b_21 = matrix_b.tile(k_half, k_half, 0, n_half);
+  TileView<T> b_22 = matrix_b.tile(k_half, k_half, n_half, n_half);
+
+  TileView<T> c_11 = matrix_c.tile(0, m_half, 0, n_half);
+  TileView<T> c_12 = matrix_c.tile(0, m_half, n_half, n_half);
+  TileView<T> c_21 = matrix_c.tile(m_half, m_half, 0, n_half);
+  TileView<T> c_22 = matrix_c.tile(m_half, m_half, n_half, n_half);
+
+  // temporaries for sums of blocks of A (x) and B (y), and for the product p1 (z), which are released
+  // when this level returns
+  ArenaScope scope(arena);
+  TileView<T> x = temporary<T>(arena, m_half, k_half);
+  TileView<T> y = temporary<T>(arena, k_half, n_half);
+  TileView<T> z = temporary<T>(arena, m_half, n_half);
 
   std::plus<T> plus;
+  std::minus<T> minus;
+
+  // c_21 = p7 = (a_11 - a_21) * (b_22 - b_12)
+  combine_matrices(a_11, a_21, x, minus);
+  combine_matrices(b_22, b_12, y, minus);
+  multiply_matrices(x, y, c_21, cutoff, arena);
+
+  // c_22 = p5 = (a_21 + a_22) * (b_12 - b_11)
+  combine_matrices(a_21, a_22, x, plus);
+  combine_matrices(b_12, b_11, y, minus);
+  multiply_matrices(x, y, c_22, cutoff, arena);
+
+  // c_12 = p6 = (a_21 + a_22 - a_11) * (b_22 - b_12 + b_11)
+  combine_matrices(x, a_11, x, minus);
+  combine_matrices(b_22, y, y, minus);
+  multiply_matrices(x, y, c_12, cutoff, arena);
+
+  // c_11 = p3 = (a_12 - a_21 - a_22 + a_11) * b_22
+  combine_matrices(a_12, x, x, minus);
+  multiply_matrices(x, b_22, c_11, cutoff, arena);
+
+  // z = p1 = a_11 * b_11
+  multiply_matrices(a_11, b_11, z, cutoff, arena);
+
+  // c_12 = u2 = p1 + p6, c_21 = u3 = u2 + p7, c_12 = u4 = u2 + p5
+  combine_matrices(z, c_12, c_12, plus);
+  combine_matrices(c_12, c_21, c_21, plus);
+  combine_matrices(c_12, c_22, c_12, plus);
+
+  // c_22 = u7 = u3 + p5, c_12 = u5 = u4 + p3
+  combine_matrices(c_21, c_22, c_22, plus);
+  combine_matrices(c_12, c_11, c_12, plus);
+
+  // c_11 = p4 = a_22 * (b_22 - b_12 + b_11 - b_21), c_21 = u6 = u3 - p4
+  combine_matrices(y, b_21, y, minus);
+  multiply_matrices(a_22, y, c_11, cutoff, arena);
+  combine_matrices(c_21, c_11, c_21, minus);
+
+  // c_11 = u1 = p1 + p2 = p1 + a_12 * b_21
+  multiply_matrices(a_12, b_21, c_11, cutoff, arena);
+  combine_matrices(z, c_11, c_11, plus);
+
+  // fix up the even-sized part of C, when the shared dimension is odd
+  if (k_even < k) {
+    multiply_classical(
+        matrix_a.tile(0, m_even, k_even, 1),
+        matrix_b.tile(k_even, 1, 0, n_even),
+        matrix_c.tile(0, m_even, 0, n_even),
+        true);
+  }
+
+  // last column of C
+  if (n_even < n) {
+    multiply_classical(matrix_a.tile(0, m_even, 0, k), matrix_b.tile(0, k, n_even, 1), matrix_c.tile(0, m_even, n_even, 1));
+  }
 
-  // c_11 = a_11 * b_11 + a_12 * b_21
-  combine_matrices(
-      multiply_matrices(matrix_a, matrix_b, m_a, n_a, m_b, n_b, subsize),
-      multiply_matrices(matrix_a, matrix_b, m_a, n_a + subsize, m_b + subsize, n_b, subsize),
-      matrix_c,
-      0,
-      0,
-      plus);
-
-  // c_12 = a_11 * b_12 + a_12 * b_22
-  combine_matrices(
-      multiply_matrices(matrix_a, matrix_b, m_a, n_a, m_b, n_b + subsize, subsize),
-      multiply_matrices(matrix_a, matrix_b, m_a, n_a + subsize, m_b + subsize, n_b + subsize, subsize),
-      matrix_c,
-      0,
-      subsize,
-      plus);
-
-  // c_21 = a_21 * b_11 + a_22 * b_21
-  combine_matrices(
-      multiply_matrices(matrix_a, matrix_b, m_a + subsize, n_a, m_b, n_b, subsize),
-      multiply_matrices(matrix_a, matrix_b, m_a + subsize, n_a + subsize, m_b + subsize, n_b, subsize),
-      matrix_c,
-      subsize,
-      0,
-      plus);
-
-  // c_22 = a_21 * b_12 + a_22 * b_22
-  combine_matrices(
-      multiply_matrices(matrix_a, matrix_b, m_a + subsize, n_a, m_b, n_b + subsize, subsize),
-      multiply_matrices(matrix_a, matrix_b, m_a + subsize, n_a + subsize, m_b + subsize, n_b + subsize, subsize),
-      matrix_c,
-      subsize,
-      subsize,
-      plus);
-
-  return matrix_c;
+  // last row of C
+  if (m_even < m) {
+    multiply_classical(matrix_a.tile(m_even, 1, 0, k), matrix_b, matrix_c.tile(m_even, 1, 0, n));
+  }
+}
+
+// Amount of arena memory needed by multiply_matrices; each level holds three temporaries while it recurses
+template<typename T>
+size_t workspace_size(int m, int k, int n, int cutoff)
+{
+  if (min({ m, k, n }) <= max(cutoff, 1)) {
+    return 0;
+  }
+
+  const int m_half = m / 2;
+  const int k_half = k / 2;
+  const int n_half = n / 2;
+
+  return Arena::footprint<T>(size_t(m_half) * k_half)
+       + Arena::footprint<T>(size_t(k_half) * n_half)
+       + Arena::footprint<T>(size_t(m_half) * n_half)
+       + workspace_size<T>(m_half, k_half, n_half, cutoff);
 }
 
 int usage(char **argv)
 {
   cout << endl;
   cout << "Usage:" << endl;
-  cout << "  " << argv[0] << " <M1> <N1/M2> <N2> [seed]" << endl;
+  cout << "  " << argv[0] << " <M1> <N1/M2> <N2> [seed] [cutoff]" << endl;
+  cout << endl;
+  cout << "Multiplies a random M1xN1 matrix by a random M2xN2 matrix" << endl;
   cout << endl;
-  cout << "Multiples a random M1xN1 matrix by a random M2xN2 matrix" << endl;
+  cout << "Sub-problems with a dimension of [cutoff] or less use the classical algorithm" << endl;
 
   return 1;
 }
 
-int pow2roundup(int x)
-{
-  --x;
-  x |= x >> 1;
-  x |= x >> 2;
-  x |= x >> 4;
-  x |= x >> 8;
-  x |= x >> 16;
-  return x + 1;
-}
-
 int main(int argc, char **argv)
 {
   if (argc == 1) {
     return usage(argv);
   }
 
-  if (argc != 4 && argc != 5) {
+  if (argc < 4 || argc > 6) {
     cout << "Invalid argument count: " << argc << endl;
     return usage(argv);
   }
@@ -160,31 +240,32 @@ int main(int argc, char **argv)
     return usage(argv);
   }
 
-  int seed = 0;
-  if (argc == 5) {
+  optional<int> seed;
+  if (argc >= 5) {
     seed = atoi(argv[4]);
+    cout << "Random seeds: " << *seed << ", " << (*seed + 1) << endl;
   }
 
-  srand(seed);
+  int cutoff = DEFAULT_CUTOFF;
+  if (argc == 6) {
+    cutoff = atoi(argv[5]);
+    if (cutoff <= 0) {
+      cout << "Argument [cutoff] is invalid" << endl;
+      return usage(argv);
+    }
+  }
 
+  // first input matrix
   Matrix<double> matrix_a(m_a, n_a);
-  matrix_a.randomise(-100, 100);
-
-  Matrix<double> matrix_b(n_a, n_b);
-  matrix_b.randomise(-100, 100);
-
-  int max_rows = max(m_a, n_a);
-  int max_cols = max(n_a, n_b);
+  matrix_a.randomise(-100, 100, seed);
 
-  // TODO: pass real size and just use virtual cells
-  int size = pow2roundup(max(max_rows, max_cols));
+  if (seed) {
+    seed = *seed + 1;
+  }
 
-  // TODO: maybe allow matrix c to be written in place
-  auto start = high_resolution_clock::now();
-  Matrix<double> matrix_c = multiply_matrices(matrix_a, matrix_b, 0, 0, 0, 0, size);
-  auto stop = high_resolution_clock::now();
-  auto duration = duration_cast<microseconds>(stop - start);
-  cout << "Duration: " << duration.count() << " microseconds (" << (double(duration.count()) / 1000000.0f) << " seconds)" << endl;
+  // second input matrix
+  Matrix<double> matrix_b(n_a, n_b);
+  matrix_b.randomise(-100, 100, seed);
 
 #ifdef DEBUG
   cout << "Matrix A:" << endl;
@@ -192,11 +273,33 @@ int main(int argc, char **argv)
 
   cout << "Matrix B:" << endl;
   cout << matrix_b << endl;
+#endif
 
+  // output matrix
+  Matrix<double> matrix_c(m_a, n_b);
+
+  // do the work, including reserving memory for temporaries
+  auto start = high_resolution_clock::now();
+  Arena arena(workspace_size<double>(m_a, n_a, n_b, cutoff));
+  multiply_matrices(matrix_a.view(), matrix_b.view(), matrix_c.view(), cutoff, arena);
+  auto stop = high_resolution_clock::now();
+
+#ifdef DEBUG
   cout << "Matrix C:" << endl;
-  Slice<double> slice(matrix_c, 0, m_a, 0, n_b);
-  cout << slice;
+  cout << matrix_c;
 #endif
 
+  auto duration = duration_cast<microseconds>(stop - start);
+  cout << "Duration: " << duration.count() << " microseconds (" << (double(duration.count()) / 1000000.0f) << " seconds)" << endl;
+
+  // temporaries all came from one heap allocation
+  cout << "Workspace: " << arena.peak() << " of " << arena.capacity() << " bytes used at peak, "
+       << arena.allocations() << " temporaries allocated" << endl;
+
+  // check the result, if asked to
+  if (!verify(matrix_a, matrix_b, matrix_c)) {
+    return 1;
+  }
+
   return 0;
 }
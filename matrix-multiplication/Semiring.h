@@ -0,0 +1,99 @@
+#pragma once
+
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+
+//
+// Semirings for the GEMM engine in Gemm.h.
+//
+// A matrix product only needs an "add" that is associative and commutative, with an identity (zero),
+// and a "multiply" that distributes over it. Ordinary arithmetic is one choice, but replacing (+, *)
+// with (min, +) makes the product of two distance matrices the matrix of shortest two-hop distances,
+// and repeated squaring then gives all-pairs shortest paths. Likewise (max, +) gives longest paths and
+// critical paths, and (or, and) gives reachability.
+//
+// Each semiring is a struct with a value_type, zero(), add() and multiply(). The engine packs and
+// blocks the operands in the same way for every semiring; only the micro-kernel differs.
+//
+
+// Ordinary arithmetic, as used by gemm()
+template<typename T>
+struct PlusTimes
+{
+  using value_type = T;
+  static constexpr const char *name = "(+, *)";
+
+  static constexpr T zero() { return T(0); }
+  static constexpr T add(T a, T b) { return a + b; }
+  static constexpr T multiply(T a, T b) { return a * b; }
+};
+
+//
+// Floating point types have a true infinity, which absorbs any finite value that is added to it. Integer
+// types use half of their range instead, so that adding two finite values cannot overflow, and multiply()
+// checks for it explicitly. Finite integer values must stay strictly between -infinity and infinity.
+//
+template<typename T>
+constexpr T semiring_infinity()
+{
+  if constexpr (std::numeric_limits<T>::has_infinity) {
+    return std::numeric_limits<T>::infinity();
+  } else {
+    return std::numeric_limits<T>::max() / 2;
+  }
+}
+
+// Tropical semiring: C(i, j) is the shortest path from i to j through any k
+template<typename T>
+struct MinPlus
+{
+  using value_type = T;
+  static constexpr const char *name = "(min, +)";
+
+  static constexpr T infinity() { return semiring_infinity<T>(); }
+  static constexpr T zero() { return infinity(); }
+  static constexpr T add(T a, T b) { return std::min(a, b); }
+
+  static constexpr T multiply(T a, T b)
+  {
+    if constexpr (std::numeric_limits<T>::has_infinity) {
+      return a + b;
+    } else {
+      return (a == infinity() || b == infinity()) ? infinity() : a + b;
+    }
+  }
+};
+
+// Arctic semiring: C(i, j) is the longest path from i to j through any k
+template<typename T>
+struct MaxPlus
+{
+  using value_type = T;
+  static constexpr const char *name = "(max, +)";
+
+  static constexpr T infinity() { return -semiring_infinity<T>(); }
+  static constexpr T zero() { return infinity(); }
+  static constexpr T add(T a, T b) { return std::max(a, b); }
+
+  static constexpr T multiply(T a, T b)
+  {
+    if constexpr (std::numeric_limits<T>::has_infinity) {
+      return a + b;
+    } else {
+      return (a == infinity() || b == infinity()) ? infinity() : a + b;
+    }
+  }
+};
+
+// Boolean semiring, using zero and non-zero values: C(i, j) is set if any A(i, k) and B(k, j) are set
+template<typename T>
+struct OrAnd
+{
+  using value_type = T;
+  static constexpr const char *name = "(or, and)";
+
+  static constexpr T zero() { return T(0); }
+  static constexpr T add(T a, T b) { return (a != 0 || b != 0) ? T(1) : T(0); }
+  static constexpr T multiply(T a, T b) { return (a != 0 && b != 0) ? T(1) : T(0); }
+};
@@ -5,6 +5,7 @@
 #include <iostream>
 
 #include "Matrix.h"
+#include "Verify.h"
 
 using namespace std;
 using namespace std::chrono;
@@ -121,5 +122,10 @@ int main(int argc, char **argv)
   auto duration = duration_cast<microseconds>(stop - start);
   cout << "Duration: " << duration.count() << " microseconds (" << (double(duration.count()) / 1000000.0f) << " seconds)" << endl;
 
+  // check the result, if asked to
+  if (!verify(matrix_a, matrix_b, matrix_c)) {
+    return 1;
+  }
+
   return 0;
 }
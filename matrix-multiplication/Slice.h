@@ -31,6 +31,12 @@ public:
     return m_rows;
   }
 
+  // Unlike get and set, the slice must lie entirely within the matrix to use a view
+  TileView<T> view() const
+  {
+    return m_matrix.view().tile(m_m_offset, m_rows, m_n_offset, m_columns);
+  }
+
   void set(int m, int n, T value)
   {
     m_matrix.set(m + m_m_offset, n + m_n_offset, value);
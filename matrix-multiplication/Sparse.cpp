@@ -0,0 +1,320 @@
+// #define DEBUG
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Matrix.h"
+#include "Sparse.h"
+#include "Verify.h"
+
+using namespace std;
+using namespace std::chrono;
+
+//
+// Sparse matrix products, with the rows shared between threads.
+//
+// Sparse products read each non-zero once and do only two floating point operations with it, so they
+// are limited by memory bandwidth rather than arithmetic. Their speed is therefore reported as effective
+// bandwidth: the least amount of data that has to be moved, divided by the time taken.
+//
+// The time taken by each row depends on its number of non-zeros rather than on its length, so giving
+// each thread the same number of rows can leave some threads with much more work than others. Both ways
+// of partitioning the rows are timed.
+//
+
+// number of times that each matrix-vector product is repeated, since one takes very little time
+const int SPMV_REPETITIONS = 20;
+
+//
+// Generates a random sparse matrix with roughly the given density. As in real feature matrices, the
+// number of non-zeros varies widely between rows, following a log-normal distribution, and the rows are
+// ordered by frequency, so the longest come first.
+//
+CsrMatrix<double> random_sparse(int rows, int columns, double density, optional<int> seed)
+{
+  mt19937 engine;
+  if (seed) {
+    engine.seed(*seed);
+  } else {
+    random_device rd;
+    engine.seed(rd());
+  }
+
+  // a mean of 1, which is scaled to the average number of non-zeros per row
+  const double sigma = 1.5;
+  lognormal_distribution<double> skew(-sigma * sigma / 2, sigma);
+  uniform_int_distribution<int> column(0, columns - 1);
+  uniform_real_distribution<double> value(-100, 100);
+
+  vector<int> counts(rows);
+  for (int &count : counts) {
+    const double expected = skew(engine) * density * columns;
+    count = int(min<double>(columns, floor(expected + generate_canonical<double, 32>(engine))));
+  }
+  sort(counts.begin(), counts.end(), greater<int>());
+
+  CsrMatrix<double> matrix(rows, columns);
+  vector<int> indices;
+  for (int i = 0; i < rows; i++) {
+    // columns are drawn independently, and duplicates removed
+    indices.resize(counts[i]);
+    for (int &j : indices) {
+      j = column(engine);
+    }
+    sort(indices.begin(), indices.end());
+    indices.erase(unique(indices.begin(), indices.end()), indices.end());
+
+    for (int j : indices) {
+      matrix.append(j, value(engine));
+    }
+    matrix.end_row(i);
+  }
+
+  return matrix;
+}
+
+// Returns the largest number of non-zeros in any part of the partition
+size_t largest_part(const CsrMatrix<double> &matrix, const vector<int> &partition)
+{
+  size_t largest = 0;
+  for (size_t p = 0; p + 1 < partition.size(); p++) {
+    largest = max(largest, matrix.offsets()[partition[p + 1]] - matrix.offsets()[partition[p]]);
+  }
+
+  return largest;
+}
+
+void print_partition(const string &name, const CsrMatrix<double> &matrix, const vector<int> &partition)
+{
+  const double share = double(matrix.nonzeros()) / (partition.size() - 1);
+  cout << "Partitioned by " << name << ": largest part has " << largest_part(matrix, partition)
+       << " non-zeros (" << (largest_part(matrix, partition) / max(share, 1.0)) << "x an even share)" << endl;
+}
+
+void print_throughput(const string &name, microseconds duration, double bytes, double flops)
+{
+  const double us = max<double>(duration.count(), 1);
+  cout << name << ": " << duration.count() << " microseconds, " << (bytes / us / 1000.0) << " GB/s, "
+       << (flops / us / 1000.0) << " GFLOP/s" << endl;
+}
+
+// Checks y = A * x against a product computed one column at a time, allowing for rounding errors
+bool check_spmv(const CsrMatrix<double> &a, const vector<double> &x, const vector<double> &y)
+{
+  vector<double> expected(a.rows());
+  spmv(CscMatrix<double>::from_csr(a), x.data(), expected.data());
+
+  vector<double> x_abs(x.size());
+  transform(x.begin(), x.end(), x_abs.begin(), [](double value) { return abs(value); });
+  vector<double> scale(a.rows());
+  spmv(sparse_abs(a), x_abs.data(), scale.data(), 0, a.rows());
+
+  const double tolerance = 4.0 * a.columns() * numeric_limits<double>::epsilon();
+  for (int i = 0; i < a.rows(); i++) {
+    if (abs(expected[i] - y[i]) > tolerance * scale[i]) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+//
+// Checks C = A * B with Freivalds' algorithm, as verify() does for dense matrices. A * (B * r) is computed
+// one column of B * r at a time, with A in CSC form as in check_spmv, so that a fault in spmm() cannot
+// affect both sides of the comparison.
+//
+bool check_spmm(const CsrMatrix<double> &a, const Matrix<double> &b, const Matrix<double> &c, int rounds, unsigned seed)
+{
+  const vector<double> r = freivalds_vectors<double>(b.columns(), rounds, seed);
+
+  Matrix<double> b_r(b.rows(), rounds);
+  Matrix<double> b_r_abs(b.rows(), rounds);
+  multiply_vectors<double>(b.view(), r.data(), r.data(), rounds, b_r.data(), b_r_abs.data());
+
+  const CscMatrix<double> a_csc = CscMatrix<double>::from_csr(a);
+  const CscMatrix<double> a_abs_csc = CscMatrix<double>::from_csr(sparse_abs(a));
+
+  Matrix<double> ab_r(a.rows(), rounds);
+  Matrix<double> scale(a.rows(), rounds);
+  vector<double> x(b.rows()), x_abs(b.rows());
+  vector<double> y(a.rows()), y_abs(a.rows());
+  for (int round = 0; round < rounds; round++) {
+    for (int i = 0; i < b.rows(); i++) {
+      x[i] = b_r.get(i, round);
+      x_abs[i] = b_r_abs.get(i, round);
+    }
+
+    spmv(a_csc, x.data(), y.data());
+    spmv(a_abs_csc, x_abs.data(), y_abs.data());
+
+    for (int i = 0; i < a.rows(); i++) {
+      ab_r.set(i, round, y[i]);
+      scale.set(i, round, y_abs[i]);
+    }
+  }
+
+  vector<double> c_r(size_t(c.rows()) * rounds);
+  multiply_vectors<double>(c.view(), r.data(), nullptr, rounds, c_r.data(), nullptr);
+
+  return freivalds_compare(ab_r.data(), scale.data(), c_r.data(), c.rows(), rounds, a.columns(), b.columns());
+}
+
+int usage(char **argv)
+{
+  cout << endl;
+  cout << "Usage:" << endl;
+  cout << "  " << argv[0] << " <M1> <N1/M2> <N2> <density> <num-threads> [seed]" << endl;
+  cout << endl;
+  cout << "Multiplies a random sparse M1xN1 matrix, in which the given fraction of cells are non-zero, by a" << endl;
+  cout << "random vector and by a random dense M2xN2 matrix" << endl;
+
+  return 1;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc == 1) {
+    return usage(argv);
+  }
+
+  if (argc != 6 && argc != 7) {
+    cout << "Invalid argument count: " << argc << endl;
+    return usage(argv);
+  }
+
+  int m_a = atoi(argv[1]);
+  if (m_a <= 0) {
+    cout << "Argument <M1> is invalid" << endl;
+    return usage(argv);
+  }
+
+  int n_a = atoi(argv[2]);
+  if (n_a <= 0) {
+    cout << "Argument <N1/M2> is invalid" << endl;
+    return usage(argv);
+  }
+
+  int n_b = atoi(argv[3]);
+  if (n_b <= 0) {
+    cout << "Argument <N2> is invalid" << endl;
+    return usage(argv);
+  }
+
+  double density = atof(argv[4]);
+  if (density <= 0 || density > 1) {
+    cout << "Argument <density> is invalid" << endl;
+    return usage(argv);
+  }
+
+  int num_threads = atoi(argv[5]);
+  if (num_threads <= 0) {
+    cout << "Argument <num-threads> is invalid" << endl;
+    return usage(argv);
+  }
+
+  optional<int> seed;
+  if (argc == 7) {
+    seed = atoi(argv[6]);
+    cout << "Random seeds: " << *seed << ", " << (*seed + 1) << endl;
+  }
+
+  // sparse input matrix
+  const CsrMatrix<double> matrix_a = random_sparse(m_a, n_a, density, seed);
+
+  if (seed) {
+    seed = *seed + 1;
+  }
+
+  // dense input matrix, whose first column is also used as the input vector
+  Matrix<double> matrix_b(n_a, n_b);
+  matrix_b.randomise(-100, 100, seed);
+
+  vector<double> x(n_a);
+  for (int i = 0; i < n_a; i++) {
+    x[i] = matrix_b.get(i, 0);
+  }
+
+  cout << "Non-zeros: " << matrix_a.nonzeros() << " (density " << (double(matrix_a.nonzeros()) / m_a / n_a) << ")" << endl;
+  cout << "Memory: " << matrix_a.bytes() << " bytes, rather than " << size_t(m_a) * n_a * sizeof(double)
+       << " as a dense matrix" << endl;
+
+#ifdef DEBUG
+  cout << "Matrix A:" << endl;
+  cout << matrix_a.to_dense() << endl;
+  cout << "Matrix B:" << endl;
+  cout << matrix_b << endl;
+#endif
+
+  const vector<int> by_rows = partition_by_rows(m_a, num_threads);
+  const vector<int> by_nonzeros = partition_by_nonzeros(matrix_a, num_threads);
+  print_partition("rows", matrix_a, by_rows);
+  print_partition("non-zeros", matrix_a, by_nonzeros);
+
+  // least data moved: A once, plus the dense inputs and outputs
+  const double spmv_bytes = matrix_a.bytes() + (double(n_a) + m_a) * sizeof(double);
+  const double spmm_bytes = matrix_a.bytes() + (double(n_a) + m_a) * n_b * sizeof(double);
+  const double spmv_flops = 2.0 * matrix_a.nonzeros();
+  const double spmm_flops = spmv_flops * n_b;
+
+  // output vector and matrix
+  vector<double> y(m_a);
+  Matrix<double> matrix_c(m_a, n_b);
+
+  // the first run of each product is not timed, since it also faults in the pages of its output
+  spmv(matrix_a, x.data(), y.data(), by_nonzeros);
+  spmm<double>(matrix_a, matrix_b.view(), matrix_c.view(), by_nonzeros);
+
+  // do the work, once for each partition
+  microseconds duration(0);
+  for (const auto &[name, partition] : { make_pair("SpMV by rows", by_rows), make_pair("SpMV by non-zeros", by_nonzeros) }) {
+    auto start = high_resolution_clock::now();
+    for (int r = 0; r < SPMV_REPETITIONS; r++) {
+      spmv(matrix_a, x.data(), y.data(), partition);
+    }
+    auto stop = high_resolution_clock::now();
+
+    print_throughput(name, duration_cast<microseconds>(stop - start) / SPMV_REPETITIONS, spmv_bytes, spmv_flops);
+  }
+
+  for (const auto &[name, partition] : { make_pair("SpMM by rows", by_rows), make_pair("SpMM by non-zeros", by_nonzeros) }) {
+    auto start = high_resolution_clock::now();
+    spmm<double>(matrix_a, matrix_b.view(), matrix_c.view(), partition);
+    auto stop = high_resolution_clock::now();
+
+    duration = duration_cast<microseconds>(stop - start);
+    print_throughput(name, duration, spmm_bytes, spmm_flops);
+  }
+
+#ifdef DEBUG
+  cout << "Matrix C:" << endl;
+  cout << matrix_c;
+#endif
+
+  // how long did the product with balanced partitions take?
+  cout << "Duration: " << duration.count() << " microseconds (" << (double(duration.count()) / 1000000.0f) << " seconds)" << endl;
+
+  // check the results, if asked to
+  if (auto bound = verification_bound()) {
+    auto start = high_resolution_clock::now();
+    const int rounds = freivalds_rounds(*bound);
+    const bool passed = check_spmv(matrix_a, x, y) && check_spmm(matrix_a, matrix_b, matrix_c, rounds, random_device()());
+
+    print_verification(passed, rounds, *bound, start);
+    if (!passed) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
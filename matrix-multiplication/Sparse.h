@@ -0,0 +1,488 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+#include "Gemm_Kernels.h"
+#include "Matrix.h"
+#include "View.h"
+
+//
+// Compressed sparse matrices, which only store their non-zero cells.
+//
+// In compressed sparse row (CSR) format, the non-zeros of each row are stored together, in order of
+// column, as two arrays of values and column indices. A third array holds the offset of the first
+// non-zero of each row, plus one past the last, so row i occupies [offsets[i], offsets[i + 1]).
+// Compressed sparse column (CSC) format is the same with rows and columns swapped.
+//
+// A matrix with a density of 0.1% needs about 1/500th of the memory of a dense matrix of doubles, and
+// multiplying it takes a similarly small fraction of the work.
+//
+
+template<typename T>
+class CsrMatrix
+{
+public:
+  CsrMatrix(int rows, int columns)
+    : m_rows(rows)
+    , m_columns(columns)
+    , m_offsets(size_t(rows) + 1, 0)
+  {
+  }
+
+  // Builds a matrix from the non-zero cells of a dense one
+  static CsrMatrix from_dense(TileView<const T> dense)
+  {
+    CsrMatrix matrix(dense.rows(), dense.columns());
+    for (int i = 0; i < dense.rows(); i++) {
+      RowView<const T> row = dense.row(i);
+      for (int j = 0; j < dense.columns(); j++) {
+        if (row[j] != T(0)) {
+          matrix.m_indices.push_back(j);
+          matrix.m_values.push_back(row[j]);
+        }
+      }
+      matrix.m_offsets[i + 1] = matrix.m_values.size();
+    }
+
+    return matrix;
+  }
+
+  // Appends a non-zero to the last row that has been started; rows must be filled in order, with their
+  // columns in increasing order
+  void append(int column, T value)
+  {
+    assert(0 <= column && column < m_columns);
+    m_indices.push_back(column);
+    m_values.push_back(value);
+  }
+
+  // Ends row i, which must be the next row; any rows that were skipped are left empty
+  void end_row(int i)
+  {
+    m_offsets[i + 1] = m_values.size();
+  }
+
+  Matrix<T> to_dense() const
+  {
+    Matrix<T> dense(m_rows, m_columns);
+    dense.view().fill(0);
+    for (int i = 0; i < m_rows; i++) {
+      for (size_t p = m_offsets[i]; p < m_offsets[i + 1]; p++) {
+        dense.set(i, m_indices[p], m_values[p]);
+      }
+    }
+
+    return dense;
+  }
+
+  int rows() const
+  {
+    return m_rows;
+  }
+
+  int columns() const
+  {
+    return m_columns;
+  }
+
+  size_t nonzeros() const
+  {
+    return m_values.size();
+  }
+
+  // Bytes occupied by the three arrays
+  size_t bytes() const
+  {
+    return m_offsets.size() * sizeof(size_t) + m_indices.size() * sizeof(int) + m_values.size() * sizeof(T);
+  }
+
+  const std::vector<size_t>& offsets() const
+  {
+    return m_offsets;
+  }
+
+  const std::vector<int>& indices() const
+  {
+    return m_indices;
+  }
+
+  const std::vector<T>& values() const
+  {
+    return m_values;
+  }
+
+  std::vector<T>& values()
+  {
+    return m_values;
+  }
+
+private:
+  int m_rows;
+  int m_columns;
+
+  std::vector<size_t> m_offsets;
+  std::vector<int> m_indices;
+  std::vector<T> m_values;
+};
+
+template<typename T>
+class CscMatrix
+{
+public:
+  // Builds a matrix from the non-zero cells of a dense one
+  static CscMatrix from_dense(TileView<const T> dense)
+  {
+    return from_csr(CsrMatrix<T>::from_dense(dense));
+  }
+
+  // Converts from CSR, using a counting sort by column, so that each column is in order of row
+  static CscMatrix from_csr(const CsrMatrix<T> &csr)
+  {
+    CscMatrix matrix;
+    matrix.m_rows = csr.rows();
+    matrix.m_columns = csr.columns();
+    matrix.m_offsets.assign(size_t(csr.columns()) + 1, 0);
+    matrix.m_indices.resize(csr.nonzeros());
+    matrix.m_values.resize(csr.nonzeros());
+
+    for (int j : csr.indices()) {
+      matrix.m_offsets[j + 1]++;
+    }
+    for (int j = 0; j < csr.columns(); j++) {
+      matrix.m_offsets[j + 1] += matrix.m_offsets[j];
+    }
+
+    std::vector<size_t> next(matrix.m_offsets.begin(), matrix.m_offsets.end() - 1);
+    for (int i = 0; i < csr.rows(); i++) {
+      for (size_t p = csr.offsets()[i]; p < csr.offsets()[i + 1]; p++) {
+        const size_t q = next[csr.indices()[p]]++;
+        matrix.m_indices[q] = i;
+        matrix.m_values[q] = csr.values()[p];
+      }
+    }
+
+    return matrix;
+  }
+
+  int rows() const
+  {
+    return m_rows;
+  }
+
+  int columns() const
+  {
+    return m_columns;
+  }
+
+  size_t nonzeros() const
+  {
+    return m_values.size();
+  }
+
+  const std::vector<size_t>& offsets() const
+  {
+    return m_offsets;
+  }
+
+  const std::vector<int>& indices() const
+  {
+    return m_indices;
+  }
+
+  const std::vector<T>& values() const
+  {
+    return m_values;
+  }
+
+private:
+  CscMatrix() = default;
+
+  int m_rows = 0;
+  int m_columns = 0;
+
+  std::vector<size_t> m_offsets;
+  std::vector<int> m_indices;
+  std::vector<T> m_values;
+};
+
+//
+// Partitions divide the rows of a matrix between threads, and are given as boundaries: part p covers rows
+// [boundaries[p], boundaries[p + 1]).
+//
+
+// Gives each part the same number of rows, give or take one
+inline std::vector<int> partition_by_rows(int rows, int parts)
+{
+  std::vector<int> boundaries(size_t(parts) + 1);
+  for (int p = 0; p <= parts; p++) {
+    boundaries[p] = int(size_t(rows) * p / parts);
+  }
+
+  return boundaries;
+}
+
+//
+// Gives each part roughly the same number of non-zeros, which is what the time taken by a sparse product
+// depends on. Rows are never split, so a single row with more than its share of non-zeros forms a part
+// by itself, and may leave other parts empty.
+//
+template<typename T>
+std::vector<int> partition_by_nonzeros(const CsrMatrix<T> &matrix, int parts)
+{
+  const std::vector<size_t> &offsets = matrix.offsets();
+
+  std::vector<int> boundaries(size_t(parts) + 1);
+  boundaries[0] = 0;
+  for (int p = 1; p < parts; p++) {
+    // the first row that starts at or after this part's share of the non-zeros
+    const size_t target = matrix.nonzeros() * p / parts;
+    const int row = int(std::lower_bound(offsets.begin(), offsets.end(), target) - offsets.begin());
+    boundaries[p] = std::clamp(row, boundaries[p - 1], matrix.rows());
+  }
+  boundaries[parts] = matrix.rows();
+
+  return boundaries;
+}
+
+// Calls work(m_begin, m_end) for each part of a partition on a thread of its own, and waits for them all
+template<typename F>
+void parallel_for_partition(const std::vector<int> &boundaries, F work)
+{
+  // track worker threads
+  std::vector<std::thread> workers;
+  for (size_t p = 0; p + 1 < boundaries.size(); p++) {
+    if (boundaries[p] < boundaries[p + 1]) {
+      workers.emplace_back(work, boundaries[p], boundaries[p + 1]);
+    }
+  }
+
+  // wait for all worker threads to finish
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+// Computes rows [m_begin, m_end) of y = A * x
+template<typename T>
+void spmv(const CsrMatrix<T> &a, const T *x, T *y, int m_begin, int m_end)
+{
+  const size_t *offsets = a.offsets().data();
+  const int *indices = a.indices().data();
+  const T *values = a.values().data();
+
+  for (int i = m_begin; i < m_end; i++) {
+    T sum = 0;
+    for (size_t p = offsets[i]; p < offsets[i + 1]; p++) {
+      sum += values[p] * x[indices[p]];
+    }
+    y[i] = sum;
+  }
+}
+
+// Computes y = A * x, using a thread for each part of the partition
+template<typename T>
+void spmv(const CsrMatrix<T> &a, const T *x, T *y, const std::vector<int> &partition)
+{
+  parallel_for_partition(partition, [&](int m_begin, int m_end) {
+    spmv(a, x, y, m_begin, m_end);
+  });
+}
+
+// Computes y = A * x, one column of A at a time; this cannot be divided between threads by rows
+template<typename T>
+void spmv(const CscMatrix<T> &a, const T *x, T *y)
+{
+  std::fill(y, y + a.rows(), T(0));
+  for (int j = 0; j < a.columns(); j++) {
+    const T x_j = x[j];
+    for (size_t p = a.offsets()[j]; p < a.offsets()[j + 1]; p++) {
+      y[a.indices()[p]] += a.values()[p] * x_j;
+    }
+  }
+}
+
+// Number of columns of C that spmm computes at a time, in registers
+const int SPMM_BLOCK = 32;
+
+// Computes SPMM_BLOCK columns of a row of C, from the 'count' non-zeros of a row of A and the matching
+// columns of the rows of B, which are 'b_stride' apart
+template<typename T>
+using SpmmKernel = void (*)(const T *values, const int *indices, size_t count, const T *b, size_t b_stride, T *c);
+
+#define SPMM_UNROLL _Pragma("GCC unroll 16")
+
+#define SPMM_KERNEL_BODY                                                                \
+  constexpr int V = SPMM_BLOCK / Ops::width;                                           \
+  typename Ops::Vec acc[V];                                                            \
+  SPMM_UNROLL                                                                          \
+  for (int v = 0; v < V; v++) {                                                        \
+    acc[v] = Ops::zero();                                                              \
+  }                                                                                    \
+                                                                                       \
+  for (size_t p = 0; p < count; p++) {                                                 \
+    const typename Ops::Vec value = Ops::broadcast(values + p);                        \
+    const T *b_row = b + size_t(indices[p]) * b_stride;                                \
+    SPMM_UNROLL                                                                        \
+    for (int v = 0; v < V; v++) {                                                      \
+      acc[v] = Ops::fma(value, Ops::load(b_row + v * Ops::width), acc[v]);             \
+    }                                                                                  \
+  }                                                                                    \
+                                                                                       \
+  SPMM_UNROLL                                                                          \
+  for (int v = 0; v < V; v++) {                                                        \
+    Ops::store(c + v * Ops::width, acc[v]);                                            \
+  }
+
+// Scalar operations for the portable kernel
+template<typename T>
+struct SpmmScalar
+{
+  using Vec = T;
+  static constexpr int width = 1;
+  static Vec zero() { return T(0); }
+  static Vec load(const T *p) { return *p; }
+  static Vec broadcast(const T *p) { return *p; }
+  static Vec fma(Vec a, Vec b, Vec c) { return a * b + c; }
+  static void store(T *p, Vec v) { *p = v; }
+};
+
+template<typename Ops, typename T>
+void spmm_generic_kernel(const T *values, const int *indices, size_t count, const T *b, size_t b_stride, T *c)
+{
+  SPMM_KERNEL_BODY
+}
+
+#ifdef GEMM_X86_KERNELS
+
+template<typename Ops, typename T>
+GEMM_AVX2 void spmm_avx2_kernel(const T *values, const int *indices, size_t count, const T *b, size_t b_stride, T *c)
+{
+  SPMM_KERNEL_BODY
+}
+
+template<typename Ops, typename T>
+GEMM_AVX512 void spmm_avx512_kernel(const T *values, const int *indices, size_t count, const T *b, size_t b_stride, T *c)
+{
+  SPMM_KERNEL_BODY
+}
+
+#endif
+
+#undef SPMM_KERNEL_BODY
+#undef SPMM_UNROLL
+
+// Vectorized kernels for an element type, if there are any
+template<typename T>
+struct SpmmSimdKernels
+{
+  static constexpr bool available = false;
+};
+
+#ifdef GEMM_X86_KERNELS
+
+template<>
+struct SpmmSimdKernels<double>
+{
+  static constexpr bool available = true;
+  static SpmmKernel<double> avx2() { return spmm_avx2_kernel<Avx2Double, double>; }
+  static SpmmKernel<double> avx512() { return spmm_avx512_kernel<Avx512Double, double>; }
+};
+
+template<>
+struct SpmmSimdKernels<float>
+{
+  static constexpr bool available = true;
+  static SpmmKernel<float> avx2() { return spmm_avx2_kernel<Avx2Float, float>; }
+  static SpmmKernel<float> avx512() { return spmm_avx512_kernel<Avx512Float, float>; }
+};
+
+#endif
+
+template<typename T>
+SpmmKernel<T> spmm_select_kernel()
+{
+#ifdef GEMM_X86_KERNELS
+  if constexpr (SpmmSimdKernels<T>::available) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+      return SpmmSimdKernels<T>::avx512();
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+      return SpmmSimdKernels<T>::avx2();
+    }
+  }
+#endif
+
+  return spmm_generic_kernel<SpmmScalar<T>, T>;
+}
+
+// Returns the kernel used by spmm(), which is chosen once based on the features of the host CPU
+template<typename T>
+SpmmKernel<T> spmm_kernel()
+{
+  static const SpmmKernel<T> kernel = spmm_select_kernel<T>();
+  return kernel;
+}
+
+//
+// Computes rows [m_begin, m_end) of C = A * B, where A is sparse and B and C are dense. Each row of C is
+// computed in blocks of SPMM_BLOCK columns, which are kept in registers while every non-zero of the row
+// of A scales and adds the same columns of a row of B. Any remaining columns are computed one at a time.
+//
+template<typename T>
+void spmm(const CsrMatrix<T> &a, TileView<const T> b, TileView<T> c, int m_begin, int m_end)
+{
+  assert(a.columns() == b.rows());
+  assert(c.rows() == a.rows() && c.columns() == b.columns());
+
+  const size_t *offsets = a.offsets().data();
+  const int *indices = a.indices().data();
+  const T *values = a.values().data();
+
+  const SpmmKernel<T> kernel = spmm_kernel<T>();
+  const int blocked = c.columns() / SPMM_BLOCK * SPMM_BLOCK;
+
+  for (int i = m_begin; i < m_end; i++) {
+    T *c_row = c.row(i).begin();
+    const size_t begin = offsets[i];
+    const size_t count = offsets[i + 1] - begin;
+
+    for (int j0 = 0; j0 < blocked; j0 += SPMM_BLOCK) {
+      kernel(values + begin, indices + begin, count, b.data() + j0, b.stride(), c_row + j0);
+    }
+
+    for (int j = blocked; j < c.columns(); j++) {
+      T sum = 0;
+      for (size_t p = begin; p < begin + count; p++) {
+        sum += values[p] * b(indices[p], j);
+      }
+      c_row[j] = sum;
+    }
+  }
+}
+
+// Computes C = A * B, using a thread for each part of the partition
+template<typename T>
+void spmm(const CsrMatrix<T> &a, TileView<const T> b, TileView<T> c, const std::vector<int> &partition)
+{
+  parallel_for_partition(partition, [&](int m_begin, int m_end) {
+    spmm(a, b, c, m_begin, m_end);
+  });
+}
+
+// Returns a copy of A with the absolute value of each non-zero, e.g. for bounding rounding errors
+template<typename T>
+CsrMatrix<T> sparse_abs(const CsrMatrix<T> &a)
+{
+  CsrMatrix<T> result(a);
+  for (T &value : result.values()) {
+    value = std::abs(value);
+  }
+
+  return result;
+}
@@ -0,0 +1,396 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "Gemm_Kernels.h"
+#include "Matrix.h"
+#include "View.h"
+
+//
+// Randomised verification of C = A * B, using Freivalds' algorithm.
+//
+// Rather than computing A * B again, which costs as much as the multiplication being checked, a random
+// vector r of zeros and ones is chosen and A * (B * r) is compared with C * r. That only needs
+// matrix-vector products, so it costs O(n^2). If C is wrong, the two differ with probability at least
+// 1/2, so checking k independent vectors gives a false-positive rate of at most 2^-k.
+//
+// The k vectors are handled together, as the columns of an n x k matrix, so that each matrix is read
+// from memory only once.
+//
+// Results computed in floating point will not match exactly. Each comparison allows for rounding errors
+// in proportion to |A| * (|B| * r), which bounds the error of any reasonable way of computing C, so
+// only errors larger than rounding can be detected.
+//
+
+// false-positive bound that is used when verification is enabled without giving one
+const double DEFAULT_FALSE_POSITIVE_BOUND = 1e-9;
+
+// Returns the false-positive bound to verify results with, if the VERIFY environment variable is set
+inline std::optional<double> verification_bound()
+{
+  const char *value = std::getenv("VERIFY");
+  if (!value) {
+    return {};
+  }
+
+  // e.g. VERIFY=1 enables verification with the default bound
+  const double bound = std::atof(value);
+  return (bound > 0 && bound < 1) ? bound : DEFAULT_FALSE_POSITIVE_BOUND;
+}
+
+// Number of random vectors needed to push the false-positive rate below 'bound'
+inline int freivalds_rounds(double bound)
+{
+  return std::max(1, int(std::ceil(-std::log2(bound))));
+}
+
+// Returns 'rounds' random vectors of length n, as the columns of a row-major n x rounds matrix
+template<typename T>
+std::vector<T> freivalds_vectors(int n, int rounds, unsigned seed)
+{
+  std::mt19937 engine(seed);
+  std::bernoulli_distribution dist;
+
+  std::vector<T> vectors(size_t(n) * rounds);
+  for (auto &value : vectors) {
+    value = dist(engine) ? 1 : 0;
+  }
+
+  return vectors;
+}
+
+// Number of vectors that multiply_vectors handles at a time; the kernels below keep a block of sums in
+// registers, which needs a width that is fixed at compile time
+const int FREIVALDS_BLOCK = 32;
+
+// Computes the sums of one row of M (or of |M|) times a block of vectors, stored as n rows of FREIVALDS_BLOCK
+template<typename T>
+using FreivaldsKernel = void (*)(const T *row, int n, const T *x, T *sums);
+
+#define FREIVALDS_UNROLL _Pragma("GCC unroll 16")
+
+#define FREIVALDS_KERNEL_BODY                                                           \
+  constexpr int V = FREIVALDS_BLOCK / Ops::width;                                      \
+  typename Ops::Vec acc[V];                                                            \
+  FREIVALDS_UNROLL                                                                     \
+  for (int v = 0; v < V; v++) {                                                        \
+    acc[v] = Ops::zero();                                                              \
+  }                                                                                    \
+                                                                                       \
+  for (int j = 0; j < n; j++) {                                                        \
+    const T value = (Abs && row[j] < 0) ? -row[j] : row[j];                            \
+    const typename Ops::Vec scalar = Ops::broadcast(&value);                           \
+    const T *x_row = x + size_t(j) * FREIVALDS_BLOCK;                                  \
+    FREIVALDS_UNROLL                                                                   \
+    for (int v = 0; v < V; v++) {                                                      \
+      acc[v] = Ops::fma(scalar, Ops::load(x_row + v * Ops::width), acc[v]);            \
+    }                                                                                  \
+  }                                                                                    \
+                                                                                       \
+  FREIVALDS_UNROLL                                                                     \
+  for (int v = 0; v < V; v++) {                                                        \
+    Ops::store(sums + v * Ops::width, acc[v]);                                         \
+  }
+
+// Scalar operations for the portable kernel
+template<typename T>
+struct FreivaldsScalar
+{
+  using Vec = T;
+  static constexpr int width = 1;
+  static Vec zero() { return T(0); }
+  static Vec load(const T *p) { return *p; }
+  static Vec broadcast(const T *p) { return *p; }
+  static Vec fma(Vec a, Vec b, Vec c) { return a * b + c; }
+  static void store(T *p, Vec v) { *p = v; }
+};
+
+template<typename Ops, bool Abs, typename T>
+void freivalds_generic_kernel(const T *row, int n, const T *x, T *sums)
+{
+  FREIVALDS_KERNEL_BODY
+}
+
+#ifdef GEMM_X86_KERNELS
+
+template<typename Ops, bool Abs, typename T>
+GEMM_AVX2 void freivalds_avx2_kernel(const T *row, int n, const T *x, T *sums)
+{
+  FREIVALDS_KERNEL_BODY
+}
+
+template<typename Ops, bool Abs, typename T>
+GEMM_AVX512 void freivalds_avx512_kernel(const T *row, int n, const T *x, T *sums)
+{
+  FREIVALDS_KERNEL_BODY
+}
+
+#endif
+
+#undef FREIVALDS_KERNEL_BODY
+#undef FREIVALDS_UNROLL
+
+// Vectorized kernels for an element type, if there are any
+template<typename T>
+struct FreivaldsSimdKernels
+{
+  static constexpr bool available = false;
+};
+
+#ifdef GEMM_X86_KERNELS
+
+template<>
+struct FreivaldsSimdKernels<double>
+{
+  static constexpr bool available = true;
+  template<bool Abs> static FreivaldsKernel<double> avx2() { return freivalds_avx2_kernel<Avx2Double, Abs, double>; }
+  template<bool Abs> static FreivaldsKernel<double> avx512() { return freivalds_avx512_kernel<Avx512Double, Abs, double>; }
+};
+
+template<>
+struct FreivaldsSimdKernels<float>
+{
+  static constexpr bool available = true;
+  template<bool Abs> static FreivaldsKernel<float> avx2() { return freivalds_avx2_kernel<Avx2Float, Abs, float>; }
+  template<bool Abs> static FreivaldsKernel<float> avx512() { return freivalds_avx512_kernel<Avx512Float, Abs, float>; }
+};
+
+#endif
+
+template<typename T, bool Abs>
+FreivaldsKernel<T> freivalds_select_kernel()
+{
+#ifdef GEMM_X86_KERNELS
+  if constexpr (FreivaldsSimdKernels<T>::available) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+      return FreivaldsSimdKernels<T>::template avx512<Abs>();
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+      return FreivaldsSimdKernels<T>::template avx2<Abs>();
+    }
+  }
+#endif
+
+  return freivalds_generic_kernel<FreivaldsScalar<T>, Abs, T>;
+}
+
+// Returns the kernel used by multiply_vectors(), which is chosen once based on the features of the host CPU
+template<typename T, bool Abs>
+FreivaldsKernel<T> freivalds_kernel()
+{
+  static const FreivaldsKernel<T> kernel = freivalds_select_kernel<T, Abs>();
+  return kernel;
+}
+
+//
+// Computes y = M * x for the columns of the n x rounds matrix x, using multiple threads for large
+// matrices. If y_abs is given, it also computes y_abs = |M| * x_abs, where x_abs must not be negative.
+//
+template<typename T>
+void multiply_vectors(TileView<const T> m, const T *x, const T *x_abs, int rounds, T *y, T *y_abs)
+{
+  constexpr int W = FREIVALDS_BLOCK;
+  const int blocks = (rounds + W - 1) / W;
+
+  // x is copied into blocks of W columns, padded with zeros, so each row of a block is W values long
+  auto pad = [&](const T *source) {
+    std::vector<T> padded(size_t(blocks) * m.columns() * W);
+    for (int block = 0; block < blocks; block++) {
+      const int width = std::min(W, rounds - block * W);
+      for (int j = 0; j < m.columns(); j++) {
+        const T *x_row = source + size_t(j) * rounds + block * W;
+        std::copy(x_row, x_row + width, padded.data() + (size_t(block) * m.columns() + j) * W);
+      }
+    }
+    return padded;
+  };
+
+  const std::vector<T> x_padded = pad(x);
+  const std::vector<T> x_abs_padded = y_abs ? pad(x_abs) : std::vector<T>();
+
+  const FreivaldsKernel<T> kernel = freivalds_kernel<T, false>();
+  const FreivaldsKernel<T> abs_kernel = freivalds_kernel<T, true>();
+
+  auto multiply_rows = [&](int m_begin, int m_end) {
+    T sums[W];
+    for (int i = m_begin; i < m_end; i++) {
+      const T *row = m.row(i).data();
+
+      for (int block = 0; block < blocks; block++) {
+        const size_t offset = size_t(block) * m.columns() * W;
+        const int width = std::min(W, rounds - block * W);
+
+        kernel(row, m.columns(), x_padded.data() + offset, sums);
+        std::copy(sums, sums + width, y + size_t(i) * rounds + block * W);
+
+        if (y_abs) {
+          abs_kernel(row, m.columns(), x_abs_padded.data() + offset, sums);
+          std::copy(sums, sums + width, y_abs + size_t(i) * rounds + block * W);
+        }
+      }
+    }
+  };
+
+  // each thread needs enough work to be worth starting
+  const size_t cells = size_t(m.rows()) * m.columns();
+  const int threads = int(std::min<size_t>({
+      std::max(1u, std::thread::hardware_concurrency()),
+      std::max<size_t>(1, cells / (1 << 16)),
+      size_t(std::max(1, m.rows()))}));
+
+  if (threads == 1) {
+    multiply_rows(0, m.rows());
+    return;
+  }
+
+  std::vector<std::thread> workers;
+  const int rows_per_thread = (m.rows() + threads - 1) / threads;
+  for (int m_begin = 0; m_begin < m.rows(); m_begin += rows_per_thread) {
+    workers.emplace_back(multiply_rows, m_begin, std::min(m.rows(), m_begin + rows_per_thread));
+  }
+
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+//
+// Compares A * (B * r) with C * r for 'rows' rows and 'rounds' vectors, allowing for rounding errors in
+// proportion to 'scale', which should be |A| * (|B| * r).
+//
+template<typename T>
+bool freivalds_compare(const T *ab_r, const T *scale, const T *c_r, int rows, int rounds, int n_a, int n_b)
+{
+  // rounding errors in C, in A * (B * r) and in C * r all grow with the length of the sums involved
+  const double tolerance = 4.0 * (n_a + n_b) * std::numeric_limits<T>::epsilon();
+
+  for (size_t i = 0; i < size_t(rows) * rounds; i++) {
+    const double difference = std::abs(double(ab_r[i]) - double(c_r[i]));
+    if (difference > tolerance * double(scale[i])) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+//
+// Checks that C = A1 * A2 * ... * An, with a false-positive rate of at most 2^-rounds. The vectors are
+// multiplied through the chain from right to left, so only matrix-vector products are needed.
+//
+template<typename T>
+bool freivalds_chain(const std::vector<TileView<const T>> &matrices, TileView<const T> c, int rounds, unsigned seed)
+{
+  assert(!matrices.empty());
+  assert(c.rows() == matrices.front().rows());
+  assert(c.columns() == matrices.back().columns());
+
+  // r is made of zeros and ones, so it is its own absolute value
+  const std::vector<T> r = freivalds_vectors<T>(c.columns(), rounds, seed);
+
+  std::vector<T> x = r;
+  std::vector<T> x_abs = r;
+
+  // rounding errors grow with the total length of the sums along the chain
+  int inner = 0;
+  for (int i = int(matrices.size()) - 1; i >= 0; i--) {
+    assert(matrices[i].columns() * size_t(rounds) == x.size());
+
+    std::vector<T> y(size_t(matrices[i].rows()) * rounds);
+    std::vector<T> y_abs(size_t(matrices[i].rows()) * rounds);
+    multiply_vectors(matrices[i], x.data(), x_abs.data(), rounds, y.data(), y_abs.data());
+    x.swap(y);
+    x_abs.swap(y_abs);
+
+    if (i > 0) {
+      inner += matrices[i].rows();
+    }
+  }
+
+  std::vector<T> c_r(size_t(c.rows()) * rounds);
+  multiply_vectors<T>(c, r.data(), nullptr, rounds, c_r.data(), nullptr);
+
+  return freivalds_compare(x.data(), x_abs.data(), c_r.data(), c.rows(), rounds, inner, c.columns());
+}
+
+// Checks that C = A * B, with a false-positive rate of at most 2^-rounds
+template<typename T>
+bool freivalds(TileView<const T> a, TileView<const T> b, TileView<const T> c, int rounds, unsigned seed)
+{
+  assert(a.columns() == b.rows());
+  return freivalds_chain<T>({ a, b }, c, rounds, seed);
+}
+
+inline void print_verification(bool passed, int rounds, double bound, std::chrono::high_resolution_clock::time_point start)
+{
+  auto duration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start);
+  std::cout << "Verification: " << (passed ? "passed" : "FAILED") << " (" << rounds << " rounds, false-positive bound "
+            << bound << ", " << duration.count() << " microseconds)" << std::endl;
+}
+
+//
+// Checks a result against a reference computation if the VERIFY environment variable is set. This is for
+// results that Freivalds' algorithm cannot check, e.g. in a semiring without subtraction, or that are too
+// small for it to save any work. 'check' returns whether the result matches the reference, which is
+// described by 'reference' when the outcome is printed. Returns false only if the check failed.
+//
+template<typename F>
+bool verify_against(const char *reference, F check)
+{
+  if (!verification_bound()) {
+    return true;
+  }
+
+  auto start = std::chrono::high_resolution_clock::now();
+  const bool passed = check();
+
+  auto duration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start);
+  std::cout << "Verification: " << (passed ? "passed" : "FAILED") << " (compared with " << reference << ", "
+            << duration.count() << " microseconds)" << std::endl;
+  return passed;
+}
+
+//
+// Checks that C = A1 * A2 * ... * An if the VERIFY environment variable is set, or if 'required' is true,
+// and prints the outcome. Returns false only if the check failed.
+//
+template<typename T>
+bool verify_chain(const std::vector<TileView<const T>> &matrices, TileView<const T> c, bool required = false)
+{
+  auto bound = verification_bound();
+  if (!bound && !required) {
+    return true;
+  }
+
+  auto start = std::chrono::high_resolution_clock::now();
+  const double false_positive_bound = bound.value_or(DEFAULT_FALSE_POSITIVE_BOUND);
+  const int rounds = freivalds_rounds(false_positive_bound);
+  const bool passed = freivalds_chain(matrices, c, rounds, std::random_device()());
+
+  print_verification(passed, rounds, false_positive_bound, start);
+  return passed;
+}
+
+// Checks that C = A * B, in the same way
+template<typename T>
+bool verify(TileView<const T> a, TileView<const T> b, TileView<const T> c, bool required = false)
+{
+  return verify_chain<T>({ a, b }, c, required);
+}
+
+template<typename T>
+bool verify(const Matrix<T> &a, const Matrix<T> &b, const Matrix<T> &c, bool required = false)
+{
+  return verify(a.view(), b.view(), c.view(), required);
+}
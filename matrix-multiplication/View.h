@@ -0,0 +1,133 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <type_traits>
+
+//
+// Lightweight, non-owning views over the storage of a Matrix<T>.
+//
+// Unlike Matrix<T>::get, element access through a view is not bounds checked, so hot loops do not pay
+// for a branch on every access. Bounds are only checked (using assert) when a view is created. Code
+// that needs to treat cells outside a matrix as zero should do so explicitly, by clipping tiles.
+//
+
+// A contiguous row of a matrix, similar to std::span in C++20
+template<typename T>
+class RowView
+{
+public:
+  RowView(T *data, int size)
+    : m_data(data)
+    , m_size(size) {}
+
+  T& operator[](int i) const
+  {
+    return m_data[i];
+  }
+
+  T* begin() const
+  {
+    return m_data;
+  }
+
+  T* data() const
+  {
+    return m_data;
+  }
+
+  T* end() const
+  {
+    return m_data + m_size;
+  }
+
+  int size() const
+  {
+    return m_size;
+  }
+
+private:
+  T *m_data;
+  int m_size;
+};
+
+// A rectangular tile of a row-major matrix, with 'stride' elements between the start of each row
+template<typename T>
+class TileView
+{
+public:
+  TileView(T *data, int rows, int columns, int stride)
+    : m_data(data)
+    , m_rows(rows)
+    , m_columns(columns)
+    , m_stride(stride) {}
+
+  // A view of mutable elements can be used wherever a view of const elements is expected
+  operator TileView<const T>() const
+  {
+    return { m_data, m_rows, m_columns, m_stride };
+  }
+
+  T& operator()(int m, int n) const
+  {
+    return m_data[size_t(m) * m_stride + n];
+  }
+
+  // Returns the part of the region [m, m + rows) x [n, n + columns) that lies inside this tile. The
+  // result may be smaller than requested, or even empty; cells that were cut off should be treated
+  // as zero padding by the caller.
+  TileView clip(int m, int rows, int n, int columns) const
+  {
+    m = std::min(m, m_rows);
+    n = std::min(n, m_columns);
+    return tile(m, std::min(rows, m_rows - m), n, std::min(columns, m_columns - n));
+  }
+
+  int columns() const
+  {
+    return m_columns;
+  }
+
+  T* data() const
+  {
+    return m_data;
+  }
+
+  void fill(std::remove_const_t<T> value) const
+  {
+    for (int m = 0; m < m_rows; m++) {
+      std::fill(row(m).begin(), row(m).end(), value);
+    }
+  }
+
+  RowView<T> row(int m) const
+  {
+    assert(0 <= m && m < m_rows);
+    return { m_data + size_t(m) * m_stride, m_columns };
+  }
+
+  int rows() const
+  {
+    return m_rows;
+  }
+
+  int stride() const
+  {
+    return m_stride;
+  }
+
+  // Returns the region [m, m + rows) x [n, n + columns), which must lie inside this tile
+  TileView tile(int m, int rows, int n, int columns) const
+  {
+    assert(0 <= m && 0 <= rows && m + rows <= m_rows);
+    assert(0 <= n && 0 <= columns && n + columns <= m_columns);
+    return { m_data + size_t(m) * m_stride + n, rows, columns, m_stride };
+  }
+
+private:
+  T *m_data;
+  int m_rows;
+  int m_columns;
+  int m_stride;
+};
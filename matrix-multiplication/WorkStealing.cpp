@@ -0,0 +1,150 @@
+// #define DEBUG
+
+#include <cassert>
+#include <chrono>
+#include <iostream>
+
+#include "Matrix.h"
+#include "Verify.h"
+#include "WorkStealingPool.h"
+
+using namespace std;
+using namespace std::chrono;
+
+template<typename T>
+void multiply_matrices(const Matrix<T> &matrix_a, const Matrix<T> &matrix_b, Matrix<T> &matrix_c, int rows_per_task, WorkStealingPool &pool)
+{
+  // check input matrix sizes
+  const auto n_a = matrix_a.columns();
+  const auto m_b = matrix_b.rows();
+  assert(matrix_a.columns() == matrix_b.rows());
+
+  // check output matrix size
+  const auto m_a = matrix_a.rows();
+  const auto n_b = matrix_b.columns();
+  assert(matrix_c.rows() == matrix_a.rows());
+  assert(matrix_c.columns() == matrix_b.columns());
+
+  // the pool decides how to divide the rows between workers, but never uses fewer than rows_per_task
+  TileView<const T> view_b = matrix_b.view();
+  pool.parallel_for(0, m_a, rows_per_task, [&](int m_begin, int m_end) {
+    for (int m = m_begin; m < m_end; m++) {
+      RowView<const T> row_a = matrix_a.row(m);
+      RowView<T> row_c = matrix_c.row(m);
+
+      for (int n = 0; n < n_b; n++) {
+        // find value of cell [m,n]
+        T sum = 0;
+        for (int i = 0; i < n_a; i++) {
+          sum += row_a[i] * view_b(i, n);
+        }
+
+        // store value
+        row_c[n] = sum;
+      }
+    }
+  });
+}
+
+int usage(char **argv)
+{
+  cout << endl;
+  cout << "Usage:" << endl;
+  cout << "  " << argv[0] << " <M1> <N1/M2> <N2> <rows-per-task> <num-threads> [seed]" << endl;
+  cout << endl;
+  cout << "Multiplies a random M1xN1 matrix by a random M2xN2 matrix" << endl;
+
+  return 1;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc == 1) {
+    return usage(argv);
+  }
+
+  if (argc != 6 && argc != 7) {
+    cout << "Invalid argument count: " << argc << endl;
+    return usage(argv);
+  }
+
+  int m_a = atoi(argv[1]);
+  if (m_a <= 0) {
+    cout << "Argument <M1> is invalid" << endl;
+    return usage(argv);
+  }
+
+  int n_a = atoi(argv[2]);
+  if (n_a <= 0) {
+    cout << "Argument <N1/M2> is invalid" << endl;
+    return usage(argv);
+  }
+
+  int n_b = atoi(argv[3]);
+  if (n_b <= 0) {
+    cout << "Argument <N2> is invalid" << endl;
+    return usage(argv);
+  }
+
+  int rows_per_task = atoi(argv[4]);
+  if (rows_per_task <= 0) {
+    cout << "Argument <rows-per-task> is invalid" << endl;
+    return usage(argv);
+  }
+
+  int num_threads = atoi(argv[5]);
+  if (num_threads <= 0) {
+    cout << "Argument <num-threads> is invalid" << endl;
+    return usage(argv);
+  }
+
+  optional<int> seed;
+  if (argc == 7) {
+    seed = atoi(argv[6]);
+    cout << "Random seeds: " << *seed << ", " << (*seed + 1) << endl;
+  }
+
+  // first input matrix
+  Matrix<double> matrix_a(m_a, n_a);
+  matrix_a.randomise(-100, 100, seed);
+
+  if (seed) {
+    seed = *seed + 1;
+  }
+
+  // second input matrix
+  Matrix<double> matrix_b(n_a, n_b);
+  matrix_b.randomise(-100, 100, seed);
+
+#ifdef DEBUG
+  cout << "Matrix A:" << endl;
+  cout << matrix_a << endl;
+  cout << "Matrix B:" << endl;
+  cout << matrix_b << endl;
+#endif
+
+  // output matrix
+  Matrix<double> matrix_c(m_a, n_b);
+
+  // do the work, including the cost of starting the worker threads
+  auto start = high_resolution_clock::now();
+  WorkStealingPool pool(num_threads);
+  multiply_matrices(matrix_a, matrix_b, matrix_c, rows_per_task, pool);
+  auto stop = high_resolution_clock::now();
+
+#ifdef DEBUG
+  cout << "Matrix C:" << endl;
+  cout << matrix_c;
+#endif
+
+  // how long did it take?
+  auto duration = duration_cast<microseconds>(stop - start);
+  cout << "Duration: " << duration.count() << " microseconds (" << (double(duration.count()) / 1000000.0f) << " seconds)" << endl;
+
+  // check the result, if asked to
+  if (!verify(matrix_a, matrix_b, matrix_c)) {
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,527 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+//
+// Chase-Lev work-stealing deque, using the memory orderings from "Correct and Efficient Work-Stealing
+// for Weak Memory Models" (Le et al, 2013).
+//
+// The owning thread pushes and pops items at the bottom, without taking a lock. Other threads steal
+// items from the top, using a compare-and-swap to resolve races with each other and with the owner.
+//
+template<typename T>
+class WorkStealingDeque
+{
+public:
+  WorkStealingDeque(int capacity = 64)
+    : m_top(0)
+    , m_bottom(0)
+    , m_array(new Array(capacity))
+  {
+  }
+
+  ~WorkStealingDeque()
+  {
+    delete m_array.load();
+    for (auto array : m_retired) {
+      delete array;
+    }
+  }
+
+  bool empty() const
+  {
+    return m_bottom.load(std::memory_order_relaxed) <= m_top.load(std::memory_order_relaxed);
+  }
+
+  // Owner only
+  void push(T *item)
+  {
+    const int64_t b = m_bottom.load(std::memory_order_relaxed);
+    const int64_t t = m_top.load(std::memory_order_acquire);
+    Array *array = m_array.load(std::memory_order_relaxed);
+    if (b - t > array->capacity - 1) {
+      array = grow(array, t, b);
+    }
+
+    array->put(b, item);
+    m_bottom.store(b + 1, std::memory_order_release);
+  }
+
+  // Owner only
+  T* pop()
+  {
+    const int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+    Array *array = m_array.load(std::memory_order_relaxed);
+    m_bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = m_top.load(std::memory_order_relaxed);
+
+    if (t > b) {
+      // deque was already empty
+      m_bottom.store(b + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+
+    T *item = array->get(b);
+    if (t == b) {
+      // last item; race against thieves for it
+      if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        item = nullptr;
+      }
+      m_bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    return item;
+  }
+
+  // Any thread; returns nullptr if the deque is empty, or if another thread won the race
+  T* steal()
+  {
+    int64_t t = m_top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const int64_t b = m_bottom.load(std::memory_order_acquire);
+
+    if (t >= b) {
+      return nullptr;
+    }
+
+    T *item = m_array.load(std::memory_order_acquire)->get(t);
+    if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+      return nullptr;
+    }
+
+    return item;
+  }
+
+private:
+  struct Array
+  {
+    Array(int64_t capacity)
+      : capacity(capacity)
+      , items(new std::atomic<T*>[capacity]) {}
+
+    ~Array()
+    {
+      delete[] items;
+    }
+
+    T* get(int64_t i) const
+    {
+      return items[i & (capacity - 1)].load(std::memory_order_relaxed);
+    }
+
+    void put(int64_t i, T *item)
+    {
+      items[i & (capacity - 1)].store(item, std::memory_order_relaxed);
+    }
+
+    const int64_t capacity;
+    std::atomic<T*> *items;
+  };
+
+  Array* grow(Array *array, int64_t t, int64_t b)
+  {
+    Array *bigger = new Array(array->capacity * 2);
+    for (int64_t i = t; i < b; i++) {
+      bigger->put(i, array->get(i));
+    }
+
+    // thieves may still be reading from the old array, so it is only freed with the deque
+    m_retired.push_back(array);
+    m_array.store(bigger, std::memory_order_release);
+    return bigger;
+  }
+
+  std::atomic<int64_t> m_top;
+  std::atomic<int64_t> m_bottom;
+  std::atomic<Array*> m_array;
+  std::vector<Array*> m_retired;
+};
+
+//
+// A fixed set of worker threads, each with its own work-stealing deque.
+//
+// Work is described as a range of indices. Rather than dividing the range up front, a worker that is
+// executing a range repeatedly takes a chunk of 'grain' indices. Before each chunk it checks its own
+// deque, and if that is empty (meaning that any thieves will have nothing to steal), it splits the
+// remaining range in half and pushes the upper half. Ranges are therefore only split when there are
+// idle workers, and the size of each task adapts to the amount of work that is left.
+//
+// Idle workers steal from randomly chosen victims, and eventually go to sleep if there is no work.
+//
+// The pool is intended to be long-lived, so that the cost of starting threads is only paid once. On
+// Linux, each worker can optionally be pinned to its own core.
+//
+// Several threads can share a pool. Functions passed to submit() belong to a Group, and wait() only
+// waits for the functions in that group. A worker that waits, either in wait() or in parallel_for(),
+// runs other tasks until its own have completed, so tasks can safely submit and wait for more work.
+//
+class WorkStealingPool
+{
+public:
+  WorkStealingPool(int num_threads, bool pin_threads = false)
+    : m_stop(false)
+    , m_epoch(0)
+    , m_sleeping(0)
+    , m_pending(0)
+  {
+    num_threads = std::max(num_threads, 1);
+    for (int i = 0; i < num_threads; i++) {
+      m_deques.emplace_back(new WorkStealingDeque<Task>());
+    }
+    for (int i = 0; i < num_threads; i++) {
+      m_workers.emplace_back(&WorkStealingPool::run, this, i);
+      if (pin_threads) {
+        pin_to_core(m_workers.back(), i);
+      }
+    }
+  }
+
+  ~WorkStealingPool()
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_pending_mutex);
+      m_idle.wait(lock, [&]() { return m_pending == 0; });
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+
+    m_wake.notify_all();
+    for (auto &worker : m_workers) {
+      worker.join();
+    }
+    for (auto deque : m_deques) {
+      delete deque;
+    }
+  }
+
+  WorkStealingPool(const WorkStealingPool&) = delete;
+  WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+  // A set of functions passed to submit(), which are waited for together; each caller uses its own
+  class Group
+  {
+  public:
+    Group() = default;
+    Group(const Group&) = delete;
+    Group& operator=(const Group&) = delete;
+
+  private:
+    friend class WorkStealingPool;
+
+    // number of functions in the group that have not completed; only changed while holding the mutex,
+    // so that the group can be destroyed as soon as a waiter sees that it is zero
+    int m_pending = 0;
+    std::mutex m_mutex;
+    std::condition_variable m_done;
+  };
+
+  // Calls fn(begin, end) for disjoint sub-ranges that together cover [begin, end), and waits for them
+  // to complete. Sub-ranges are never smaller than 'grain', except at the end of the range.
+  void parallel_for(int begin, int end, int grain, std::function<void(int, int)> fn)
+  {
+    if (begin >= end) {
+      return;
+    }
+
+    Job job(std::move(fn), std::max(grain, 1), end - begin);
+    inject(new Task{ &job, begin, end });
+
+    if (is_worker()) {
+      help_until([&]() {
+        std::lock_guard<std::mutex> lock(job.mutex);
+        return job.done;
+      });
+      return;
+    }
+
+    std::unique_lock<std::mutex> lock(job.mutex);
+    job.finished.wait(lock, [&]() { return job.done; });
+  }
+
+  // Runs fn on one of the workers as part of 'group', without waiting for it to complete
+  void submit(Group &group, std::function<void()> fn)
+  {
+    {
+      std::lock_guard<std::mutex> lock(group.m_mutex);
+      group.m_pending++;
+    }
+    {
+      std::lock_guard<std::mutex> lock(m_pending_mutex);
+      m_pending++;
+    }
+
+    Job *job = new Job([fn = std::move(fn)](int, int) { fn(); }, 1, 1);
+    job->group = &group;
+    inject(new Task{ job, 0, 1 });
+  }
+
+  // Waits for the functions passed to submit() as part of 'group' to complete
+  void wait(Group &group)
+  {
+    if (is_worker()) {
+      help_until([&]() {
+        std::lock_guard<std::mutex> lock(group.m_mutex);
+        return group.m_pending == 0;
+      });
+      return;
+    }
+
+    std::unique_lock<std::mutex> lock(group.m_mutex);
+    group.m_done.wait(lock, [&]() { return group.m_pending == 0; });
+  }
+
+  int size() const
+  {
+    return int(m_workers.size());
+  }
+
+private:
+  struct Job
+  {
+    Job(std::function<void(int, int)> fn, int grain, int64_t remaining)
+      : fn(std::move(fn))
+      , grain(grain)
+      , remaining(remaining)
+      , group(nullptr)
+      , done(false) {}
+
+    std::function<void(int, int)> fn;
+    const int grain;
+
+    // number of indices that have not yet been processed
+    std::atomic<int64_t> remaining;
+
+    // jobs created by submit() are owned by the pool, rather than by a waiting caller, and belong to a group
+    Group *group;
+
+    std::mutex mutex;
+    std::condition_variable finished;
+    bool done;
+  };
+
+  struct Task
+  {
+    Job *job;
+    int begin;
+    int end;
+  };
+
+  static void pin_to_core(std::thread &thread, int index)
+  {
+#ifdef __linux__
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(index % std::max(1u, std::thread::hardware_concurrency()), &cpus);
+    pthread_setaffinity_np(thread.native_handle(), sizeof(cpus), &cpus);
+#endif
+  }
+
+  // The calling thread's pool and worker index, if it is a worker
+  struct Worker
+  {
+    WorkStealingPool *pool = nullptr;
+    int index = 0;
+  };
+
+  static Worker& current_worker()
+  {
+    thread_local Worker worker;
+    return worker;
+  }
+
+  bool is_worker() const
+  {
+    return current_worker().pool == this;
+  }
+
+  // Runs tasks on the calling worker until 'finished' returns true, rather than blocking, so that the
+  // tasks being waited for cannot be stuck behind the waiter
+  template<typename F>
+  void help_until(F finished)
+  {
+    const int index = current_worker().index;
+    uint32_t rng = 2654435761u * uint32_t(index + 1) + 1;
+
+    while (!finished()) {
+      if (Task *task = find_task(index, rng)) {
+        execute(index, task);
+      } else {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  void finish(Job &job)
+  {
+    if (Group *group = job.group) {
+      delete &job;
+      {
+        std::lock_guard<std::mutex> lock(group->m_mutex);
+        if (--group->m_pending == 0) {
+          group->m_done.notify_all();
+        }
+      }
+
+      std::lock_guard<std::mutex> lock(m_pending_mutex);
+      if (--m_pending == 0) {
+        m_idle.notify_all();
+      }
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(job.mutex);
+    job.done = true;
+    job.finished.notify_all();
+  }
+
+  void inject(Task *task)
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_injected_mutex);
+      m_injected.push_back(task);
+    }
+
+    notify();
+  }
+
+  void notify()
+  {
+    m_epoch.fetch_add(1);
+    if (m_sleeping.load() > 0) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_wake.notify_all();
+    }
+  }
+
+  Task* find_task(int index, uint32_t &rng)
+  {
+    if (Task *task = m_deques[index]->pop()) {
+      return task;
+    }
+
+    // try a few random victims
+    const int n = int(m_deques.size());
+    for (int attempt = 0; attempt < 2 * n; attempt++) {
+      rng ^= rng << 13;
+      rng ^= rng >> 17;
+      rng ^= rng << 5;
+      const int victim = int(rng % n);
+      if (victim == index) {
+        continue;
+      }
+      if (Task *task = m_deques[victim]->steal()) {
+        return task;
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(m_injected_mutex);
+    if (m_injected.empty()) {
+      return nullptr;
+    }
+
+    Task *task = m_injected.front();
+    m_injected.pop_front();
+    return task;
+  }
+
+  void execute(int index, Task *task)
+  {
+    Job &job = *task->job;
+    WorkStealingDeque<Task> &deque = *m_deques[index];
+
+    int begin = task->begin;
+    int end = task->end;
+    delete task;
+
+    while (begin < end) {
+      // lazily split off the upper half of the range if nobody has anything to steal
+      if (end - begin > 2 * job.grain && deque.empty()) {
+        const int middle = begin + (end - begin) / 2;
+        deque.push(new Task{ &job, middle, end });
+        end = middle;
+        notify();
+      }
+
+      const int chunk_end = std::min(end, begin + job.grain);
+      job.fn(begin, chunk_end);
+
+      const int64_t count = chunk_end - begin;
+      begin = chunk_end;
+
+      if (job.remaining.fetch_sub(count) == count) {
+        finish(job);
+      }
+    }
+  }
+
+  void run(int index)
+  {
+    current_worker() = { this, index };
+
+    uint32_t rng = 2654435761u * uint32_t(index + 1);
+
+    int failures = 0;
+    while (true) {
+      const uint64_t epoch = m_epoch.load();
+
+      if (Task *task = find_task(index, rng)) {
+        execute(index, task);
+        failures = 0;
+        continue;
+      }
+
+      // spin briefly before going to sleep, since new work often arrives soon after
+      if (++failures < 64) {
+        std::this_thread::yield();
+        continue;
+      }
+
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_sleeping.fetch_add(1);
+      m_wake.wait(lock, [&]() { return m_stop || m_epoch.load() != epoch; });
+      m_sleeping.fetch_sub(1);
+      if (m_stop) {
+        return;
+      }
+
+      failures = 0;
+    }
+  }
+
+  std::vector<WorkStealingDeque<Task>*> m_deques;
+  std::vector<std::thread> m_workers;
+
+  // work submitted from outside the pool
+  std::deque<Task*> m_injected;
+  std::mutex m_injected_mutex;
+
+  // used to put idle workers to sleep
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+  bool m_stop;
+  std::atomic<uint64_t> m_epoch;
+  std::atomic<int> m_sleeping;
+
+  // number of submitted functions that have not completed, in any group, so that the pool is not
+  // destroyed while they are running
+  int m_pending;
+  std::mutex m_pending_mutex;
+  std::condition_variable m_idle;
+};
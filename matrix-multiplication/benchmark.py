@@ -0,0 +1,274 @@
+#
+# Benchmark driver for the matrix multiplication examples
+#
+# Runs each example over a sweep of matrix shapes and thread (or process) counts. Every configuration
+# is run a number of times after some warmup runs, and the 'Duration' line printed by the example is
+# used as the time for that run. Results are written as JSON or CSV, so that they can be compared
+# across commits.
+#
+# Usage:
+#  python3 benchmark.py --shapes 512x512x512,1024x1024x1024 --threads 1,2,4 --repetitions 5
+#  python3 benchmark.py --variants Blocked,Recursive2 --format csv --output results.csv
+#
+# The MPI examples must be built first, e.g. using 'make MPI MPI_Hybrid'. Examples that have not been
+# built are skipped.
+#
+
+import argparse
+import csv
+import datetime
+import json
+import math
+import os
+import platform
+import re
+import shlex
+import statistics
+import subprocess
+import sys
+
+DIRECTORY = os.path.dirname(os.path.abspath(__file__))
+
+# every example multiplies matrices of doubles
+ELEMENT_SIZE = 8
+
+DURATION = re.compile(r'^Duration: (\d+) microseconds', re.MULTILINE)
+
+def rows_per_worker(m, workers):
+  """ Divides m rows evenly between workers """
+  return max(1, math.ceil(m / workers))
+
+def rows_per_task(m, workers):
+  """ Divides m rows into several tasks per worker, so that work can be balanced """
+  return max(1, math.ceil(m / (4 * workers)))
+
+#
+# Each variant describes how to build the command line for one example. 'threads' is False for
+# examples that always use a single thread, or that choose the number of threads themselves.
+# 'max_cells' limits the size of the output for examples that would otherwise be impractical.
+# 'mpi' examples are launched with one process per thread count, except that 'hybrid' examples divide
+# each count between processes and threads in every possible way, and are passed the threads per process.
+#
+VARIANTS = {
+  'Sequential': {
+    'args': lambda m, k, n, t, seed: [m, k, n, seed],
+    'threads': False,
+  },
+  'Blocked': {
+    'args': lambda m, k, n, t, seed: [m, k, n, seed],
+    'threads': False,
+  },
+  'Recursive1': {
+    'args': lambda m, k, n, t, seed: [m, k, n, seed],
+    'threads': False,
+  },
+  'Recursive2': {
+    'args': lambda m, k, n, t, seed: [m, k, n, seed],
+    'threads': False,
+  },
+  'Multithreaded1': {
+    # one thread per cell of the output
+    'args': lambda m, k, n, t, seed: [m, k, n, seed],
+    'threads': False,
+    'max_cells': 128 * 128,
+  },
+  'Multithreaded2': {
+    'args': lambda m, k, n, t, seed: [m, k, n, rows_per_worker(m, t), seed],
+    'threads': True,
+  },
+  'Multithreaded3': {
+    'args': lambda m, k, n, t, seed: [m, k, n, rows_per_task(m, t), t, 1, seed],
+    'threads': True,
+  },
+  'QueueBased': {
+    'args': lambda m, k, n, t, seed: [m, k, n, rows_per_task(m, t), t, seed],
+    'threads': True,
+  },
+  'WorkStealing': {
+    'args': lambda m, k, n, t, seed: [m, k, n, rows_per_task(m, t), t, seed],
+    'threads': True,
+  },
+  'MPI': {
+    'args': lambda m, k, n, t, seed: [m, k, n, seed],
+    'threads': True,
+    'mpi': True,
+  },
+  'MPI_SUMMA': {
+    # the processes are arranged in the most square grid that uses all of them
+    'args': lambda m, k, n, t, seed: [m, k, n, seed],
+    'threads': True,
+    'mpi': True,
+  },
+  'MPI_Pipelined': {
+    'args': lambda m, k, n, t, seed: [m, k, n, seed],
+    'threads': True,
+    'mpi': True,
+  },
+  'MPI_Hybrid': {
+    'args': lambda m, k, n, t, seed: [m, k, n, seed, t],
+    'threads': True,
+    'mpi': True,
+    'hybrid': True,
+  },
+  'MPI_Shared': {
+    # processes on the same node share one copy of B
+    'args': lambda m, k, n, t, seed: [m, k, n, seed],
+    'threads': True,
+    'mpi': True,
+  },
+}
+
+def parse_shape(shape):
+  """ Parses a shape written as MxKxN, for an MxK matrix multiplied by a KxN matrix """
+  dims = [int(d) for d in shape.lower().split('x')]
+  if len(dims) != 3 or min(dims) <= 0:
+    raise argparse.ArgumentTypeError("invalid shape '%s', expected MxKxN" % shape)
+  return tuple(dims)
+
+def parse_list(value, parse):
+  return [parse(v) for v in value.split(',') if v]
+
+def percentile(values, p):
+  """ Nearest-rank percentile """
+  ordered = sorted(values)
+  rank = max(1, math.ceil(p / 100.0 * len(ordered)))
+  return ordered[rank - 1]
+
+def configurations(variant, counts):
+  """ Returns the (processes, threads per process) pairs to run for each thread or process count """
+  if not variant['threads']:
+    return [(1, 1)]
+  if variant.get('hybrid'):
+    return [(p, count // p) for count in counts for p in range(1, count + 1) if count % p == 0]
+  if variant.get('mpi'):
+    return [(count, 1) for count in counts]
+  return [(1, count) for count in counts]
+
+def command_for(name, variant, shape, processes, threads, seed, mpirun):
+  m, k, n = shape
+  command = [os.path.join(DIRECTORY, name)] + [str(a) for a in variant['args'](m, k, n, threads, seed)]
+  if variant.get('mpi'):
+    command = mpirun + ['-n', str(processes)] + command
+  return command
+
+def run_once(command, timeout):
+  """ Runs an example, and returns its duration in seconds """
+  result = subprocess.run(command, stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True, timeout=timeout)
+  match = DURATION.search(result.stdout)
+  if result.returncode != 0 or not match:
+    raise RuntimeError('%s failed (exit code %d): %s' % (' '.join(command), result.returncode, result.stderr.strip()))
+
+  # examples that report more than one duration print the one for a cold call first
+  return int(match.group(1)) / 1e6
+
+def benchmark(name, variant, shape, processes, threads, args, mpirun):
+  command = command_for(name, variant, shape, processes, threads, args.seed, mpirun)
+
+  for _ in range(args.warmup):
+    run_once(command, args.timeout)
+  times = [run_once(command, args.timeout) for _ in range(args.repetitions)]
+
+  m, k, n = shape
+  flops = 2.0 * m * k * n
+
+  # the minimum traffic: each input read once and the output written once
+  bytes_moved = ELEMENT_SIZE * (m * k + k * n + m * n)
+
+  median = statistics.median(times)
+  return {
+    'variant': name,
+    'm': m,
+    'k': k,
+    'n': n,
+    'processes': processes,
+    'threads': threads,
+    'repetitions': len(times),
+    'median_seconds': median,
+    'p95_seconds': percentile(times, 95),
+    'min_seconds': min(times),
+    'gflops': flops / max(median, 1e-9) / 1e9,
+    'bytes_per_flop': bytes_moved / flops,
+  }
+
+def git_revision():
+  try:
+    return subprocess.check_output(['git', 'rev-parse', 'HEAD'], cwd=DIRECTORY, stderr=subprocess.DEVNULL, text=True).strip()
+  except (OSError, subprocess.CalledProcessError):
+    return None
+
+def write_json(results, output):
+  document = {
+    'revision': git_revision(),
+    'timestamp': datetime.datetime.now(datetime.timezone.utc).isoformat(),
+    'host': platform.node(),
+    'cpus': os.cpu_count(),
+    'results': results,
+  }
+  json.dump(document, output, indent=2)
+  output.write('\n')
+
+def write_csv(results, output):
+  if not results:
+    return
+  writer = csv.DictWriter(output, fieldnames=list(results[0].keys()))
+  writer.writeheader()
+  writer.writerows(results)
+
+def main():
+  parser = argparse.ArgumentParser(description='Benchmarks the matrix multiplication examples')
+  parser.add_argument('--variants', default=','.join(VARIANTS), help='comma-separated examples to run (default: all)')
+  parser.add_argument('--shapes', default='256x256x256,512x512x512', help='comma-separated MxKxN shapes')
+  parser.add_argument('--threads', default='1,2,4', help='comma-separated thread or process counts')
+  parser.add_argument('--warmup', type=int, default=1, help='untimed runs before each measurement')
+  parser.add_argument('--repetitions', type=int, default=5, help='timed runs for each measurement')
+  parser.add_argument('--seed', type=int, default=1, help='random seed passed to each example')
+  parser.add_argument('--timeout', type=float, default=600, help='seconds before a run is abandoned')
+  parser.add_argument('--mpirun', default='mpirun', help='command used to launch the MPI example')
+  parser.add_argument('--format', choices=['json', 'csv'], default='json')
+  parser.add_argument('--output', help='file to write results to (default: stdout)')
+  args = parser.parse_args()
+
+  if args.repetitions <= 0 or args.warmup < 0:
+    parser.error('--repetitions must be positive and --warmup must not be negative')
+
+  try:
+    shapes = parse_list(args.shapes, parse_shape)
+  except argparse.ArgumentTypeError as e:
+    parser.error(str(e))
+
+  thread_counts = parse_list(args.threads, int)
+  mpirun = shlex.split(args.mpirun)
+
+  names = parse_list(args.variants, str)
+  for name in names:
+    if name not in VARIANTS:
+      parser.error("unknown variant '%s'" % name)
+
+  results = []
+  for name in names:
+    variant = VARIANTS[name]
+    if not os.path.exists(os.path.join(DIRECTORY, name)):
+      print('Skipping %s, which has not been built' % name, file=sys.stderr)
+      continue
+
+    for shape in shapes:
+      if shape[0] * shape[2] > variant.get('max_cells', math.inf):
+        print('Skipping %s for %dx%dx%d, which is too large' % ((name,) + shape), file=sys.stderr)
+        continue
+
+      for processes, threads in configurations(variant, thread_counts):
+        print('Running %s for %dx%dx%d with %d process(es) of %d thread(s)' % ((name,) + shape + (processes, threads)), file=sys.stderr)
+        try:
+          results.append(benchmark(name, variant, shape, processes, threads, args, mpirun))
+        except (RuntimeError, subprocess.TimeoutExpired) as e:
+          print('  %s' % e, file=sys.stderr)
+
+  write = write_json if args.format == 'json' else write_csv
+  if args.output:
+    with open(args.output, 'w', newline='') as output:
+      write(results, output)
+  else:
+    write(results, sys.stdout)
+
+if __name__ == '__main__':
+  main()